@@ -0,0 +1,180 @@
+/******************************************************************************
+    rmtermbench -- throughput and idle CPU of the rmtermd relay
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*******************************************************************************/
+
+/*
+ * Runs rmtermd's relay loop, rmterm(), between one end of a
+ * SOCK_SEQPACKET socketpair (standing in for the DECnet link) and a pty
+ * with cat(1) on a raw slave, so everything sent comes straight back.
+ * Pushes <kbytes> through in <msgsize>-byte DTERM messages and back,
+ * reports the rate, then samples the relay's CPU time while the session
+ * sits idle.
+ *
+ *   rmtermbench [kbytes [msgsize]]     defaults 4096 and 64
+ *
+ * Built with the other apps but not installed.
+ */
+
+#define main rmtermd_main
+#include "rmtermd.c"
+#undef main
+
+#include <termios.h>
+#include <sys/time.h>
+#ifndef DNETUSE_DEVPTS
+#include <pty.h>
+#endif
+
+#define IDLE_SECS 2
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* utime + stime of a process, in clock ticks */
+static long cpu_ticks(pid_t pid)
+{
+	char	name[64];
+	char	buf[1024];
+	char	*p;
+	long	utime, stime;
+	FILE	*f;
+
+	snprintf(name, sizeof(name), "/proc/%d/stat", (int)pid);
+	if ((f = fopen(name, "r")) == NULL)
+		return -1;
+	if (!fgets(buf, sizeof(buf), f))
+		buf[0] = '\0';
+	fclose(f);
+
+	/* Fields 14 and 15, counted after the command name */
+	if ((p = strrchr(buf, ')')) == NULL ||
+	    sscanf(p+2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %ld %ld",
+		   &utime, &stime) != 2)
+		return -1;
+	return utime + stime;
+}
+
+int main(int argc, char *argv[])
+{
+	struct	termios	tio;
+	struct	pollfd	pfd;
+	long	total = 4096 * 1024L;
+	long	sent = 0, got = 0;
+	int	msgsize = 64;
+	int	sv[2];
+	int	slave;
+	char	msg[RMTERM_NETMSG];
+	char	buf[RMTERM_BUFSIZE];
+	pid_t	catpid, relay;
+	double	start, secs;
+	long	t0, t1;
+	int	i, cnt;
+
+	if (argc > 1) total = atol(argv[1]) * 1024L;
+	if (argc > 2) msgsize = atoi(argv[2]);
+	if (total <= 0 || msgsize < 1 || msgsize > RMTERM_NETMSG)
+	{
+		fprintf(stderr, "usage: %s [kbytes [msgsize]]\n", argv[0]);
+		return 2;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0 ||
+	    openpty(&pty, &slave, NULL, NULL, NULL) < 0)
+	{
+		perror("rmtermbench");
+		return 1;
+	}
+
+	/* cat on a raw slave sends back exactly what it's given */
+	tcgetattr(slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+
+	if ((catpid = fork()) == 0)
+	{
+		close(pty); close(sv[0]); close(sv[1]);
+		dup2(slave, 0);
+		dup2(slave, 1);
+		execlp("cat", "cat", (char *)0);
+		_exit(127);
+	}
+	close(slave);
+
+	if ((relay = fork()) == 0)
+	{
+		close(sv[0]);
+		net = sv[1];
+		rmterm();
+		_exit(0);
+	}
+	close(sv[1]);
+	close(pty);
+
+	/* Skip the banner */
+	read(sv[0], buf, sizeof(buf));
+
+	for (i = 0; i < msgsize; i++)
+		msg[i] = 'A' + i % 26;
+
+	fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+	start = now();
+	while (got < total)
+	{
+		pfd.fd = sv[0];
+		pfd.events = POLLIN;
+		/* Don't run too far ahead of the echo or the pty fills */
+		if (sent < total && sent - got < RMTERM_BUFSIZE)
+			pfd.events |= POLLOUT;
+		if (poll(&pfd, 1, 5000) <= 0)
+		{
+			fprintf(stderr, "rmtermbench: relay stalled at %ld/%ld bytes\n",
+				got, total);
+			break;
+		}
+		if (pfd.revents & POLLOUT)
+		{
+			cnt = total - sent < msgsize ? total - sent : msgsize;
+			if (write(sv[0], msg, cnt) == cnt)
+				sent += cnt;
+		}
+		if (pfd.revents & POLLIN)
+		{
+			cnt = read(sv[0], buf, sizeof(buf));
+			if (cnt == 0) break;
+			if (cnt > 0) got += cnt;
+		}
+	}
+	secs = now() - start;
+
+	printf("%d-byte messages: %ld KB each way in %.3fs, %.0f KB/s\n",
+	       msgsize, got / 1024, secs, got / 1024 / secs);
+
+	t0 = cpu_ticks(relay);
+	sleep(IDLE_SECS);
+	t1 = cpu_ticks(relay);
+	if (t0 >= 0 && t1 >= 0)
+		printf("idle CPU over %ds: %.1f%%\n", IDLE_SECS,
+		       100.0 * (t1 - t0) / sysconf(_SC_CLK_TCK) / IDLE_SECS);
+
+	/* Not through rmterm_reset(), this isn't a real login */
+	kill(relay, SIGKILL);
+	kill(catpid, SIGKILL);
+	waitpid(relay, NULL, 0);
+	waitpid(catpid, NULL, 0);
+	return got < total;
+}
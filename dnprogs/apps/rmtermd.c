@@ -45,6 +45,7 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <poll.h>
 #include <netdnet/dn.h>
 #include <netdnet/dnetdb.h>
 #ifdef DNETUSE_DEVPTS
@@ -57,6 +58,25 @@ static	struct	sockaddr_dn		sockaddr;
 static	char				*line;
 static	int				s,t,net,pty,len;
 static	int				read_present;
+
+/*
+ * Data waiting to go to the network (from the pty) and to the pty (from
+ * the network). Both descriptors are non-blocking and the relay only
+ * reads from one side while there is room to hold what it reads, so a
+ * slow reader just backs data up to its writer rather than stalling
+ * the other direction.
+ */
+#define RMTERM_BUFSIZE	4096
+#define RMTERM_NETMSG	512	/* Largest DTERM message we read */
+#define RMTERM_NETOUT	100	/* Largest we send, small nodes may not take more */
+
+struct rmterm_buf
+{
+	char	data[RMTERM_BUFSIZE];
+	int	start;
+	int	len;
+};
+static	struct	rmterm_buf		tonet, topty;
 /*-----------------------------------------------------------------------*/
 void rmterm_child(int s)
 {
@@ -115,9 +135,12 @@ void rmterm_purge(void)
 	ioctl(pty,FIONREAD,&numbytes);
 	while (numbytes)
 	{
-	 	read(pty,buf,numbytes);
+		if (numbytes > sizeof(buf)) numbytes = sizeof(buf);
+	 	if (read(pty,buf,numbytes) <= 0) break;
 		ioctl(pty,FIONREAD,&numbytes);
 	}
+	/* Anything not yet sent to the remote is flushed as well */
+	tonet.start = tonet.len = 0;
 }
 /*-----------------------------------------------------------------------*/
 void rmterm_write (char *buf)
@@ -130,14 +153,45 @@ void rmterm_write (char *buf)
 	
 }
 /*-----------------------------------------------------------------------*/
+/* Write as much of a buffer as the descriptor will take */
+static int rmterm_flush(int fd, struct rmterm_buf *b, int max)
+{
+	int	cnt;
+
+	while (b->len)
+	{
+		cnt = write(fd, b->data+b->start, b->len < max ? b->len : max);
+		if (cnt < 0)
+		{
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN) break;
+			return -1;
+		}
+		b->start += cnt;
+		b->len   -= cnt;
+	}
+	if (b->len == 0) b->start = 0;
+	return 0;
+}
+/*-----------------------------------------------------------------------*/
+/* Room at the end of a buffer, moving what is left down if need be */
+static int rmterm_space(struct rmterm_buf *b)
+{
+	if (b->start && b->start + b->len > RMTERM_BUFSIZE - RMTERM_NETMSG)
+	{
+		memmove(b->data, b->data+b->start, b->len);
+		b->start = 0;
+	}
+	return RMTERM_BUFSIZE - b->start - b->len;
+}
+/*-----------------------------------------------------------------------*/
 void rmterm (void)
 {
-	char	 buf[100];
-	struct	 timeval tv;
-	fd_set	 rdfs;
-	int	 cnt;
+	struct	 pollfd	pfd[2];
 	struct   sigaction siga;
 	sigset_t ss;
+	int	 cnt;
+	int	 net_hup = 0, pty_hup = 0;
 
 	setsid();
 
@@ -151,38 +205,73 @@ void rmterm (void)
 	signal(SIGTTOU, SIG_IGN);
 
 	rmterm_write("RMTERM Version 1.0.3\r\nDECnet for Linux\r\n\n");
-	
+
+	fcntl(pty, F_SETFL, fcntl(pty, F_GETFL) | O_NONBLOCK);
+	fcntl(net, F_SETFL, fcntl(net, F_GETFL) | O_NONBLOCK);
+
 	for (;;)
 	{
-		FD_ZERO(&rdfs);
-		FD_SET(pty,&rdfs);
-		tv.tv_sec = 0;
-		tv.tv_usec= 200;
-		
-		if (select(pty+1,&rdfs,NULL,NULL,&tv) > 0)
+		/* Only read a side if there is somewhere to put it, and only
+		   ask to write when something is queued. Nothing else wakes
+		   us up so an idle session just sleeps here. */
+		pfd[0].fd = pty;
+		pfd[0].events = 0;
+		if (rmterm_space(&tonet) > 0) pfd[0].events |= POLLIN;
+		if (topty.len) pfd[0].events |= POLLOUT;
+
+		pfd[1].fd = net;
+		pfd[1].events = 0;
+		if (rmterm_space(&topty) >= RMTERM_NETMSG) pfd[1].events |= POLLIN;
+		if (tonet.len) pfd[1].events |= POLLOUT;
+
+		/* A hung up side keeps saying so. Until there's room to read
+		   what it still has, leave it out so we don't spin. */
+		if (pty_hup && !(pfd[0].events & POLLIN)) pfd[0].fd = -1;
+		if (net_hup && !(pfd[1].events & POLLIN)) pfd[1].fd = -1;
+
+		if (poll(pfd, 2, -1) < 0)
 		{
-			if (FD_ISSET(pty,&rdfs))
-			{
-				cnt=read(pty,buf,sizeof(buf)-1);
-				buf[cnt]='\0';
-				rmterm_write(buf);
-			}
+			if (errno == EINTR) continue;
+			break;
 		}
-		FD_ZERO(&rdfs);
-		FD_SET(net,&rdfs);
-		tv.tv_sec = 0;
-		tv.tv_usec= 200;
-		
-		if (select(net+1,&rdfs,NULL,NULL,&tv) > 0)
+
+		if (pfd[1].revents & (POLLHUP|POLLERR))
+			net_hup = 1;
+		if (pfd[1].revents & (POLLIN|POLLHUP|POLLERR) &&
+		    rmterm_space(&topty) >= RMTERM_NETMSG)
 		{
-			if (FD_ISSET(net,&rdfs))
+			/* One read is one DTERM message */
+			char *p = topty.data + topty.start + topty.len;
+
+			cnt = read(net, p, RMTERM_NETMSG);
+			if (cnt == 0) break;
+			if (cnt < 0 && errno != EAGAIN && errno != EINTR) break;
+			if (cnt > 0)
 			{
-				cnt=read(net,buf,sizeof(buf));
-				if (buf[0] == 3)
+				if (p[0] == 3)
+				{
 					rmterm_purge();
-				write(pty,buf,cnt);
+					pfd[0].revents &= ~POLLIN;
+				}
+				topty.len += cnt;
 			}
 		}
+
+		if (pfd[0].revents & (POLLHUP|POLLERR))
+			pty_hup = 1;
+		if (pfd[0].revents & (POLLIN|POLLHUP|POLLERR) &&
+		    rmterm_space(&tonet) > 0)
+		{
+			cnt = read(pty, tonet.data + tonet.start + tonet.len,
+				   rmterm_space(&tonet));
+			/* EIO means login has gone away and SIGCHLD will follow */
+			if (cnt == 0) break;
+			if (cnt < 0 && errno != EAGAIN && errno != EINTR) break;
+			if (cnt > 0) tonet.len += cnt;
+		}
+
+		if (rmterm_flush(pty, &topty, RMTERM_BUFSIZE) < 0) break;
+		if (rmterm_flush(net, &tonet, RMTERM_NETOUT) < 0) break;
 	}
 	rmterm_reset(0);
 }
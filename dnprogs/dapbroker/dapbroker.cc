@@ -0,0 +1,318 @@
+/******************************************************************************
+    dapbroker.cc
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+ ******************************************************************************
+ */
+// Per-user DAP session broker.
+//
+// When a DAP client (dndir, dncopy, dndel, librms...) has finished with
+// a FAL link cleanly it hands it here instead of disconnecting. The
+// next client that wants a link to the same node, object and user gets
+// it back already configured, saving the connect and the CONFIG
+// exchange. Links that nobody wants are closed after a short time.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <syslog.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdnet/dn.h>
+
+#include "logging.h"
+#include "broker.h"
+
+#define MAX_LINKS 64
+
+struct idle_link
+{
+    struct dap_broker_msg key;
+    int    fd;
+    time_t parked;
+};
+
+static struct idle_link links[MAX_LINKS];
+static int nlinks;
+static int max_links = 16;
+static int idle_time = 30;
+static int verbose;
+
+static void drop_link(int i)
+{
+    if (verbose)
+        DAPLOG((LOG_DEBUG, "closing idle link %d\n", links[i].fd));
+    close(links[i].fd);
+    memmove(&links[i], &links[i+1], (nlinks-i-1)*sizeof(struct idle_link));
+    nlinks--;
+}
+
+// An idle FAL link should have nothing to say. If it's readable then
+// the other end has gone away (or is confused) so it's no use to anyone.
+static bool link_dead(int i)
+{
+    struct pollfd pfd;
+
+    pfd.fd = links[i].fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) != 0;
+}
+
+static void expire_links(time_t now)
+{
+    int i = 0;
+
+    while (i < nlinks)
+    {
+        if (now - links[i].parked >= idle_time)
+            drop_link(i);
+        else
+            i++;
+    }
+}
+
+// Most recently parked links are at the end, hand those out first.
+static void get_link(int csock, struct dap_broker_msg *msg)
+{
+    int i;
+
+    for (i = nlinks-1; i >= 0; i--)
+    {
+        if (!dap_broker_match(&links[i].key, msg))
+            continue;
+
+        if (link_dead(i))
+        {
+            drop_link(i);
+            continue;
+        }
+
+        msg->type = DAP_BROKER_HIT;
+        msg->blocksize = links[i].key.blocksize;
+        msg->remote_os = links[i].key.remote_os;
+        if (dap_broker_send(csock, msg, links[i].fd))
+        {
+            if (verbose)
+                DAPLOG((LOG_DEBUG, "handed out link %d\n", links[i].fd));
+            drop_link(i);
+            return;
+        }
+        // Client has gone, keep the link for someone else
+        return;
+    }
+
+    msg->type = DAP_BROKER_MISS;
+    dap_broker_send(csock, msg, -1);
+}
+
+static void put_link(struct dap_broker_msg *msg, int fd)
+{
+    if (fd == -1)
+        return;
+
+    if (nlinks == max_links)
+        drop_link(0);
+
+    memcpy(&links[nlinks].key, msg, sizeof(*msg));
+    links[nlinks].key.type = 0;
+    links[nlinks].fd = fd;
+    links[nlinks].parked = time(NULL);
+    nlinks++;
+
+    if (verbose)
+        DAPLOG((LOG_DEBUG, "parked link %d\n", fd));
+}
+
+static void do_request(int lsock)
+{
+    struct dap_broker_msg msg;
+    struct ucred cred;
+    socklen_t credlen = sizeof(cred);
+    struct timeval tv = {2, 0};
+    int csock;
+    int fd;
+
+    csock = accept4(lsock, NULL, NULL, SOCK_CLOEXEC);
+    if (csock == -1)
+        return;
+
+    // Links carry the user's password, only deal with ourself
+    if (getsockopt(csock, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) == -1 ||
+        cred.uid != getuid())
+    {
+        close(csock);
+        return;
+    }
+    setsockopt(csock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(csock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    if (dap_broker_recv(csock, &msg, &fd))
+    {
+        switch (msg.type)
+        {
+        case DAP_BROKER_GET:
+            get_link(csock, &msg);
+            break;
+
+        case DAP_BROKER_PUT:
+            put_link(&msg, fd);
+            fd = -1;
+            break;
+        }
+    }
+    if (fd != -1) close(fd);
+    close(csock);
+}
+
+static void usage(FILE *f)
+{
+    fprintf(f, "\nusage: dapbroker [options]\n\n");
+    fprintf(f, " Options\n");
+    fprintf(f, "  -t <secs>  Close links idle for this long (default 30)\n");
+    fprintf(f, "  -n <num>   Maximum number of idle links (default 16)\n");
+    fprintf(f, "  -d         Don't fork and log to stderr\n");
+    fprintf(f, "  -v         Verbose logging\n");
+    fprintf(f, "  -h         Display this help\n");
+    fprintf(f, "  -V         Show version\n");
+    fprintf(f, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct pollfd pfds[MAX_LINKS+1];
+    bool dont_fork = false;
+    int lsock;
+    int opt;
+
+    opterr = 0;
+    while ((opt=getopt(argc,argv,"?hvVdt:n:")) != EOF)
+    {
+        switch(opt)
+        {
+        case 'h':
+            usage(stdout);
+            exit(0);
+
+        case '?':
+            usage(stderr);
+            exit(1);
+
+        case 'v':
+            verbose++;
+            break;
+
+        case 'd':
+            dont_fork = true;
+            break;
+
+        case 't':
+            idle_time = atoi(optarg);
+            if (idle_time < 1)
+            {
+                fprintf(stderr, "Invalid idle time\n");
+                exit(1);
+            }
+            break;
+
+        case 'n':
+            max_links = atoi(optarg);
+            if (max_links < 1 || max_links > MAX_LINKS)
+            {
+                fprintf(stderr, "Number of links must be between 1 and %d\n",
+                        MAX_LINKS);
+                exit(1);
+            }
+            break;
+
+        case 'V':
+            printf("\ndapbroker from dnprogs version %s\n\n", VERSION);
+            exit(1);
+            break;
+        }
+    }
+
+    lsock = dap_broker_listen();
+    if (lsock == -1)
+    {
+        if (errno == EADDRINUSE)
+            fprintf(stderr, "dapbroker is already running\n");
+        else
+            perror("dapbroker: socket");
+        exit(2);
+    }
+
+    if (dont_fork)
+    {
+        init_logging("dapbroker", 'e', false);
+    }
+    else
+    {
+        switch (fork())
+        {
+        case -1:
+            perror("dapbroker: fork");
+            exit(2);
+        case 0:
+            break;
+        default:
+            exit(0);
+        }
+        setsid();
+        chdir("/");
+        close(0); close(1); close(2);
+        init_logging("dapbroker", 's', false);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    for (;;)
+    {
+        time_t now = time(NULL);
+        int timeout = -1;
+        int i;
+
+        expire_links(now);
+
+        pfds[0].fd = lsock;
+        pfds[0].events = POLLIN;
+        for (i = 0; i < nlinks; i++)
+        {
+            pfds[i+1].fd = links[i].fd;
+            pfds[i+1].events = POLLIN;
+        }
+
+        // The oldest link is the next one to expire
+        if (nlinks)
+            timeout = (links[0].parked + idle_time - now) * 1000;
+
+        if (poll(pfds, nlinks+1, timeout) < 0)
+        {
+            if (errno == EINTR) continue;
+            DAPLOG((LOG_ERR, "poll: %s\n", strerror(errno)));
+            exit(2);
+        }
+
+        // Drop links the other end has closed, from the top down so
+        // the indices stay valid.
+        for (i = nlinks-1; i >= 0; i--)
+        {
+            if (pfds[i+1].revents)
+                drop_link(i);
+        }
+
+        if (pfds[0].revents & POLLIN)
+            do_request(lsock);
+    }
+}
@@ -0,0 +1,342 @@
+/******************************************************************************
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+ ******************************************************************************
+ */
+/* Block cache for random access reads of files opened in block mode.
+
+   Each open file has its own hash of 512 byte pages keyed by block
+   number, all pages are also on one global LRU list so that the total
+   memory used by all open files stays inside the budget set with
+   the cachesize= mount option.
+ */
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include "blockcache.h"
+
+#define VMS_BLOCK_SIZE  512
+#define CACHE_HASH_SIZE 512
+
+struct cache_page
+{
+	struct block_cache *owner;
+	unsigned int blk;	/* Block number, from zero */
+	int len;		/* Bytes valid, <512 only at EOF */
+	struct cache_page *hash_next;
+	struct cache_page *lru_prev;
+	struct cache_page *lru_next;
+	unsigned char data[VMS_BLOCK_SIZE];
+};
+
+struct block_cache
+{
+	block_fetch_fn fetch;
+	void *arg;
+	int maxblocks;		/* Largest request we can send */
+	unsigned int eof_blk;	/* First block known to be beyond EOF */
+	off_t size;		/* File size last reported, -1 if unknown */
+	unsigned int next_blk;	/* Block after the end of the last read */
+	char *xferbuf;
+	pthread_mutex_t fetch_lock;
+	struct cache_page *hash[CACHE_HASH_SIZE];
+};
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Most recently used at the head */
+static struct cache_page *lru_head;
+static struct cache_page *lru_tail;
+static size_t cache_pages;
+static size_t cache_budget = (16*1024*1024) / VMS_BLOCK_SIZE;
+
+static void lru_unlink(struct cache_page *p)
+{
+	if (p->lru_prev)
+		p->lru_prev->lru_next = p->lru_next;
+	else
+		lru_head = p->lru_next;
+
+	if (p->lru_next)
+		p->lru_next->lru_prev = p->lru_prev;
+	else
+		lru_tail = p->lru_prev;
+}
+
+static void lru_push(struct cache_page *p)
+{
+	p->lru_prev = NULL;
+	p->lru_next = lru_head;
+	if (lru_head)
+		lru_head->lru_prev = p;
+	lru_head = p;
+	if (!lru_tail)
+		lru_tail = p;
+}
+
+static struct cache_page *lookup(struct block_cache *bc, unsigned int blk)
+{
+	struct cache_page *p;
+
+	for (p = bc->hash[blk % CACHE_HASH_SIZE]; p; p = p->hash_next)
+		if (p->blk == blk)
+			return p;
+	return NULL;
+}
+
+static void unhash(struct cache_page *p)
+{
+	struct cache_page **pp = &p->owner->hash[p->blk % CACHE_HASH_SIZE];
+
+	while (*pp != p)
+		pp = &(*pp)->hash_next;
+	*pp = p->hash_next;
+}
+
+static void drop_page(struct cache_page *p)
+{
+	unhash(p);
+	lru_unlink(p);
+	free(p);
+	cache_pages--;
+}
+
+/* Called with cache_lock held */
+static void insert(struct block_cache *bc, unsigned int blk,
+		   const char *data, int len)
+{
+	struct cache_page *p;
+
+	if (!cache_budget)
+		return;
+
+	p = lookup(bc, blk);
+	if (p) {
+		lru_unlink(p);
+	}
+	else {
+		while (cache_pages >= cache_budget && lru_tail)
+			drop_page(lru_tail);
+
+		p = malloc(sizeof(struct cache_page));
+		if (!p)
+			return;
+		p->owner = bc;
+		p->blk = blk;
+		p->hash_next = bc->hash[blk % CACHE_HASH_SIZE];
+		bc->hash[blk % CACHE_HASH_SIZE] = p;
+		cache_pages++;
+	}
+	memcpy(p->data, data, len);
+	p->len = len;
+	lru_push(p);
+}
+
+/* Copy the part of [start, start+len) that overlaps the caller's
+   request into their buffer */
+static size_t copy_out(char *buf, off_t offset, size_t size,
+		       off_t start, const void *data, size_t len)
+{
+	off_t from = start > offset ? start : offset;
+	off_t to = start + len;
+
+	if (to > offset + (off_t)size)
+		to = offset + size;
+	if (to <= from)
+		return 0;
+
+	memcpy(buf + (from - offset), (const char *)data + (from - start), to - from);
+	return to - from;
+}
+
+struct block_cache *block_cache_alloc(block_fetch_fn fetch, void *arg, int maxblocks)
+{
+	struct block_cache *bc;
+
+	bc = calloc(1, sizeof(struct block_cache));
+	if (!bc)
+		return NULL;
+
+	if (maxblocks < 1)
+		maxblocks = 1;
+
+	bc->xferbuf = malloc(maxblocks * VMS_BLOCK_SIZE);
+	if (!bc->xferbuf) {
+		free(bc);
+		return NULL;
+	}
+	bc->fetch = fetch;
+	bc->arg = arg;
+	bc->maxblocks = maxblocks;
+	bc->eof_blk = UINT_MAX;
+	bc->size = -1;
+	pthread_mutex_init(&bc->fetch_lock, NULL);
+
+	return bc;
+}
+
+/* Forget blk and everything after it, and where EOF was. Called with
+   cache_lock held */
+static void forget_tail(struct block_cache *bc, unsigned int blk)
+{
+	struct cache_page *p, *next;
+	int i;
+
+	for (i = 0; i < CACHE_HASH_SIZE; i++) {
+		for (p = bc->hash[i]; p; p = next) {
+			next = p->hash_next;
+			if (p->blk >= blk)
+				drop_page(p);
+		}
+	}
+	bc->eof_blk = UINT_MAX;
+}
+
+/* The file is now this big, as far as stat knows. If that isn't what it
+   was then the old last block and EOF can't be trusted */
+void block_cache_set_size(struct block_cache *bc, off_t size)
+{
+	off_t old;
+
+	pthread_mutex_lock(&cache_lock);
+	old = bc->size;
+	bc->size = size;
+	if (old != -1 && old != size) {
+		if (old < size)
+			size = old;
+		forget_tail(bc, size / VMS_BLOCK_SIZE);
+	}
+	pthread_mutex_unlock(&cache_lock);
+}
+
+void block_cache_invalidate(struct block_cache *bc)
+{
+	int i;
+
+	pthread_mutex_lock(&cache_lock);
+	for (i = 0; i < CACHE_HASH_SIZE; i++) {
+		while (bc->hash[i])
+			drop_page(bc->hash[i]);
+	}
+	bc->eof_blk = UINT_MAX;
+	pthread_mutex_unlock(&cache_lock);
+}
+
+void block_cache_free(struct block_cache *bc)
+{
+	if (!bc)
+		return;
+
+	block_cache_invalidate(bc);
+	pthread_mutex_destroy(&bc->fetch_lock);
+	free(bc->xferbuf);
+	free(bc);
+}
+
+void block_cache_set_budget(size_t bytes)
+{
+	pthread_mutex_lock(&cache_lock);
+	cache_budget = bytes / VMS_BLOCK_SIZE;
+	while (cache_pages > cache_budget && lru_tail)
+		drop_page(lru_tail);
+	pthread_mutex_unlock(&cache_lock);
+}
+
+/* Satisfy a read from the cache, fetching any missing blocks from the
+   server. Adjacent missing blocks are fetched in one request and, if
+   this read carries on from where the last one stopped, the request is
+   filled up with the blocks that follow. */
+int block_cache_read(struct block_cache *bc, char *buf, size_t size, off_t offset)
+{
+	unsigned int blk;
+	unsigned int last;
+	size_t copied = 0;
+	int sequential;
+	int res = 0;
+
+	if (!size)
+		return 0;
+
+	blk = offset / VMS_BLOCK_SIZE;
+	last = (offset + size - 1) / VMS_BLOCK_SIZE;
+	sequential = (blk == bc->next_blk);
+
+	pthread_mutex_lock(&bc->fetch_lock);
+
+	/* The file may have grown since we saw its end, so anything at or
+	   past the last block we had is read from the server again */
+	pthread_mutex_lock(&cache_lock);
+	if (bc->eof_blk != UINT_MAX && last + 1 >= bc->eof_blk)
+		forget_tail(bc, bc->eof_blk ? bc->eof_blk - 1 : 0);
+	pthread_mutex_unlock(&cache_lock);
+
+	while (blk <= last && blk < bc->eof_blk)
+	{
+		struct cache_page *p;
+		int nblocks;
+		int len;
+
+		pthread_mutex_lock(&cache_lock);
+		p = lookup(bc, blk);
+		if (p) {
+			lru_unlink(p);
+			lru_push(p);
+			copied += copy_out(buf, offset, size, (off_t)blk * VMS_BLOCK_SIZE,
+					   p->data, p->len);
+			len = p->len;
+			pthread_mutex_unlock(&cache_lock);
+
+			blk++;
+			if (len < VMS_BLOCK_SIZE)
+				break;
+			continue;
+		}
+
+		/* Gather up all the missing blocks we can */
+		nblocks = 1;
+		while (nblocks < bc->maxblocks &&
+		       (blk + nblocks <= last || sequential) &&
+		       blk + nblocks < bc->eof_blk &&
+		       !lookup(bc, blk + nblocks))
+			nblocks++;
+		pthread_mutex_unlock(&cache_lock);
+
+		res = bc->fetch(bc->arg, blk + 1, nblocks, bc->xferbuf);
+		if (res < 0)
+			break;
+
+		pthread_mutex_lock(&cache_lock);
+		for (len = 0; len < res; len += VMS_BLOCK_SIZE) {
+			int pagelen = res - len;
+
+			if (pagelen > VMS_BLOCK_SIZE)
+				pagelen = VMS_BLOCK_SIZE;
+			insert(bc, blk + len / VMS_BLOCK_SIZE, bc->xferbuf + len, pagelen);
+		}
+		if (res < nblocks * VMS_BLOCK_SIZE)
+			bc->eof_blk = blk + (res + VMS_BLOCK_SIZE - 1) / VMS_BLOCK_SIZE;
+		pthread_mutex_unlock(&cache_lock);
+
+		copied += copy_out(buf, offset, size, (off_t)blk * VMS_BLOCK_SIZE,
+				   bc->xferbuf, res);
+
+		if (res < nblocks * VMS_BLOCK_SIZE)
+			break;
+		blk += nblocks;
+	}
+	bc->next_blk = last + 1;
+	pthread_mutex_unlock(&bc->fetch_lock);
+
+	if (res < 0 && !copied)
+		return res;
+	return copied;
+}
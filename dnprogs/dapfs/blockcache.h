@@ -0,0 +1,30 @@
+/******************************************************************************
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+ ******************************************************************************
+ */
+/* blockcache.c */
+
+/* Sparse cache of 512 byte VMS blocks for one open file. Pages from
+   all open files share a single memory budget and are thrown away
+   least recently used first. */
+struct block_cache;
+
+/* Read nblocks blocks starting at (1-based) vbn into buf. Returns the
+   number of bytes read, less than nblocks*512 at end of file, or a
+   negative errno */
+typedef int (*block_fetch_fn)(void *arg, unsigned int vbn, int nblocks, char *buf);
+
+struct block_cache *block_cache_alloc(block_fetch_fn fetch, void *arg, int maxblocks);
+void block_cache_free(struct block_cache *bc);
+void block_cache_invalidate(struct block_cache *bc);
+void block_cache_set_size(struct block_cache *bc, off_t size);
+int  block_cache_read(struct block_cache *bc, char *buf, size_t size, off_t offset);
+void block_cache_set_budget(size_t bytes);
@@ -30,6 +30,7 @@
 #include <syslog.h>
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/statfs.h>
 #include <netdnet/dn.h>
 #include "rms.h"
@@ -37,6 +38,7 @@
 #include "dapfs_dap.h"
 #include "filenames.h"
 #include "kfifo.h"
+#include "blockcache.h"
 
 #define RMS_BUF_SIZE 65536
 
@@ -49,14 +51,31 @@ struct dapfs_handle
 	int rfm;
 	int mrs;
 	int fsz;
+	/* Read using BLOCKFT rather than record GETs */
+	int blockxfer;
+	/* Bytes asked for by each block mode GET */
+	int xfersize;
 	/* Last known offset in the file */
 	off_t offset;
 	// Circular buffer of data read from VMS
 	struct kfifo *kf;
+	// Blocks read from VMS, for random access in block mode
+	struct block_cache *bcache;
+	// On the list of cached files, so stat can tell the cache the size
+	char *path;
+	struct dapfs_handle *next_cached;
 };
 
+static struct dapfs_handle *cached_files;
+static pthread_mutex_t cached_files_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const int BLOCKMODE_RECORD = 0;
+static const int BLOCKMODE_BLOCK  = 1;
+static const int BLOCKMODE_AUTO   = 2;
+
 static char mountdir[BUFLEN];
-static int blockmode = 0; // Default to record mode
+static int blockmode = BLOCKMODE_AUTO; // Choose per file from its attributes
+static long cachesize = 16384; // KB of block cache shared by all open files
 char prefix[BUFLEN];
 int debuglevel = 0;
 
@@ -75,6 +94,10 @@ static const int RFM_STM = 4;
 static const int RFM_STMLF = 5;
 static const int RFM_STMCR = 6;
 
+static const int ORG_SEQ = 0; // RMS ORG values from fab.h
+
+static const int VMS_BLOCK_SIZE = 512;
+
 /* Convert RMS record carriage control into something more unixy */
 static int convert_rms_record(char *buf, int len, struct dapfs_handle *fh)
 {
@@ -125,6 +148,118 @@ static int convert_rms_record(char *buf, int len, struct dapfs_handle *fh)
 	return retlen;
 }
 
+/* Work out whether a file should be read in blocks or records.
+   Sequential files with no carriage control (FIX or UDF, eg.
+   executables, backup savesets and zip files) are read as blocks,
+   anything that looks like text goes through record mode so that
+   convert_rms_record() can give it Unix line endings. */
+static int use_block_transfers(struct dapfs_handle *h)
+{
+	if (blockmode != BLOCKMODE_AUTO)
+		return blockmode == BLOCKMODE_BLOCK;
+
+	if (h->org != ORG_SEQ)
+		return 0;
+
+	if (h->rfm != RFM_FIX && h->rfm != RFM_UDF)
+		return 0;
+
+	if (h->rat & (RAT_CR | RAT_PRN | RAT_FTN))
+		return 0;
+
+	return 1;
+}
+
+/* Largest whole number of VMS blocks that fits in one DATA message */
+static int block_transfer_size(RMSHANDLE rmsh)
+{
+	int size = rms_blocksize(rmsh);
+
+	// Leave room for the DATA message header
+	size -= 32;
+	if (size > RMS_BUF_SIZE)
+		size = RMS_BUF_SIZE;
+
+	size -= size % VMS_BLOCK_SIZE;
+	if (size < VMS_BLOCK_SIZE)
+		size = VMS_BLOCK_SIZE;
+
+	return size;
+}
+
+/* Called by the block cache to read blocks it doesn't have */
+static int fetch_blocks(void *arg, unsigned int vbn, int nblocks, char *buf)
+{
+	struct dapfs_handle *h = arg;
+	struct RAB rab;
+	unsigned char key[4];
+	int res;
+
+	if (debuglevel&2)
+		fprintf(stderr, "fetch_blocks (%p): vbn=%u, count=%d\n", h->rmsh, vbn, nblocks);
+
+	/* Key is the VBN as a little-endian longword */
+	key[0] = vbn & 0xFF;
+	key[1] = (vbn >> 8) & 0xFF;
+	key[2] = (vbn >> 16) & 0xFF;
+	key[3] = (vbn >> 24) & 0xFF;
+
+	memset(&rab, 0, sizeof(rab));
+	rab.rab$b_rac = 4; // BLOCK
+	rab.rab$l_kbf = key;
+	rab.rab$b_ksz = sizeof(key);
+	rab.rab$w_usz = nblocks * VMS_BLOCK_SIZE;
+
+	res = rms_read(h->rmsh, buf, nblocks * VMS_BLOCK_SIZE, &rab);
+	if (res < 0) {
+		if (debuglevel&2)
+			fprintf(stderr, "fetch_blocks: res=%d, rms error: %s\n", res, rms_lasterror(h->rmsh));
+		return -EIO;
+	}
+	return res;
+}
+
+static void cached_file_add(struct dapfs_handle *h, const char *path)
+{
+	h->path = strdup(path);
+	if (!h->path)
+		return;
+	pthread_mutex_lock(&cached_files_lock);
+	h->next_cached = cached_files;
+	cached_files = h;
+	pthread_mutex_unlock(&cached_files_lock);
+}
+
+static void cached_file_remove(struct dapfs_handle *h)
+{
+	struct dapfs_handle **hp;
+
+	if (!h->path)
+		return;
+	pthread_mutex_lock(&cached_files_lock);
+	for (hp = &cached_files; *hp; hp = &(*hp)->next_cached) {
+		if (*hp == h) {
+			*hp = h->next_cached;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&cached_files_lock);
+	free(h->path);
+}
+
+/* Let the block caches of open copies of a file know how big stat says
+   it is, so they notice it growing or shrinking */
+static void cached_file_size(const char *path, off_t size)
+{
+	struct dapfs_handle *h;
+
+	pthread_mutex_lock(&cached_files_lock);
+	for (h = cached_files; h; h = h->next_cached)
+		if (!strcmp(h->path, path))
+			block_cache_set_size(h->bcache, size);
+	pthread_mutex_unlock(&cached_files_lock);
+}
+
 static int dapfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 			 off_t offset, struct fuse_file_info *fi)
 {
@@ -347,8 +482,11 @@ static int dapfs_open(const char *path, struct fuse_file_info *fi)
 	if (fi->flags & O_CREAT)
 		fab.fab$b_rfm = RFM_STMLF;
 
-	/* Block transfers */
-	if (blockmode && !(fi->flags & O_CREAT))
+	/* Block transfers. In auto mode we don't know what sort of file
+	   this is until it's open, so ask for BRO access which lets us do
+	   either record or block reads afterwards. */
+	if ((blockmode == BLOCKMODE_BLOCK && !(fi->flags & O_CREAT)) ||
+	    (blockmode == BLOCKMODE_AUTO && (fi->flags & O_ACCMODE) == O_RDONLY))
 	{
 		fab.fab$b_fac = FAB$M_BRO | FAB$M_GET;
 		fab.fab$b_shr = FAB$M_GET;
@@ -378,6 +516,19 @@ static int dapfs_open(const char *path, struct fuse_file_info *fi)
 	h->mrs = fab.fab$w_mrs;
 	h->fsz = fab.fab$b_fsz;
 
+	if (blockmode == BLOCKMODE_BLOCK || (fi->flags & O_ACCMODE) == O_RDONLY)
+		h->blockxfer = use_block_transfers(h);
+	if (h->blockxfer)
+		h->xfersize = block_transfer_size(h->rmsh);
+	if (h->blockxfer && cachesize)
+		h->bcache = block_cache_alloc(fetch_blocks, h, h->xfersize / VMS_BLOCK_SIZE);
+	if (h->bcache)
+		cached_file_add(h, path);
+
+	if (debuglevel&2)
+		fprintf(stderr, "dapfs_open: org=%d, rfm=%d, rat=%d: using %s mode\n",
+			h->org, h->rfm, h->rat, h->blockxfer?"block":"record");
+
 	fi->fh = (unsigned long)h;
 	h->offset = 0;
 	return 0;
@@ -406,6 +557,15 @@ static int dapfs_read(const char *path, char *buf, size_t size, off_t offset,
 
 	}
 
+	if (h->bcache) {
+		res = block_cache_read(h->bcache, buf, size, offset);
+		if (res > 0)
+			h->offset = offset + res;
+		if (debuglevel&1)
+			fprintf(stderr, "dapfs_read: returning %d from cache, offset=%lld\n", res, h->offset);
+		return res;
+	}
+
 	memset(&rab, 0, sizeof(rab));
 	if (offset && offset != h->offset) {
 		if (debuglevel&2)
@@ -422,8 +582,10 @@ static int dapfs_read(const char *path, char *buf, size_t size, off_t offset,
 		kfifo_reset(h->kf);
 	}
 
-	if (blockmode)
+	if (h->blockxfer) {
 		rab.rab$b_rac = 5; // BLOCKFT
+		rab.rab$w_usz = h->xfersize;
+	}
 
 	if (debuglevel&1)
 		fprintf(stderr, "dapfs_read: kf space available = %d, free=%d, size=%d\n", kfifo_len(h->kf), kfifo_avail(h->kf), size);
@@ -436,9 +598,9 @@ static int dapfs_read(const char *path, char *buf, size_t size, off_t offset,
 			fprintf(stderr, "dapfs_read: size=%d, kfifo_len()=%d\n", size, kfifo_len(h->kf));
 
 		// -2 here allows for convert_rms_record to add delimiters
-		res = rms_read(h->rmsh, tmpbuf, kfifo_avail(h->kf) - ((blockmode==0)?2:0), &rab);
+		res = rms_read(h->rmsh, tmpbuf, kfifo_avail(h->kf) - ((h->blockxfer==0)?2:0), &rab);
 
-		if (debuglevel&1 & !blockmode)
+		if (debuglevel&1 & !h->blockxfer)
 		{
 			tmpbuf[res] = '\0';
 			fprintf(stderr, "dapfs_read: res=%d. data='%s'\n", res, tmpbuf);
@@ -462,7 +624,7 @@ static int dapfs_read(const char *path, char *buf, size_t size, off_t offset,
 
 		// Convert to records (if needed) and add to circular buffer.
 		if (res >= 0 && !rms_lasterror(h->rmsh)) {
-			if (!blockmode)
+			if (!h->blockxfer)
 				res = convert_rms_record(tmpbuf, res, h);
 
 			kfifo_put(h->kf, (unsigned char *)tmpbuf, res);
@@ -507,6 +669,9 @@ static int dapfs_write(const char *path, const char *buf, size_t size,
 
 	if (debuglevel)
 		fprintf(stderr, "dapfs_write (%p). offset=%d, (%p) fh->offset=%d\n", h->rmsh, (int)offset, h, (int)h->offset);
+	if (h->bcache)
+		block_cache_invalidate(h->bcache);
+
 	memset(&rab, 0, sizeof(rab));
 	if (offset && offset != h->offset) {
 		rab.rab$l_kbf = &offset;
@@ -542,6 +707,8 @@ static int dapfs_release(const char *path, struct fuse_file_info *fi)
 
 	ret = rms_close(h->rmsh);
 	kfifo_free(h->kf);
+	cached_file_remove(h);
+	block_cache_free(h->bcache);
 	free(h);
 	fi->fh = 0L;
 
@@ -570,6 +737,9 @@ static int dapfs_getattr(const char *path, struct stat *stbuf)
 			sprintf(dirname, "%s.dir", path);
 			res = dapfs_getattr_dap(dirname, stbuf);
 		}
+		else if (res == 0 && S_ISREG(stbuf->st_mode)) {
+			cached_file_size(path, stbuf->st_size);
+		}
 	}
 	if (debuglevel&1)
 		fprintf(stderr, "dapfs_getattr: returning %d\n", res);
@@ -629,11 +799,19 @@ static int process_options(char *options)
 			processed = 1;
 		}
 		if (strncmp("block", optptr, 5) == 0) {
-			blockmode = 1;
+			blockmode = BLOCKMODE_BLOCK;
 			processed = 1;
 		}
 		if (strncmp("record", optptr, 6) == 0) {
-			blockmode = 0;
+			blockmode = BLOCKMODE_RECORD;
+			processed = 1;
+		}
+		if (strncmp("cachesize=", optptr, 10) == 0 && option) {
+			cachesize = atol(option);
+			processed = 1;
+		}
+		if (strncmp("auto", optptr, 4) == 0) {
+			blockmode = BLOCKMODE_AUTO;
 			processed = 1;
 		}
 		t = strtok(NULL, ",");
@@ -710,9 +888,11 @@ int main(int argc, char *argv[])
 	if (debuglevel&2)
 		fprintf(stderr, "prefix is now: %s\n", prefix);
 
-	if (debuglevel&2 && blockmode)
+	if (debuglevel&2 && blockmode == BLOCKMODE_BLOCK)
 		fprintf(stderr, "Sending files in BLOCK mode\n");
 
+	block_cache_set_budget(cachesize * 1024);
+
 	// Make a scratch connection - also verifies the path name nice and early
 	if (dap_init()) {
 		syslog(LOG_ERR, "Cannot connect to '%s'\n", prefix);
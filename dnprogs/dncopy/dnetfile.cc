@@ -43,6 +43,7 @@ dnetfile::dnetfile(const char *n, int verbosity):
     conn(verbosity)
 {
     isOpen = FALSE;
+    idle = FALSE;
     verbose = verbosity;
     lasterror = NULL;
     protection = NULL;
@@ -127,6 +128,7 @@ int dnetfile::open(const char *mode)
     int real_rfm, real_rat;
     int status;
 
+    idle = FALSE;
     switch (mode[0])
     {
     case 'r':
@@ -277,6 +279,7 @@ int dnetfile::next()
     if ( ((status = dap_get_file_entry(&real_rfm, &real_rat))) )
     {
 	if (status != -2) perror("last file");
+	else idle = TRUE;
 	return FALSE; // No more files.
     }
     else
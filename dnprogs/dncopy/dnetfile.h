@@ -45,6 +45,7 @@ public:
     bool  wildcard; // Is a wildcard file name
     bool  isOpen;   // Set when we have an open connection
     bool  writing;  // if FALSE then we are reading.
+    bool  idle;     // Link is between operations, can be parked
     const char *lasterror;
     char  errstring[80];
     int   verbose;
@@ -38,6 +38,9 @@
 void dnetfile::dap_close_link()
 {
     if (verbose > 2) DAPLOG((LOG_INFO, "in dap_close_link()\n"));
+
+    // Let the session broker keep it if FAL is waiting for a new ACCESS
+    if (idle) conn.park();
     conn.close();
 }
 /*-------------------------------------------------------------------------*/
@@ -258,7 +261,11 @@ int dnetfile::dap_send_accomp()
     conn.set_blocked(false);
 
     if (writing)
-	return dap_get_reply();
+    {
+	int status = dap_get_reply();
+	idle = (status == 0);
+	return status;
+    }
     else
 	return 0;
 }
@@ -23,12 +23,16 @@
 #include <netdnet/dn.h>
 #include <netdnet/dnetdb.h>
 #include <unistd.h>
+#include <poll.h>
 #include <regex.h>
 
 #include "connection.h"
 #include "protocol.h"
 #include "logging.h"
 
+// Most ERASE requests we let FAL have outstanding on the delete link
+#define MAX_PENDING 256
+
 
 static void usage(void)
 {
@@ -39,6 +43,8 @@ static void usage(void)
     printf("\nOptions:\n");
     printf("  -i           interactive - prompt before deleting\n");
     printf("  -v           verbose - display files that have been deleted\n");
+    printf("  -p <depth>   list and delete on separate links, with up to <depth>\n");
+    printf("               deletes outstanding (default 16)\n");
     printf("  -T <secs>    connect timeout (default 60)\n");
     printf("  -? -h        display this help message\n");
     printf("  -V           show version number\n");
@@ -50,47 +56,54 @@ static void usage(void)
 }
 
 
-// Check for an extra STATUS message following a NAME
+// Check for an extra STATUS message following a NAME. Only the ACK or
+// STATUS (or ATTRIB) that goes with this name is taken, anything else
+// (such as the next NAME from a FAL that doesn't ACK each one) is left
+// for dap_get_dir_entry.
 static bool check_status(dap_connection &conn, char *name)
 {
+  if (!conn.read_if_necessary(false))
+      return true;
+
+  int type = dap_message::peek_message_type(conn);
+  if (type != dap_message::STATUS && type != dap_message::ACK &&
+      type != dap_message::ATTRIB)
+      return true;
+
   dap_message *m = dap_message::read_message(conn, false);
-  if (m)
+  if (m && type == dap_message::STATUS)
   {
-      if (m->get_type() == dap_message::STATUS)
-      {
-	  dap_status_message *sm = (dap_status_message *)m;
-	  fprintf(stderr, "Error deleting %s: %s\n", name, sm->get_message());
-	  delete m;
-	  return false;
-      }
-
-      // The file must exist if we get an ATTRIB message.
-      if (m->get_type() == dap_message::ATTRIB)
-      {
-	  delete m;
-	  return true;
-      }
-
-      fprintf(stderr, "Got unexpected message: %s\n", m->type_name());
+      dap_status_message *sm = (dap_status_message *)m;
+      fprintf(stderr, "Error deleting %s: %s\n", name, sm->get_message());
       delete m;
+      return false;
   }
+
+  // The file must exist if we get an ATTRIB message. FAL follows
+  // each NAME with an ACK when it erases files for us.
+  delete m;
   return true;
 }
 
 
-// Send an ACCESS DIRECTORY request. If we are running non-interactively then
-// we actually delete the files here instead.
+// Send an ACCESS DIRECTORY request. If the files are not being deleted on a
+// second link then we actually delete them here instead, with one wildcard
+// ERASE, and FAL sends back the name of each file.
 static	bool dap_directory_lookup(dap_connection &c, char *dirname,
-				  bool interactive)
+				  bool list_only)
 {
     dap_access_message acc;
-    if (interactive)
+    if (list_only)
 	acc.set_accfunc(dap_access_message::DIRECTORY);
     else
 	acc.set_accfunc(dap_access_message::ERASE);
     acc.set_accopt(1);
     acc.set_filespec(dirname);
-    acc.set_display(dap_access_message::DISPLAY_MAIN_MASK);
+    if (list_only)
+	acc.set_display(dap_access_message::DISPLAY_MAIN_MASK);
+    else
+	acc.set_display(dap_access_message::DISPLAY_MAIN_MASK |
+			dap_access_message::DISPLAY_NAME_MASK);
     return acc.write(c);
 }
 
@@ -105,27 +118,79 @@ static bool dap_delete_file(dap_connection &c, char *name)
     return acc.write(c);
 }
 
-// Get a response from the delete request
-static bool dap_get_delete_ack(dap_connection &c)
+// ERASE requests sent on the delete link that FAL has not answered yet.
+// It answers them in the order they were sent.
+static char pending[MAX_PENDING][256];
+static int  pending_head;
+static int  pending_count;
+
+// Has FAL sent anything we have not read yet?
+static bool dap_answer_waiting(dap_connection &c)
+{
+    struct pollfd pfd;
+
+    pfd.fd = c.get_fd();
+    pfd.events = POLLIN;
+    return c.get_length() > 0 || poll(&pfd, 1, 0) > 0;
+}
+
+// Read the answer to the oldest outstanding delete and report it. Returns
+// 1 if it has been answered, 0 if nothing has arrived yet (non-blocking
+// only) and -1 if the link has failed.
+static int dap_get_delete_ack(dap_connection &c, bool block, bool verbose)
 {
-    dap_message *m = dap_message::read_message(c, true);
-    if (m)
+    const char *name = pending[pending_head];
+    dap_message *m;
+
+    for (;;)
     {
-	switch (m->get_type())
+	if (!block && !dap_answer_waiting(c))
+	    return 0;
+	if (!(m = dap_message::read_message(c, true)))
+	    return -1;
+
+	int type = m->get_type();
+	if (type == dap_message::STATUS)
 	{
-	case dap_message::ACCOMP:
-	case dap_message::ACK:
-	    return true;
+	    dap_status_message *sm = (dap_status_message *)m;
+	    fprintf(stderr, "Error deleting %s: %s\n", name, sm->get_message());
+	}
+	delete m;
 
-	case dap_message::STATUS:
-	    {
-		dap_status_message *sm = (dap_status_message *)m;
-		fprintf(stderr, "Error deleting file: %s\n", sm->get_message());
-		return false;
-	    }
+	// ACK (and anything else) comes before the ACCOMP
+	if (type == dap_message::STATUS || type == dap_message::ACCOMP)
+	{
+	    if (type == dap_message::ACCOMP && verbose)
+		printf("Deleted %s\n", name);
+	    pending_head = (pending_head + 1) % MAX_PENDING;
+	    pending_count--;
+	    return 1;
 	}
     }
-    return false;
+}
+
+// Queue a delete, waiting for old ones only when "depth" are outstanding,
+// then pick up any answers that have already arrived.
+static bool dap_queue_delete(dap_connection &c, char *name, int depth, bool verbose)
+{
+    while (pending_count >= depth)
+	if (dap_get_delete_ack(c, true, verbose) < 0)
+	    return false;
+
+    strcpy(pending[(pending_head + pending_count) % MAX_PENDING], name);
+    pending_count++;
+    if (!dap_delete_file(c, name))
+	return false;
+
+    while (pending_count)
+    {
+	int status = dap_get_delete_ack(c, false, verbose);
+	if (status < 0)
+	    return false;
+	if (status == 0)
+	    break;
+    }
+    return true;
 }
 
 // Send CONTRAN/SKIP message. We need this if a file in the list is locked.
@@ -183,9 +248,9 @@ static int dap_get_dir_entry(dap_connection &c, char *name)
 	    }
 	    break;
 
-	case dap_message::ACCOMP:
+	case dap_message::ACCOMP: // No more files
 	    delete m;
-	    return -1;
+	    return 0;
 
 	case dap_message::ACK:
 	    delete m;
@@ -207,8 +272,11 @@ static int dap_get_dir_entry(dap_connection &c, char *name)
 	    }
 
 	default:
-	    delete m;
-	    return m->get_type();
+	    {
+		int type = m->get_type();
+		delete m;
+		return type;
+	    }
 	}
 	delete m;
     }
@@ -220,9 +288,13 @@ int main(int argc, char *argv[])
 {
     int	    opt,retval;
     char    name[256];
+    char    filespec[256];
     bool    interactive = false;
     int     verbose = 0;
     int     two_links = 0;
+    int     depth = 16;
+    int     names = 0;
+    bool    link_ok = true;
     int     connect_timeout = 60;
 
     if (argc < 2)
@@ -234,7 +306,7 @@ int main(int argc, char *argv[])
 /* Get command-line options */
     opterr = 0;
     optind = 0;
-    while ((opt=getopt(argc,argv,"?hvViT:")) != EOF)
+    while ((opt=getopt(argc,argv,"?hvViT:p:")) != EOF)
     {
 	switch(opt)
 	{
@@ -248,13 +320,19 @@ int main(int argc, char *argv[])
 	    two_links++;
 	    break;
 
+	case 'p':
+	    depth = atoi(optarg);
+	    if (depth < 1) depth = 1;
+	    if (depth > MAX_PENDING) depth = MAX_PENDING;
+	    two_links++;
+	    break;
+
 	case 'T':
 	    connect_timeout = atoi(optarg);
 	    break;
 
 	case 'v':
 	    verbose++;
-	    two_links++;
 	    break;
 
 	case 'V':
@@ -271,8 +349,8 @@ int main(int argc, char *argv[])
     dir_conn.set_connect_timeout(connect_timeout);
     del_conn.set_connect_timeout(connect_timeout);
 
-    /* We open one link to get the file names and (if interactive or verbose)
-       another to do the actual deletion.
+    /* We open one link to get the file names and (if interactive or asked
+       for with -p) another to do the actual deletion.
        This is not a waste of resources - it's what VMS does !
      */
     if (!dir_conn.connect(argv[optind], dap_connection::FAL_OBJECT, name))
@@ -280,6 +358,8 @@ int main(int argc, char *argv[])
 	fprintf(stderr, "%s\n", dir_conn.get_error());
 	return -1;
     }
+    strcpy(filespec, name);
+
     // Exchange config messages
     if (!dir_conn.exchange_config())
     {
@@ -303,39 +383,63 @@ int main(int argc, char *argv[])
 	}
     }
 
-    /* If non-interactive then the next command just deletes the files */
-    dap_directory_lookup(dir_conn, name, interactive || (verbose>0) );
+    /* With one link the next command just deletes the files, and FAL
+       tells us the name of each one as it goes */
+    dap_directory_lookup(dir_conn, name, two_links);
 
-    /* Loop through the files we find */
+    /* Loop through the files we find. Deletes on the second link are
+       not waited for, their answers are picked up as they arrive. */
     while ((retval=dap_get_dir_entry(dir_conn, name)) > 0)
     {
 	if (retval == dap_message::NAME)
 	{
+	    names++;
 	    if (interactive)
 	    {
 		char response[255];
 
 		printf("Delete %s ? ", name);
-		fgets(response, sizeof(response), stdin);
-		if (tolower(response[0]) == 'y')
+		fflush(stdout);
+		if (!fgets(response, sizeof(response), stdin))
+		    response[0] = 'n';
+		// Wait for it so the result shows before the next prompt
+		if (tolower(response[0]) == 'y' && link_ok)
 		{
-		    dap_delete_file(del_conn, name);
-		    if (dap_get_delete_ack(del_conn))
-			if (verbose)
-			    printf("Deleted %s\n", name);
+		    link_ok = dap_queue_delete(del_conn, name, depth, verbose);
+		    while (link_ok && pending_count)
+			link_ok = dap_get_delete_ack(del_conn, true, verbose) > 0;
 		}
 	    }
+	    else if (two_links)
+	    {
+		if (link_ok)
+		    link_ok = dap_queue_delete(del_conn, name, depth, verbose);
+	    }
 	    else if (verbose)
 	    {
-		dap_delete_file(del_conn, name);
-		if (dap_get_delete_ack(del_conn))
-		    printf("Deleted %s\n", name);
+		printf("Deleted %s\n", name);
 	    }
 	}
     }
 
+    // A FAL that does not name the files it erased
+    if (retval == 0 && !two_links && names == 0 && verbose)
+	printf("Deleted %s\n", filespec);
+
+    // Collect the answers to the deletes still outstanding
+    while (link_ok && pending_count)
+	link_ok = dap_get_delete_ack(del_conn, true, verbose) > 0;
+    if (!link_ok)
+	fprintf(stderr, "Error deleting files: %s\n", del_conn.get_error());
+
+    // If everything went through cleanly leave the links with the
+    // session broker for the next command.
+    if (retval == 0)
+    {
+	dir_conn.park();
+	if (two_links && link_ok) del_conn.park();
+    }
     dir_conn.close();
     if (two_links) del_conn.close();
     return 0;
 }
-
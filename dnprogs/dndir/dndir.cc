@@ -309,6 +309,7 @@ int main(int argc, char *argv[])
     acc.write(conn);
 
     bool name_pending = false;
+    bool completed = false;
     if (show_full)
     {
         if (show_full_details(dirname, conn)) goto finished;
@@ -455,6 +456,7 @@ int main(int argc, char *argv[])
                     break;
                 }
             case dap_message::ACCOMP:
+                completed = true;
                 goto flush;
             }
             delete m;
@@ -479,6 +481,11 @@ int main(int argc, char *argv[])
                     size,
                     name, owner, cdt,prot, &printed);
     }
+    // FAL is waiting for the next ACCESS, the session broker
+    // can keep the link for the next command. Not after an error
+    // though, we don't know what state it's in.
+    if (completed)
+        conn.park();
 
  finished:
     conn.close();
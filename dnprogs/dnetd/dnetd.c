@@ -66,6 +66,8 @@ void usage(char *prog, FILE *f)
     fprintf(f," -s        Don't run scripts in users' directories\n");
     fprintf(f," -l<type>  Logging type(s:syslog, e:stderr, m:mono)\n");
     fprintf(f," -p<dir>   Path to find daemon programs\n");
+    fprintf(f," -b<num>   Incoming connect queue length (default 5)\n");
+    fprintf(f," -S        Show object statistics of the running dnetd\n");
     fprintf(f," -V        Show version number\n\n");
 }
 
@@ -153,6 +155,37 @@ void mirror(int insock)
 }
 
 
+// Print the per-object link counts from a running dnetd
+int show_status(void)
+{
+    struct sockaddr_un sockaddr;
+    char buf[1024];
+    int  len;
+    int  fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        return 1;
+    }
+
+    memset(&sockaddr, 0, sizeof(sockaddr));
+    sockaddr.sun_family = AF_UNIX;
+    strcpy(sockaddr.sun_path, DNETD_STATUS_SOCKET);
+    if (connect(fd, (struct sockaddr *)&sockaddr, sizeof(sockaddr)))
+    {
+        fprintf(stderr, "Can't connect to dnetd: %s\n", strerror(errno));
+        close(fd);
+        return 1;
+    }
+
+    while ( (len=read(fd, buf, sizeof(buf))) > 0)
+        fwrite(buf, 1, len, stdout);
+    close(fd);
+    return 0;
+}
+
 // Start here...
 int main(int argc, char *argv[])
 {
@@ -164,6 +197,7 @@ int main(int argc, char *argv[])
     int                debug=0;
     int                status;
     int                secure=0;
+    int                backlog=0;
     int                len = sizeof(sockaddr);
     char               log_char = 'l'; // Default to syslog(3)
     char               condata[] = {0x00, 0x20}; // Actually 4096 as a LE word
@@ -201,7 +235,7 @@ int main(int argc, char *argv[])
     // so we can check the version number and get help without being root.
     opterr = 0;
     optind = 0;
-    while ((opt=getopt(argc,argv,"?vVhp:sdl:")) != EOF)
+    while ((opt=getopt(argc,argv,"?vVhp:sdl:b:S")) != EOF)
     {
         switch(opt)
         {
@@ -230,6 +264,9 @@ int main(int argc, char *argv[])
             exit(1);
             break;
 
+        case 'S':
+            exit(show_status());
+
         case 'p':
             if (stat(optarg, &st) < 0)
             {
@@ -254,6 +291,15 @@ int main(int argc, char *argv[])
             }
             log_char = optarg[0];
             break;
+
+        case 'b':
+            backlog = atoi(optarg);
+            if (backlog <= 0)
+            {
+                usage(argv[0], stderr);
+                exit(2);
+            }
+            break;
         }
     }
 
@@ -267,6 +313,9 @@ int main(int argc, char *argv[])
     // set handling of hinum objects (needed for use with NIS)
     dnet_setobjhinum_handling(DNOBJHINUM_ZERO, 1);
 
+    if (backlog)
+        dnet_set_backlog(backlog);
+
     fd = dnet_daemon(0, NULL, verbosity, debug?0:1);
     if (fd > -1)
     {
@@ -0,0 +1,363 @@
+/*
+ * dnl1.c       Show the kernel's level 1 routing state, or send a made up
+ *              level 1 routing message to test it.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <linux/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <net/if.h>
+#include <netpacket/packet.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <netdnet/dn.h>
+#include <netdnet/dnetdb.h>
+
+#include "csum.h"
+#include "dnl1.h"
+
+#define ETH_P_DNA_RT 0x6003
+#define L1_NODES     1024
+#define L1_INF       0x7fff
+
+static int numeric;
+
+static void usage(char *cmd, FILE *f)
+{
+	fprintf(f, "\nusage: %s [-n]\n", cmd);
+	fprintf(f, "       %s -s <interface> <area.node> <node>=<hops>/<cost>|<node>=- ...\n\n", cmd);
+	fprintf(f, " -n           Don't resolve node numbers into names\n");
+	fprintf(f, " -s           Send one level 1 routing message on <interface> as if\n");
+	fprintf(f, "              it came from router <area.node>\n");
+	fprintf(f, " -h           Print this help message\n");
+	fprintf(f, "\n");
+}
+
+static char *node_name(unsigned short addr)
+{
+	static char name[32];
+	unsigned char dn_addr[2];
+	struct nodeent *ne;
+
+	dn_addr[0] = addr & 0xFF;
+	dn_addr[1] = addr >> 8;
+	if (!numeric && (ne = getnodebyaddr((const char *)dn_addr, 2, AF_DECnet)))
+		snprintf(name, sizeof(name), "%s", ne->n_name);
+	else
+		snprintf(name, sizeof(name), "%d.%d", addr >> 10, addr & 0x3FF);
+	return name;
+}
+
+static char *if_name(int ifindex)
+{
+	static char name[IF_NAMESIZE];
+
+	if (!if_indextoname(ifindex, name))
+		snprintf(name, sizeof(name), "if%d", ifindex);
+	return name;
+}
+
+/* Send a generic netlink request and hand each reply to "fn" */
+static int genl_request(int sock, int family, int cmd, int flags, void *attrs, int attrlen,
+			int (*fn)(struct nlmsghdr *, struct nlattr **))
+{
+	struct {
+		struct nlmsghdr   nlh;
+		struct genlmsghdr genl;
+		char              attrs[64];
+	} req;
+	static unsigned int seq;
+	char   buf[16384];
+	int    len;
+
+	memset(&req, 0, sizeof(req));
+	req.nlh.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN + attrlen);
+	req.nlh.nlmsg_type = family;
+	req.nlh.nlmsg_flags = NLM_F_REQUEST | flags;
+	req.nlh.nlmsg_seq = ++seq;
+	req.genl.cmd = cmd;
+	req.genl.version = 1;
+	memcpy(req.attrs, attrs, attrlen);
+
+	if (send(sock, &req, req.nlh.nlmsg_len, 0) < 0)
+	{
+		perror("netlink send");
+		return -1;
+	}
+
+	while ((len = recv(sock, buf, sizeof(buf), 0)) > 0)
+	{
+		struct nlmsghdr *nlh;
+
+		for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len))
+		{
+			struct nlattr *tb[CTRL_ATTR_MAX > DNL1_A_MAX ? CTRL_ATTR_MAX+1 : DNL1_A_MAX+1];
+			struct nlattr *nla;
+			int    rem;
+
+			if (nlh->nlmsg_seq != seq)
+				continue;
+			if (nlh->nlmsg_type == NLMSG_DONE)
+				return 0;
+			if (nlh->nlmsg_type == NLMSG_ERROR)
+			{
+				struct nlmsgerr *err = NLMSG_DATA(nlh);
+				errno = -err->error;
+				return err->error ? -1 : 0;
+			}
+
+			memset(tb, 0, sizeof(tb));
+			nla = (struct nlattr *)((char *)NLMSG_DATA(nlh) + GENL_HDRLEN);
+			rem = nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+			while (rem >= (int)sizeof(*nla) && nla->nla_len >= sizeof(*nla) && nla->nla_len <= rem)
+			{
+				int type = nla->nla_type & NLA_TYPE_MASK;
+
+				if (type < (int)(sizeof(tb)/sizeof(tb[0])))
+					tb[type] = nla;
+				rem -= NLA_ALIGN(nla->nla_len);
+				nla = (struct nlattr *)((char *)nla + NLA_ALIGN(nla->nla_len));
+			}
+			if (fn(nlh, tb))
+				return 0;
+		}
+	}
+	return -1;
+}
+
+#define NLA_U8(a)  (*(unsigned char *)((char *)(a) + NLA_HDRLEN))
+#define NLA_U16(a) (*(unsigned short *)((char *)(a) + NLA_HDRLEN))
+#define NLA_U32(a) (*(unsigned int *)((char *)(a) + NLA_HDRLEN))
+
+static int family_id;
+
+static int got_family(struct nlmsghdr *nlh, struct nlattr **tb)
+{
+	if (tb[CTRL_ATTR_FAMILY_ID])
+		family_id = NLA_U16(tb[CTRL_ATTR_FAMILY_ID]);
+	return 1;
+}
+
+static int show_adj(struct nlmsghdr *nlh, struct nlattr **tb)
+{
+	if (!tb[DNL1_A_ADDR] || !tb[DNL1_A_IFINDEX])
+		return 0;
+
+	printf("%-16s %-8s %5d %6d %7.1f\n",
+	       node_name(NLA_U16(tb[DNL1_A_ADDR])),
+	       if_name(NLA_U32(tb[DNL1_A_IFINDEX])),
+	       tb[DNL1_A_COST] ? NLA_U16(tb[DNL1_A_COST]) : 0,
+	       tb[DNL1_A_REACH] ? NLA_U16(tb[DNL1_A_REACH]) : 0,
+	       tb[DNL1_A_EXPIRES] ? NLA_U32(tb[DNL1_A_EXPIRES]) / 1000.0 : 0.0);
+	return 0;
+}
+
+static int show_route(struct nlmsghdr *nlh, struct nlattr **tb)
+{
+	unsigned short addr;
+	char   dest[32];
+
+	if (!tb[DNL1_A_ADDR] || !tb[DNL1_A_GW] || !tb[DNL1_A_IFINDEX])
+		return 0;
+
+	addr = NLA_U16(tb[DNL1_A_ADDR]);
+	if (addr & 0x3FF)
+		snprintf(dest, sizeof(dest), "%s", node_name(addr));
+	else
+		snprintf(dest, sizeof(dest), "(area router)");
+
+	printf("%-16s %4d %5d  %-8s %s\n", dest,
+	       tb[DNL1_A_HOPS] ? NLA_U8(tb[DNL1_A_HOPS]) : 0,
+	       tb[DNL1_A_COST] ? NLA_U16(tb[DNL1_A_COST]) : 0,
+	       if_name(NLA_U32(tb[DNL1_A_IFINDEX])),
+	       node_name(NLA_U16(tb[DNL1_A_GW])));
+	return 0;
+}
+
+static int show_state(void)
+{
+	struct sockaddr_nl snl;
+	struct {
+		struct nlattr hdr;
+		char          name[16];
+	} attr;
+	int sock;
+
+	sock = socket(AF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
+	if (sock < 0)
+	{
+		perror("netlink socket");
+		return 2;
+	}
+	memset(&snl, 0, sizeof(snl));
+	snl.nl_family = AF_NETLINK;
+	if (bind(sock, (struct sockaddr *)&snl, sizeof(snl)) < 0)
+	{
+		perror("netlink bind");
+		return 2;
+	}
+
+	memset(&attr, 0, sizeof(attr));
+	strcpy(attr.name, DNL1_GENL_NAME);
+	attr.hdr.nla_type = CTRL_ATTR_FAMILY_NAME;
+	attr.hdr.nla_len = NLA_HDRLEN + strlen(DNL1_GENL_NAME) + 1;
+	if (genl_request(sock, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0,
+			 &attr, NLA_ALIGN(attr.hdr.nla_len), got_family) || !family_id)
+	{
+		fprintf(stderr, "Kernel level 1 routing is not available (%s)\n", strerror(errno));
+		close(sock);
+		return 2;
+	}
+
+	printf("Adjacency        Circuit   Cost  Reach  Expires\n");
+	genl_request(sock, family_id, DNL1_CMD_GET_ADJ, NLM_F_DUMP, NULL, 0, show_adj);
+	printf("\nNode             Hops  Cost  Circuit  Next hop\n");
+	genl_request(sock, family_id, DNL1_CMD_GET_ROUTE, NLM_F_DUMP, NULL, 0, show_route);
+
+	close(sock);
+	return 0;
+}
+
+/* Build a level 1 routing message with one segment covering the nodes given */
+static int send_message(char *iface, char *router, int argc, char **argv)
+{
+	static unsigned short vec[L1_NODES];
+	unsigned char packet[1600];
+	struct sockaddr_ll sll;
+	unsigned short sum;
+	int area, node, hops, cost;
+	int lo = L1_NODES, hi = -1;
+	int i, n, sock;
+
+	if (sscanf(router, "%d.%d", &area, &node) != 2 ||
+	    area < 1 || area > 63 || node < 1 || node > 1023)
+	{
+		fprintf(stderr, "Bad router address %s\n", router);
+		return 2;
+	}
+
+	for (n = 0; n < L1_NODES; n++)
+		vec[n] = L1_INF;
+	for (; argc; argc--, argv++)
+	{
+		int dest;
+		char dash;
+
+		if (sscanf(*argv, "%d=%d/%d", &dest, &hops, &cost) == 3 &&
+		    hops >= 0 && hops < 32 && cost >= 0 && cost < 1024)
+			vec[dest & 0x3FF] = hops << 10 | cost;
+		else if (sscanf(*argv, "%d=%c", &dest, &dash) != 2 || dash != '-')
+		{
+			fprintf(stderr, "Bad routing entry %s\n", *argv);
+			return 2;
+		}
+		if (dest < 0 || dest >= L1_NODES)
+		{
+			fprintf(stderr, "Bad node number %d\n", dest);
+			return 2;
+		}
+		if (dest < lo) lo = dest;
+		if (dest > hi) hi = dest;
+	}
+	if (hi < 0)
+	{
+		fprintf(stderr, "No routing entries given\n");
+		return 2;
+	}
+	if (hi - lo + 1 > (int)(sizeof(packet) - 16) / 2)
+	{
+		fprintf(stderr, "Too many nodes for one message\n");
+		return 2;
+	}
+
+	i = 0;
+	packet[i++] = 0x00; /* Length, filled in at end */
+	packet[i++] = 0x00;
+	packet[i++] = 0x07; /* Level 1 routing message */
+	packet[i++] = node & 0xFF;
+	packet[i++] = (area << 2) | (node >> 8);
+	packet[i++] = 0x00; /* Reserved */
+	packet[i++] = (hi - lo + 1) & 0xFF;
+	packet[i++] = (hi - lo + 1) >> 8;
+	packet[i++] = lo & 0xFF;
+	packet[i++] = lo >> 8;
+	for (n = lo; n <= hi; n++)
+	{
+		packet[i++] = vec[n] & 0xFF;
+		packet[i++] = vec[n] >> 8;
+	}
+	sum = route_csum(packet, 6, i);
+	packet[i++] = sum & 0xFF;
+	packet[i++] = sum >> 8;
+	packet[0] = (i-2) & 0xFF;
+	packet[1] = (i-2) >> 8;
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family   = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_DNA_RT);
+	sll.sll_ifindex  = if_nametoindex(iface);
+	sll.sll_halen    = 6;
+	memcpy(sll.sll_addr, "\xab\x00\x00\x03\x00\x00", 6); /* All routers */
+	if (!sll.sll_ifindex)
+	{
+		fprintf(stderr, "No interface %s\n", iface);
+		return 2;
+	}
+
+	sock = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_DNA_RT));
+	if (sock < 0)
+	{
+		perror("socket");
+		return 2;
+	}
+	if (sendto(sock, packet, i, 0, (struct sockaddr *)&sll, sizeof(sll)) < 0)
+	{
+		perror("sendto");
+		close(sock);
+		return 2;
+	}
+	close(sock);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "?hns")) != EOF)
+	{
+		switch (opt)
+		{
+		case 'n':
+			numeric = 1;
+			break;
+
+		case 's':
+			if (argc - optind < 3)
+			{
+				usage(argv[0], stderr);
+				return 2;
+			}
+			return send_message(argv[optind], argv[optind+1],
+					    argc - optind - 2, argv + optind + 2);
+
+		case 'h':
+		case '?':
+			usage(argv[0], stdout);
+			return 0;
+		}
+	}
+
+	return show_state();
+}
@@ -0,0 +1,28 @@
+/*
+ * dnl1.h       Generic netlink interface to the kernel's level 1
+ *              decision process. Must match include/net/dn_l1route.h
+ *              in the kernel tree.
+ */
+#define DNL1_GENL_NAME          "DECNET_L1"
+#define DNL1_GENL_VERSION       1
+
+enum {
+	DNL1_CMD_UNSPEC,
+	DNL1_CMD_GET_ADJ,       /* Adjacencies we have routing messages from */
+	DNL1_CMD_GET_ROUTE,     /* Our decision for each reachable node */
+	__DNL1_CMD_MAX,
+};
+#define DNL1_CMD_MAX (__DNL1_CMD_MAX - 1)
+
+enum {
+	DNL1_A_UNSPEC,
+	DNL1_A_IFINDEX,         /* u32: Circuit */
+	DNL1_A_ADDR,            /* u16: Adjacency or destination */
+	DNL1_A_GW,              /* u16: Next hop adjacency */
+	DNL1_A_HOPS,            /* u8 */
+	DNL1_A_COST,            /* u16 */
+	DNL1_A_EXPIRES,         /* u32: Milliseconds until adjacency is dropped */
+	DNL1_A_REACH,           /* u16: Nodes the adjacency can reach */
+	__DNL1_A_MAX,
+};
+#define DNL1_A_MAX (__DNL1_A_MAX - 1)
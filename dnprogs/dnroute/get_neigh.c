@@ -59,6 +59,9 @@
 #define STATUS_SOCKET "/var/run/dnroute.status"
 #define PIDFILE "/var/run/dnroute.pid"
 
+/* Set to 1 when the kernel runs the level 1 decision process itself */
+#define KERNEL_L1_FILE "/proc/sys/net/decnet/l1_routing"
+
 /* What we stick in the hash table */
 struct nodeinfo
 {
@@ -97,6 +100,7 @@ static int verbose;
 static int send_routing;
 static int send_level2;
 static int no_routes;
+static int kernel_l1;
 static int routing_multicast_timer = 15;
 struct dn_naddr *exec_addr;
 
@@ -457,6 +461,9 @@ static inline int add_via_route(unsigned short addr, unsigned short via_node)
 	}
 	else
 	{
+		/* The kernel's own routes are used instead */
+		if (kernel_l1)
+			return 0;
 		bits = 16;
 	}
 
@@ -475,6 +482,8 @@ static inline int del_via_route(unsigned short addr, unsigned short via_node)
 	}
 	else
 	{
+		if (kernel_l1)
+			return 0;
 		bits = 16;
 	}
 	return edit_via_route(RTM_DELROUTE, addr, via_node, bits);
@@ -688,6 +697,39 @@ static int got_neigh(struct sockaddr_nl *who, struct nlmsghdr *n, void *arg)
 	return 0;
 }
 
+/* When the kernel's level 1 routing is turned on or off, hand over the
+   routes to nodes in our area. dnroute still keeps its node table so
+   that it can send level 1 routing messages. */
+static void check_kernel_l1(void)
+{
+	FILE *f;
+	int   on = 0;
+	int   i;
+
+	if ((f = fopen(KERNEL_L1_FILE, "r")))
+	{
+		if (fscanf(f, "%d", &on) != 1)
+			on = 0;
+		fclose(f);
+	}
+	if (on == kernel_l1)
+		return;
+
+	syslog(LOG_INFO, "Kernel level 1 routing turned %s\n", on?"on":"off");
+
+	/* Our routes would hide the kernel's, so remove them first... */
+	for (i=1; i<1024 && on; i++)
+		if (node_table[i].valid && node_table[i].router)
+			del_via_route((exec_addr->a_addr[1] & 0xFC) << 8 | i, node_table[i].router);
+
+	kernel_l1 = on;
+
+	/* ...or put them back when the kernel stops routing */
+	for (i=1; i<1024 && !on; i++)
+		if (node_table[i].valid && node_table[i].router)
+			add_via_route((exec_addr->a_addr[1] & 0xFC) << 8 | i, node_table[i].router);
+}
+
 /* Called on a timer, read the neighbours list and send router messages */
 static void get_neighbours(void)
 {
@@ -702,6 +744,8 @@ static void get_neighbours(void)
 		first_time = 0;
 	}
 
+	check_kernel_l1();
+
 	/* Get the list of adjacent nodes */
 	if (rtnl_wilddump_request(&listen_rth, AF_DECnet, RTM_GETNEIGH) < 0) {
 		syslog(LOG_ERR, "Cannot send dump request: %m");
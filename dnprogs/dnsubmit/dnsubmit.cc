@@ -29,25 +29,30 @@
 #include "protocol.h"
 #include "logging.h"
 
-
+// Most SUBMITs we will have sent without an answer
+#define MAX_PENDING 64
 
 /*-------------------------------------------------------------------------*/
 static void usage(FILE *f, bool dnprint)
 {
     if (dnprint)
     {
-	fprintf(f,"\nUSAGE: dnprint [OPTIONS] 'node\"user password\"::filespec'\n\n");
+	fprintf(f,"\nUSAGE: dnprint [OPTIONS] 'node\"user password\"::filespec' [filespec...]\n\n");
     }
     else
     {
-	fprintf(f, "\nUSAGE: dnsubmit [OPTIONS] 'node\"user password\"::filespec'\n\n");
+	fprintf(f, "\nUSAGE: dnsubmit [OPTIONS] 'node\"user password\"::filespec' [filespec...]\n\n");
     }
     fprintf(f,"NOTE: The VMS filename really should be in single quotes to\n");
     fprintf(f,"      protect it from the shell\n");
+    fprintf(f,"      Files without a node name go over the link to the node before\n");
+    fprintf(f,"      them. A filespec of - reads a list of them from stdin.\n");
 
     fprintf(f,"\nOptions:\n");
     fprintf(f,"  -? -h        display this help message\n");
     fprintf(f,"  -T <secs>    connect timeout (default 60)\n");
+    if (!dnprint)
+	fprintf(f,"  -p <depth>   SUBMITs to send before waiting for the answers (default 8)\n");
     fprintf(f,"  -v           increase verbosity\n");
     fprintf(f,"  -V           show version number\n");
 
@@ -58,10 +63,19 @@ static void usage(FILE *f, bool dnprint)
     }
     else
     {
-	fprintf(f," dnsubmit  'serv1\"user password\"::myjob.com'\n");
+	fprintf(f," dnsubmit  'serv1\"user password\"::myjob.com' other.com\n");
     }
     fprintf(f,"\n");
 }
+
+/*-------------------------------------------------------------------------*/
+// Jobs we have sent and not had the answer to yet. The remote end
+// answers them in order.
+static char pending[MAX_PENDING][256];
+static int  pending_head;
+static int  pending_count;
+static int  failed;
+
 /*-------------------------------------------------------------------------*/
 static int submit(dap_connection &conn, char *dirname, bool print)
 {
@@ -82,48 +96,252 @@ static int submit(dap_connection &conn, char *dirname, bool print)
     acc.write(conn);
     return conn.set_blocked(false);
 }
+
 /*-------------------------------------------------------------------------*/
-static int read_reply(dap_connection &conn)
+// Close the file the remote end has opened for us, asking it to print
+// or submit it as it goes.
+static int close_file(dap_connection &conn, bool print)
 {
-    dap_message *m;
+    dap_accomp_message acc;
 
-    m = dap_message::read_message(conn, true);
-    if (!m) return -1;
+    acc.set_cmpfunc(dap_accomp_message::CLOSE);
+    if (print)
+	acc.set_fop_bit(dap_attrib_message::FB$SPL);
+    else
+	acc.set_fop_bit(dap_attrib_message::FB$SCF);
+    return acc.write(conn);
+}
 
-    switch (m->get_type())
-    {
-    case dap_message::ATTRIB:
-	break;
+/*-------------------------------------------------------------------------*/
+// Read the answer to one request. Returns 0 if the job is done, 1 if the
+// remote end has opened the file and wants it closed (ACK), 2 if it
+// failed and -1 if the link has gone.
+static int read_reply(dap_connection &conn, const char *name)
+{
+    dap_message *m;
 
-    case dap_message::ACK:
-	break;
+    while ((m = dap_message::read_message(conn, true)))
+    {
+	int type = m->get_type();
+	switch (type)
+	{
+	case dap_message::ATTRIB:
+	case dap_message::NAME:
+	    break;
 
-    case dap_message::STATUS:
-        {
-	    dap_status_message *sm = (dap_status_message *)m;
-	    fprintf(stderr, "%s\n", sm->get_message());
+	case dap_message::ACK:
+	    delete m;
+	    return 1;
+
+	case dap_message::STATUS:
+	    {
+		dap_status_message *sm = (dap_status_message *)m;
+		fprintf(stderr, "%s: %s\n", name, sm->get_message());
+		delete m;
+		return 2;
+	    }
+
+	case dap_message::ACCOMP:
+	    delete m;
+	    return 0;
+
+	default:
+	    printf("Unknown mesage received: 0x%x\n", type);
+	    delete m;
 	    return -1;
 	}
+	delete m;
+    }
+    return -1;
+}
 
-    case dap_message::ACCOMP:
-	break;
+/*-------------------------------------------------------------------------*/
+// Print or submit one file and wait for it to be done.
+static int do_job(dap_connection &conn, char *name, bool print,
+		  bool &needs_close)
+{
+    int status;
 
-    case dap_message::NAME:
-	break;
+    if (!submit(conn, name, print)) return -1;
 
-    default:
-	printf("Unknown mesage received: 0x%x\n", m->get_type());
-	return -1;
-	break;
+    status = read_reply(conn, name);
+    needs_close = (status == 1);
+    if (status == 1)
+    {
+	if (!close_file(conn, print)) return -1;
+	status = read_reply(conn, name);
     }
+    return status;
+}
+
+/*-------------------------------------------------------------------------*/
+// Pick up the answer to the oldest SUBMIT outstanding.
+static int collect_job(dap_connection &conn, int verbose)
+{
+    const char *name = pending[pending_head];
+    int status = read_reply(conn, name);
+
+    if (status < 0) return -1;
+    if (status == 2)
+	failed++;
+    else if (verbose)
+	printf("Submitted %s\n", name);
+
+    pending_head = (pending_head + 1) % MAX_PENDING;
+    pending_count--;
+    return 0;
+}
+
+/*-------------------------------------------------------------------------*/
+// Send off a SUBMIT without waiting for the previous ones, unless there
+// are already "depth" of them outstanding.
+static int queue_job(dap_connection &conn, char *name, int depth, int verbose)
+{
+    while (pending_count >= depth)
+	if (collect_job(conn, verbose) < 0) return -1;
+
+    strcpy(pending[(pending_head + pending_count) % MAX_PENDING], name);
+    pending_count++;
+    return submit(conn, name, false) ? 0 : -1;
+}
+
+/*-------------------------------------------------------------------------*/
+static int drain_jobs(dap_connection &conn, int verbose)
+{
+    while (pending_count)
+	if (collect_job(conn, verbose) < 0) return -1;
     return 0;
 }
 
+/*-------------------------------------------------------------------------*/
+// One link is kept open for as long as the files are on the same node.
+static dap_connection *conn = NULL;
+static char  link_node[256];
+static bool  link_ok;
+static enum {PROBE, PIPELINE, ONE_BY_ONE} link_mode;
+
+static void close_link(int verbose)
+{
+    if (!conn) return;
+
+    if (link_ok && drain_jobs(*conn, verbose) < 0)
+    {
+	fprintf(stderr, "Error submitting files: %s\n", conn->get_error());
+	link_ok = false;
+    }
+    if (link_ok) conn->park();
+    conn->close();
+    delete conn;
+    conn = NULL;
+}
+
+static void do_file(char *spec, bool print, int depth, int connect_timeout,
+		    int verbose)
+{
+    char  dirname[256] = {'\0'};
+    char *colons = strstr(spec, "::");
+    int   status;
+
+    // link_node and dirname are both parts of the spec
+    if (strlen(spec) >= sizeof(dirname))
+    {
+	fprintf(stderr, "%.40s...: file name too long\n", spec);
+	failed++;
+	return;
+    }
+
+    // A new node (or user) needs a new link
+    if (colons &&
+	(!conn || strncmp(link_node, spec, colons - spec + 2) ||
+	 link_node[colons - spec + 2] != '\0'))
+    {
+	close_link(verbose);
+
+	strncpy(link_node, spec, colons - spec + 2);
+	link_node[colons - spec + 2] = '\0';
+
+	conn = new dap_connection(verbose);
+	conn->set_connect_timeout(connect_timeout);
+	link_ok = false;
+	link_mode = PROBE;
+	if (!conn->connect(spec, dap_connection::FAL_OBJECT, dirname))
+	{
+	    fprintf(stderr, "%s\n", conn->get_error());
+	    failed++;
+	    return;
+	}
+
+	// Exchange config messages
+	if (!conn->exchange_config())
+	{
+	    fprintf(stderr, "Error in config: %s\n", conn->get_error());
+	    failed++;
+	    return;
+	}
+	link_ok = true;
+    }
+    else if (colons)
+    {
+	strcpy(dirname, colons + 2);
+    }
+    else if (!conn)
+    {
+	fprintf(stderr, "%s: no node name\n", spec);
+	failed++;
+	return;
+    }
+    else
+    {
+	strcpy(dirname, spec);
+    }
+
+    if (!link_ok)
+    {
+	fprintf(stderr, "%s: not sent, the link to %s failed\n", dirname, link_node);
+	failed++;
+	return;
+    }
+
+    // Once we know the remote end does a SUBMIT without waiting to be
+    // told to close the file, the rest can go without waiting.
+    if (!print && link_mode == PIPELINE)
+    {
+	if (queue_job(*conn, dirname, depth, verbose) < 0)
+	{
+	    fprintf(stderr, "Error submitting %s: %s\n", dirname, conn->get_error());
+	    link_ok = false;
+	    failed++;
+	}
+	return;
+    }
+
+    bool needs_close;
+    status = do_job(*conn, dirname, print, needs_close);
+    if (status < 0)
+    {
+	fprintf(stderr, "Error in opening: %s %s\n", dirname, conn->get_error());
+	link_ok = false;
+	failed++;
+	return;
+    }
+    if (status == 2)
+    {
+	failed++;
+    }
+    else
+    {
+	if (verbose) printf("%s %s\n", print?"Printed":"Submitted", dirname);
+
+	if (link_mode == PROBE && depth > 1)
+	    link_mode = needs_close ? ONE_BY_ONE : PIPELINE;
+    }
+}
 
 int main(int argc, char *argv[])
 {
-    int	    opt,retval;
+    int	    opt;
     int     verbose = 0;
+    int     depth = 8;
     bool    dnprint = false;
     int     connect_timeout = 60;
 
@@ -142,7 +360,7 @@ int main(int argc, char *argv[])
 /* Get command-line options */
     opterr = 0;
     optind = 0;
-    while ((opt=getopt(argc,argv,"?hvVT:")) != EOF)
+    while ((opt=getopt(argc,argv,"?hvVT:p:")) != EOF)
     {
 	switch(opt)
 	{
@@ -162,6 +380,12 @@ int main(int argc, char *argv[])
 	    connect_timeout = atoi(optarg);
 	    break;
 
+	case 'p':
+	    depth = atoi(optarg);
+	    if (depth < 1) depth = 1;
+	    if (depth > MAX_PENDING) depth = MAX_PENDING;
+	    break;
+
 	case 'V':
 	    printf("\ndnsubmit from dnprogs version %s\n\n", VERSION);
 	    exit(1);
@@ -176,44 +400,39 @@ int main(int argc, char *argv[])
 
     init_logging("dnsubmit", 'e', false);
 
-    dap_connection conn(verbose);
-    conn.set_connect_timeout(connect_timeout);
-
-    char dirname[256] = {'\0'};
-    if (!conn.connect(argv[optind], dap_connection::FAL_OBJECT, dirname))
-    {
-	fprintf(stderr, "%s\n", conn.get_error());
-	return -1;
-    }
-
-    // Exchange config messages
-    if (!conn.exchange_config())
-    {
-	fprintf(stderr, "Error in config: %s\n", conn.get_error());
-	return -1;
-    }
-
-    if (!submit(conn, dirname, dnprint))
+    for (; optind < argc; optind++)
     {
-	fprintf(stderr, "Error in opening: %s %s\n", dirname, conn.get_error());
-	return -1;
-    }
-
-    retval = read_reply(conn);
-    if (retval < 0) dnprint=false; // Don't try the rest
-
-    // When printing we have to send an ACCOMP message with the SPL bit set.
-    if (dnprint)
-    {
-	dap_accomp_message acc;
-
-	acc.set_cmpfunc(dap_accomp_message::CLOSE);
-	acc.set_fop_bit(dap_attrib_message::FB$SPL);
-	acc.write(conn);
-
-	retval = read_reply(conn);
+	// - reads file names from stdin, one per line
+	if (strcmp(argv[optind], "-") == 0)
+	{
+	    char line[256];
+
+	    while (fgets(line, sizeof(line), stdin))
+	    {
+		char *end = line + strlen(line);
+
+		// Don't take the rest of a long line as another file
+		if (end[-1] != '\n' && !feof(stdin))
+		{
+		    int c;
+
+		    fprintf(stderr, "%.40s...: file name too long\n", line);
+		    failed++;
+		    while ((c = getchar()) != EOF && c != '\n')
+			;
+		    continue;
+		}
+		while (end > line && isspace(end[-1])) *--end = '\0';
+		if (line[0])
+		    do_file(line, dnprint, depth, connect_timeout, verbose);
+	    }
+	}
+	else
+	{
+	    do_file(argv[optind], dnprint, depth, connect_timeout, verbose);
+	}
     }
+    close_link(verbose);
 
-    conn.close();
-    return 0;
+    return failed ? 1 : 0;
 }
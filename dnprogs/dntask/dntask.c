@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <poll.h>
 #include <netdnet/dn.h>
 #include <netdnet/dnetdb.h>
 #include <fcntl.h>
@@ -58,50 +59,229 @@ static void usage(FILE *);
 static char *connerror(int sockfd);
 /*-------------------------------------------------------------------------*/
 
+/*
+ * Output waiting to go to stdout. Records from the link are collected
+ * here and only written out when the link has nothing more ready for
+ * us, or there is no room for another record.
+ */
+#define OUTBUF_SIZE 65536
+static	char			outbuf[OUTBUF_SIZE];
+static	int			outlen;
+
+/* Write all of a buffer, coping with short writes and a non-blocking fd */
+static int write_all(int fd, const char *data, int len)
+{
+    struct pollfd pfd;
+    int           cnt;
+
+    while (len)
+    {
+	cnt = write(fd, data, len);
+	if (cnt < 0)
+	{
+	    if (errno == EINTR) continue;
+	    if (errno == EAGAIN)
+	    {
+		pfd.fd = fd;
+		pfd.events = POLLOUT;
+		poll(&pfd, 1, -1);
+		continue;
+	    }
+	    return -1;
+	}
+	data += cnt;
+	len  -= cnt;
+    }
+    return 0;
+}
+
+static int flush_output(void)
+{
+    int status = write_all(STDOUT_FILENO, outbuf, outlen);
+
+    outlen = 0;
+    if (status < 0) perror("Error writing output");
+    return status;
+}
+
+/* Add a record to the output, as a line unless we are in binary mode */
+static int queue_output(unsigned char *data, int len)
+{
+    if (!binary_mode && len && data[len-1] == '\n') len--;
+
+    if (outlen + len + 1 > OUTBUF_SIZE && flush_output() < 0)
+	return -1;
+
+    memcpy(outbuf+outlen, data, len);
+    outlen += len;
+    if (!binary_mode) outbuf[outlen++] = '\n';
+    return 0;
+}
+
+/* Is there another record waiting on the link? */
+static int link_ready(void)
+{
+    struct pollfd pfd;
+
+    pfd.fd = sockfd;
+    pfd.events = POLLIN;
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/*
+ * Binary output needs no reformatting so it goes from the link to
+ * stdout with splice(2) through a pipe of our own. Records are
+ * collected in the pipe until the link has nothing more ready or the
+ * pipe is full, then it is all spliced to stdout in one go. If
+ * the kernel won't do it for the link or for stdout we drop back to
+ * read() and write().
+ */
+#define SPLICE_PIPE_SIZE (256*1024)
+static	int			use_splice;
+static	int			splice_pipe[2] = {-1, -1};
+static	int			pipe_bytes;	/* Waiting in the pipe */
+
+static void setup_splice(void)
+{
+    if (!binary_mode || pipe(splice_pipe) < 0)
+	return;
+
+    /* Not fatal if we can't have a bigger one */
+    fcntl(splice_pipe[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+    use_splice = TRUE;
+}
+
+/* Empty our pipe into stdout. If stdout won't take a splice then copy
+   what is in the pipe and stop splicing. */
+static int drain_splice_pipe(void)
+{
+    int cnt;
+
+    while (pipe_bytes)
+    {
+	cnt = splice(splice_pipe[0], NULL, STDOUT_FILENO, NULL, pipe_bytes,
+		     SPLICE_F_MOVE);
+	if (cnt < 0)
+	{
+	    if (errno == EINTR) continue;
+	    if (errno != EINVAL) return -1;
+
+	    use_splice = FALSE;
+	    while (pipe_bytes)
+	    {
+		cnt = read(splice_pipe[0], buf,
+			   pipe_bytes < (int)sizeof(buf) ? pipe_bytes : (int)sizeof(buf));
+		if (cnt <= 0 || write_all(STDOUT_FILENO, (char *)buf, cnt) < 0)
+		    return -1;
+		pipe_bytes -= cnt;
+	    }
+	    break;
+	}
+	pipe_bytes -= cnt;
+    }
+    return 0;
+}
+
+/*
+ * Read a record from the link and pass it on to stdout. Returns its
+ * length, 0 at the end or -1 if something went wrong.
+ */
+static int read_link(void)
+{
+    int len;
+    int err;
+
+    while (use_splice)
+    {
+	/* We are the only reader of the pipe, so never block on it being
+	   full. EAGAIN means the pipe is full, or if it is empty that the
+	   link has nothing for us yet. */
+	len = splice(sockfd, NULL, splice_pipe[1], NULL, sizeof(buf),
+		     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	err = errno;
+	if (len > 0)
+	    pipe_bytes += len;
+
+	if (len < 0 && err == EAGAIN && !pipe_bytes)
+	{
+	    struct pollfd pfd;
+
+	    pfd.fd = sockfd;
+	    pfd.events = POLLIN;
+	    poll(&pfd, 1, -1);
+	    continue;
+	}
+
+	if ((len <= 0 || !link_ready()) && drain_splice_pipe() < 0)
+	{
+	    perror("Error writing output");
+	    return -1;
+	}
+	if (len >= 0)
+	    return len;
+	if (err == EAGAIN || err == EINTR)
+	    continue;
+	if (err == EINVAL)
+	    use_splice = FALSE;
+	errno = err;
+	break;
+    }
+
+    if (!use_splice)
+    {
+	len = read(sockfd, buf, sizeof(buf));
+	if (len > 0 && queue_output(buf, len) < 0)
+	    return -1;
+    }
+
+    if (len < 0)
+    {
+	if (errno != ENOTCONN)
+	    perror("Error reading from network");
+	else
+	    fprintf(stderr, "Read failed: %s\n", connerror(sockfd));
+    }
+    return len;
+}
+
 /*
  * Run an interactive command procedure. As we get input from either the
  * remote or local end we pass it on to the other.
  */
 void be_interactive(void)
 {
-    fd_set         in;
-    struct timeval tv;
+    struct pollfd  pfd[2];
     int            len;
+    int            status;
 
-    FD_ZERO(&in);
-    FD_SET(sockfd, &in);
-    FD_SET(STDIN_FILENO, &in);
-    tv.tv_sec  = timeout;
-    tv.tv_usec = 0;
+    setup_splice();
+
+    pfd[0].fd = sockfd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = STDIN_FILENO;
+    pfd[1].events = POLLIN;
 
     /* Loop for input */
-    while ( select(sockfd+1, &in, NULL, NULL, (timeout==0?NULL:&tv)) > 0)
+    while ( (status = poll(pfd, 2, timeout ? timeout*1000 : -1)) != 0)
     {
-	if (FD_ISSET(sockfd, &in)) // From VMS to us
+	if (status < 0)
 	{
-	    len = read(sockfd, buf, sizeof(buf));
-	    if (len < 0)
-	    {
-		fprintf(stderr, "Read failed: %s\n", connerror(sockfd));
-		return;
-	    }
-	    if (len == 0) /* EOF */
-	    {
-		return;
-	    }
+	    if (errno == EINTR) continue;
+	    break;
+	}
 
-            if (binary_mode)
-	    {
-                write(STDOUT_FILENO, buf, len);
-            }
-	    else
+	if (pfd[0].revents) // From VMS to us
+	{
+	    /* Take everything that has arrived before writing it out */
+	    do
 	    {
-	        buf[len] = '\0';
-	        if (buf[len-1] == '\n') buf[len-1] = '\0';
-		printf("%s\n", buf);
-            }
+		len = read_link();
+	    } while (len > 0 && link_ready());
+
+	    if (flush_output() < 0 || len <= 0)
+		return;
 	}
-	if (FD_ISSET(STDIN_FILENO, &in)) // from us to VMS
+	if (pfd[1].revents) // from us to VMS
 	{
 	    len = read(STDIN_FILENO, buf, sizeof(buf));
 	    if (len < 0)
@@ -111,15 +291,12 @@ void be_interactive(void)
 	    }
 	    if (len == 0) return; //EOF
 	    if (buf[len-1] == '\n') buf[--len] = '\0';
-	    write(sockfd, buf, len);
+	    if (write(sockfd, buf, len) < 0)
+	    {
+		fprintf(stderr, "Write failed: %s\n", connerror(sockfd));
+		return;
+	    }
 	}
-
-	// Reset for another select
-	FD_ZERO(&in);
-	FD_SET(sockfd, &in);
-	FD_SET(STDIN_FILENO, &in);
-	tv.tv_sec  = timeout;
-	tv.tv_usec = 0;
     }
     fprintf(stderr, "Time-out expired\n");
 }
@@ -129,30 +306,14 @@ void be_interactive(void)
  */
 void print_output(void)
 {
-    int len;
+    setup_splice();
 
-    while ( ((len = read(sockfd, buf, sizeof(buf)))) )
+    while (read_link() > 0)
     {
-        if (len == -1)
-	{
-	    if (errno != ENOTCONN)
-		perror("Error reading from network");
-	    else
-		fprintf(stderr, "Read failed: %s\n", connerror(sockfd));
-	    break;
-        }
-
-        if (binary_mode)
-	{
-            write(STDOUT_FILENO, buf, len);
-        }
-	else
-	{
-	    buf[len] = '\0';
-	    if (buf[len-1] == '\n') buf[len-1] = '\0';
-	    printf("%s\n", buf);
-        }
+	if (outlen && !link_ready() && flush_output() < 0)
+	    return;
     }
+    flush_output();
 }
 
 /*
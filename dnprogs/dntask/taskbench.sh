@@ -0,0 +1,17 @@
+#!/bin/sh
+#
+# Measure how fast dntask can take output from a TASK object, in text
+# and in binary (-b) mode. The node must run dnetd with the taskbench
+# task from the tasks directory installed, by default the local node
+# is used.
+#
+# usage: taskbench.sh [node] [dntask]
+#
+NODE=${1:-$(cat /proc/sys/net/decnet/node_address)}
+DNTASK=${2:-dntask}
+
+for mode in "" "-b"
+do
+    printf "dntask %-3s " "$mode"
+    $DNTASK $mode "$NODE::taskbench" | dd of=/dev/null bs=64k 2>&1 | tail -1
+done
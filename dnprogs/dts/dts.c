@@ -20,6 +20,8 @@
 #include <syslog.h>
 #include <ctype.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/time.h>
@@ -83,6 +85,7 @@ char *tests[] = {
   "abort",
   "data",
   "interrupt",
+  "connect",
   NULL
 };
 #define CMD_ACCEPT              0
@@ -91,9 +94,10 @@ char *tests[] = {
 #define CMD_ABORT               3
 #define CMD_DATA                4
 #define CMD_INTERRUPT           5
+#define CMD_CONNECT             6
 
 char *options[] = {
-  "o:", "o:", "o:", "o:", "c:f:v:l:r:st:", "c:l:r:st:"
+  "o:", "o:", "o:", "o:", "c:f:v:l:r:st:", "c:l:r:st:", "c:n:o:p:t:w:"
 };
 
 struct switchval {
@@ -124,6 +128,7 @@ struct switchval rswitch[] = {
 };
 
 #define MAX_NODE                6
+#define MAX_WORKERS             256
 
 char *remote = "0.0::";
 
@@ -137,7 +142,8 @@ extern char *optarg;
  * Test parameters
  */
 unsigned long long cvalue;
-int ovalue, fvalue, rvalue, lvalue, vvalue, tvalue;
+int ovalue, fvalue, rvalue, lvalue, vvalue, tvalue, pvalue, wvalue;
+char *nvalue;
 int sswitch = 0;
 
 void run_test(int);
@@ -156,7 +162,8 @@ void usage(
   fprintf(f, "   disc              - Disconnect a connection\n");
   fprintf(f, "   abort             - Abort a connection\n");
   fprintf(f, "   data              - Test data transfer\n");
-  fprintf(f, "   interrupt         - Test interrupt message transfer\n\n");
+  fprintf(f, "   interrupt         - Test interrupt message transfer\n");
+  fprintf(f, "   connect           - Measure connection setup rate/latency\n\n");
   fprintf(f, "  OPTIONS is:\n");
   fprintf(f, "   accept/reject/disc/abort:\n");
   fprintf(f, "    -o none|std|rcvd - Type of returned optional data\n\n");
@@ -176,8 +183,15 @@ void usage(
   fprintf(f, "                     - Received message processing options\n");
   fprintf(f, "    -s               - Print test statistics\n");
   fprintf(f, "    -t n             - Test duration in seconds\n\n");
+  fprintf(f, "   connect:\n");
+  fprintf(f, "    -c n             - Limit count of connections made\n");
+  fprintf(f, "    -n object        - Connect to this object instead of DTR\n");
+  fprintf(f, "    -o none|std|rcvd - Type of returned optional data\n");
+  fprintf(f, "    -p n             - Target connections per second (0 = no limit)\n");
+  fprintf(f, "    -t n             - Test duration in seconds\n");
+  fprintf(f, "    -w n             - Number of concurrent workers\n\n");
   fprintf(f, "Default options:\n");
-  fprintf(f, " -o none -c 0 -f none -v 1 -l 1024 -t 30\n\n");
+  fprintf(f, " -o none -c 0 -f none -v 1 -l 1024 -t 30 -p 0 -w 1\n\n");
   fprintf(f, "The remote node defaults to the local system and may contain\n");
   fprintf(f, "control information in either VMS or Ultrix format:\n\n");
   fprintf(f, "    node\"user password\"[::]   or\n");
@@ -228,6 +242,9 @@ int main(
         lvalue = 1024;
         vvalue = 1;
         tvalue = 30;
+        pvalue = 0;
+        wvalue = 1;
+        nvalue = NULL;
 
         if (cmd == CMD_INTERRUPT)
           lvalue = maxsize = DTS_INT_MAXSIZE;
@@ -259,6 +276,19 @@ int main(
               lvalue = val;
               break;
 
+            case 'n':
+              if (strlen(optarg) >= DN_MAXOBJL)
+                goto done;
+              nvalue = optarg;
+              break;
+
+            case 'p':
+              val = strtoul(optarg, &endptr, 10);
+              if (*endptr != '\0')
+                goto done;
+              pvalue = val;
+              break;
+
             case 'o':
               if ((idx = switchidx(optarg, oswitch)) == -1)
                 goto done;
@@ -288,6 +318,13 @@ int main(
                 goto done;
               vvalue = val;
               break;
+
+            case 'w':
+              val = strtoul(optarg, &endptr, 10);
+              if ((*endptr != '\0') || (val == 0) || (val > MAX_WORKERS))
+                goto done;
+              wvalue = val;
+              break;
           }
         }
         argc -= optind;
@@ -430,6 +467,19 @@ void parse(void)
   sockaddr.sdn_objnum = DNOBJECT_DTR;
   sockaddr.sdn_nodeaddrl = DN_MAXADDL;
 
+  if (nvalue) {
+    char *endptr;
+    unsigned long objnum = strtoul(nvalue, &endptr, 10);
+
+    if ((*endptr == '\0') && (objnum <= 255))
+      sockaddr.sdn_objnum = objnum;
+    else {
+      sockaddr.sdn_objnum = 0;
+      sockaddr.sdn_objnamel = dn_htons(strlen(nvalue));
+      memcpy(sockaddr.sdn_objname, nvalue, strlen(nvalue));
+    }
+  }
+
   if ((dn = getnodebyname(node)) != NULL) {
     memcpy(sockaddr.sdn_nodeaddr, dn->n_addr, sizeof(sockaddr.sdn_nodeaddr));
     return;
@@ -921,6 +971,264 @@ static void test_data(
   }
 }
 
+/*
+ * Connect rate test. A number of worker threads repeatedly connect to the
+ * remote object and then disconnect, either as fast as they can or at a
+ * target overall rate. Connections are started on a fixed schedule so that
+ * a slow remote doesn't hide itself by slowing down the request rate.
+ */
+static struct {
+  pthread_mutex_t       lock;
+  struct timespec       start;
+  long long             testtime;       /* Test duration in usec */
+  long long             interval;       /* usec between connects, 0 = none */
+  unsigned long long    started;        /* Connects started so far */
+  struct optdata_dn     *optdata;
+} storm = { PTHREAD_MUTEX_INITIALIZER };
+
+struct worker {
+  pthread_t             thread;
+  long long             *latency;       /* usec for each successful connect */
+  size_t                nlatency, maxlatency;
+  unsigned long long    rejects[256];   /* Indexed by disconnect reason */
+  unsigned long long    timeouts, errors, late;
+};
+
+static long long usec_since(
+  struct timespec *from
+)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((now.tv_sec - from->tv_sec) * 1000000LL) +
+    ((now.tv_nsec - from->tv_nsec) / 1000);
+}
+
+/*
+ * Claim the next connect slot. Returns the time (relative to the start of
+ * the test) at which it should be started, or -1 if the test is over.
+ */
+static long long next_slot(void)
+{
+  long long when;
+
+  pthread_mutex_lock(&storm.lock);
+  if ((cvalue && (storm.started >= cvalue)) ||
+      (usec_since(&storm.start) >= storm.testtime)) {
+    pthread_mutex_unlock(&storm.lock);
+    return -1;
+  }
+  when = storm.started++ * storm.interval;
+  pthread_mutex_unlock(&storm.lock);
+
+  return when;
+}
+
+static void *connect_worker(
+  void *arg
+)
+{
+  struct worker *w = arg;
+  struct timeval timeout = { 10, 0 };
+  long long when;
+
+  while ((when = next_slot()) != -1) {
+    long long now = usec_since(&storm.start), t0;
+    int s;
+
+    if (when > now) {
+      struct timespec delay;
+
+      delay.tv_sec = (when - now) / 1000000;
+      delay.tv_nsec = ((when - now) % 1000000) * 1000;
+      nanosleep(&delay, NULL);
+    } else if (storm.interval && ((now - when) > storm.interval))
+      w->late++;
+
+    if ((s = socket(AF_DECnet, SOCK_SEQPACKET, DNPROTO_NSP)) == -1) {
+      w->errors++;
+      continue;
+    }
+
+    setsockopt(s, DNPROTO_NSP, DSO_CONACCESS, &accessdata, sizeof(accessdata));
+    if (storm.optdata)
+      setsockopt(s, DNPROTO_NSP, DSO_CONDATA, storm.optdata, sizeof(*storm.optdata));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    t0 = usec_since(&storm.start);
+    if (connect(s, (struct sockaddr *)&sockaddr, sizeof(sockaddr)) == 0) {
+      if (w->nlatency == w->maxlatency) {
+        size_t newmax = w->maxlatency ? w->maxlatency * 2 : 1024;
+        long long *l = realloc(w->latency, newmax * sizeof(long long));
+
+        if (l) {
+          w->latency = l;
+          w->maxlatency = newmax;
+        }
+      }
+      if (w->nlatency < w->maxlatency)
+        w->latency[w->nlatency++] = usec_since(&storm.start) - t0;
+    } else {
+      struct optdata_dn disdata;
+      socklen_t dislen = sizeof(disdata);
+
+      switch (errno) {
+        case ECONNREFUSED:
+          if ((getsockopt(s, DNPROTO_NSP, DSO_DISDATA, &disdata, &dislen) == 0) &&
+              (dislen == sizeof(disdata)))
+            w->rejects[disdata.opt_status & 0xFF]++;
+          else w->errors++;
+          break;
+
+        case EINPROGRESS:
+        case ETIMEDOUT:
+          w->timeouts++;
+          break;
+
+        default:
+          w->errors++;
+          break;
+      }
+    }
+    close(s);
+  }
+  return NULL;
+}
+
+static int latencycompare(
+  const void *p1,
+  const void *p2
+)
+{
+  long long l1 = *((long long *)p1);
+  long long l2 = *((long long *)p2);
+
+  return (l1 > l2) - (l1 < l2);
+}
+
+static const char *reject_reason(
+  int status
+)
+{
+  switch (status) {
+    case DNSTAT_REJECTED: return "Rejected by object";
+    case DNSTAT_RESOURCES: return "No resources";
+    case DNSTAT_NODENAME: return "Unrecognized node name";
+    case DNSTAT_LOCNODESHUT: return "Local node shut down";
+    case DNSTAT_OBJECT: return "Unrecognized object";
+    case DNSTAT_OBJNAMEFORMAT: return "Invalid object name format";
+    case DNSTAT_TOOBUSY: return "Object too busy";
+    case DNSTAT_NODENAMEFORMAT: return "Invalid node name format";
+    case DNSTAT_REMNODESHUT: return "Remote node shut down";
+    case DNSTAT_NODERESOURCES: return "Node resources";
+    case DNSTAT_OBJRESOURCES: return "Object resources";
+    case DNSTAT_ACCCONTROL: return "Access control rejected";
+    case DNSTAT_BADACCOUNT: return "Bad account";
+    case DNSTAT_NORESPONSE: return "No response from object";
+    case DNSTAT_NODEUNREACH: return "Node unreachable";
+    default: return "Other";
+  }
+}
+
+static void test_connect(
+  struct optdata_dn *optdata
+)
+{
+  struct worker *workers;
+  unsigned long long rejects[256], timeouts = 0, errors = 0, late = 0;
+  unsigned long long attempts, rejected = 0;
+  long long *latency, elapsed, total = 0;
+  size_t nlatency = 0;
+  int i, j;
+
+  if ((workers = calloc(wvalue, sizeof(struct worker))) == NULL) {
+    fprintf(stderr, "Connect: No memory\n");
+    exit(1);
+  }
+
+  /*
+   * Only DTR understands the test request block
+   */
+  storm.optdata = nvalue ? NULL : optdata;
+  storm.testtime = tvalue * 1000000LL;
+  storm.interval = pvalue ? 1000000LL / pvalue : 0;
+  storm.started = 0;
+  clock_gettime(CLOCK_MONOTONIC, &storm.start);
+
+  for (i = 0; i < wvalue; i++)
+    if (pthread_create(&workers[i].thread, NULL, connect_worker, &workers[i]) != 0) {
+      perror("Connect: pthread_create");
+      exit(1);
+    }
+
+  memset(rejects, 0, sizeof(rejects));
+  for (i = 0; i < wvalue; i++) {
+    pthread_join(workers[i].thread, NULL);
+    nlatency += workers[i].nlatency;
+    timeouts += workers[i].timeouts;
+    errors += workers[i].errors;
+    late += workers[i].late;
+    for (j = 0; j < 256; j++)
+      rejects[j] += workers[i].rejects[j];
+  }
+  elapsed = usec_since(&storm.start);
+  attempts = storm.started;
+
+  /*
+   * Gather all the latencies so that we can report percentiles
+   */
+  latency = malloc((nlatency ? nlatency : 1) * sizeof(long long));
+  if (latency == NULL) {
+    fprintf(stderr, "Connect: No memory\n");
+    exit(1);
+  }
+  nlatency = 0;
+  for (i = 0; i < wvalue; i++) {
+    memcpy(&latency[nlatency], workers[i].latency,
+           workers[i].nlatency * sizeof(long long));
+    nlatency += workers[i].nlatency;
+    free(workers[i].latency);
+  }
+  free(workers);
+
+  qsort(latency, nlatency, sizeof(long long), latencycompare);
+  for (i = 0; i < nlatency; i++)
+    total += latency[i];
+  for (j = 0; j < 256; j++)
+    rejected += rejects[j];
+
+  printf("Connects started %15llu  Workers %d\n", attempts, wvalue);
+  printf("Connects accepted %14zu\n", nlatency);
+  printf("Connects rejected %14llu\n", rejected);
+  printf("Connects timed out %13llu\n", timeouts);
+  printf("Other errors %19llu\n", errors);
+  if (pvalue)
+    printf("Started late %19llu  (target %d/sec)\n", late, pvalue);
+  printf("Accepts per second %13.2f\n",
+         elapsed ? (nlatency * 1000000.0) / elapsed : 0.0);
+
+  if (nlatency) {
+    printf("Connect confirm latency (msec):\n");
+    printf("  min %8.3f  avg %8.3f  max %8.3f\n",
+           latency[0] / 1000.0, (total / nlatency) / 1000.0,
+           latency[nlatency - 1] / 1000.0);
+    printf("  p50 %8.3f  p90 %8.3f  p99 %8.3f  p99.9 %8.3f\n",
+           latency[(nlatency * 50) / 100] / 1000.0,
+           latency[(nlatency * 90) / 100] / 1000.0,
+           latency[(nlatency * 99) / 100] / 1000.0,
+           latency[(nlatency * 999) / 1000] / 1000.0);
+  }
+
+  if (rejected) {
+    printf("Reject reasons:\n");
+    for (j = 0; j < 256; j++)
+      if (rejects[j])
+        printf("  %3d %-28s %10llu\n", j, reject_reason(j), rejects[j]);
+  }
+  free(latency);
+}
+
 void run_test(int cmd)
 {
   struct optdata_dn optdata;
@@ -933,9 +1241,10 @@ void run_test(int cmd)
     switch (cmd) {
       case CMD_ACCEPT:
       case CMD_REJECT:
+      case CMD_CONNECT:
         optdata.opt_data[0] = DTS_TEST_CONNECT;
         optdata.opt_data[1] =
-          cmd == CMD_ACCEPT ? DTS_SUBTEST_ACC : DTS_SUBTEST_REJ;
+          cmd == CMD_REJECT ? DTS_SUBTEST_REJ : DTS_SUBTEST_ACC;
         optdata.opt_data[1] |= ovalue;
         if (ovalue != DTS_CONNDIS_NONE) {
           memcpy(&optdata.opt_data[2], std_optdata, 14);
@@ -1031,6 +1340,14 @@ void run_test(int cmd)
       case CMD_INTERRUPT:
         test_interrupt(&optdata);
         break;
+
+      case CMD_CONNECT:
+        /*
+         * The workers use their own sockets
+         */
+        close(sock);
+        test_connect(&optdata);
+        break;
     }
     return;
   } else perror("socket() failed");
@@ -38,6 +38,7 @@
 #include "connection.h"
 #include "protocol.h"
 #include "vaxcrc.h"
+#include "filespec.h"
 #include "params.h"
 #include "task.h"
 #include "server.h"
@@ -261,36 +262,7 @@ bool fal_directory::send_dir_entry(char *path, int display)
 	char vmsname[PATH_MAX];
 	make_vms_filespec(path, vmsname, false);
 
-	unsigned int lastdot = strlen(vmsname);
-	unsigned int dotcount = 0;
-	unsigned int i;
-
-// Hack the name around to keep VMS happy. If there is more than one dot
-// in the name then convert the first ones to hyphens,
-// also convert some other illegal characters to hyphens too.
-// There may need to be more here as odd characters to seem to upset VMS
-// greatly.
-// CC: TODO - move this back into task.cc so we can do more generic
-// 	       conversions of "illegal" filenames
-	for (i=0; i< strlen(vmsname); i++)
-	{
-	    if (vmsname[i] == '~' ||
-		vmsname[i] == ' ') vmsname[i] = '-';
-
-	    if (vmsname[i] == '.')
-	    {
-		lastdot = i;
-		dotcount++;
-	    }
-	}
-	// Do those superflous dots
-	if (dotcount > 1)
-	{
-	    for (i=0; i< strlen(vmsname); i++)
-	    {
-		if (vmsname[i] == '.' && i != lastdot) vmsname[i] = '-';
-	    }
-	  }
+	dap_vms_legalise(vmsname);
 	name_msg->set_namespec(vmsname);
     }
     else
@@ -38,6 +38,7 @@
 #include "connection.h"
 #include "protocol.h"
 #include "vaxcrc.h"
+#include "filespec.h"
 #include "params.h"
 #include "task.h"
 #include "server.h"
@@ -62,7 +63,6 @@ bool fal_erase::process_message(dap_message *m)
         {
 	    glob_t gl;
 	    int    status;
-	    int    pathno = 0;
 	    char   unixname[PATH_MAX];
 
 	    dap_access_message *am = (dap_access_message *)m;
@@ -115,25 +115,22 @@ bool fal_erase::process_message(dap_message *m)
 		    return false;
 	    }
 
-	    // Delete all the files
-	    do
-	    {
-		status = unlink(gl.gl_pathv[pathno]);
-
-		if (verbose > 1)
-		    DAPLOG((LOG_DEBUG, "in fal_erase: unlink '%s', result = %d\n", gl.gl_pathv[pathno], status));
+	    // A single file has had its name sent with the attributes,
+	    // for a wildcard send the name of each file as it goes.
+	    bool send_names = gl.gl_pathc > 1 &&
+		(am->get_display() & dap_access_message::DISPLAY_NAME_MASK);
 
-		pathno++;
-	    } while (status == 0 && gl.gl_pathv[pathno]);
-
-	    if (status) // Send error code
+	    if (!erase_files(gl, send_names)) // Send error code
 	    {
 		return_error();
 	    }
 	    else
 	    {
-		dap_ack_message ack;
-		ack.write(conn);
+		if (!send_names)
+		{
+		    dap_ack_message ack;
+		    ack.write(conn);
+		}
 
 		dap_accomp_message acc;
 		acc.set_cmpfunc(dap_accomp_message::RESPONSE);
@@ -146,4 +143,167 @@ bool fal_erase::process_message(dap_message *m)
     return false; //Finished
 }
 
+// Delete the files glob found. Its output is sorted so all the files in
+// a directory come together, when the client wants their names we hold
+// the directory open while we work through them and only work out the
+// VMS name of the directory once.
+bool fal_erase::erase_files(glob_t &gl, bool send_names)
+{
+    char   dirname[PATH_MAX];
+    char   vmsname[PATH_MAX];
+    char  *failed = NULL;
+    bool   named = false;
+    int    prefixlen = 0;
+    int    dirfd = -1;
+    int    status = 0;
+    int    saved_errno;
+
+    // Nothing to send back per file, so nothing to batch
+    if (!send_names)
+	return unlink_files(gl);
+
+    for (unsigned int pathno = 0; pathno < gl.gl_pathc; pathno++)
+    {
+	char *path = gl.gl_pathv[pathno];
+	char *base = strrchr(path, '/');
+	int   dirlen = base ? base - path + 1 : 0;
+
+	base = base ? base + 1 : path;
+	failed = path;
+	named = false;
+
+	// New directory ?
+	if (dirfd == -1 || strncmp(dirname, path, dirlen) ||
+	    dirname[dirlen] != '\0')
+	{
+	    if (dirfd != -1) close(dirfd);
+	    memcpy(dirname, path, dirlen);
+	    dirname[dirlen] = '\0';
+	    dirfd = open(dirlen ? dirname : ".", O_RDONLY | O_DIRECTORY);
+	    if (dirfd == -1)
+	    {
+		status = -1;
+		break;
+	    }
+	    prefixlen = 0;
+	}
+
+	// The VMS name has to be made before the file goes. The volume
+	// and directory part is worked out once for each directory, from
+	// the directory itself, and each file's name is added to that.
+	if (vms_format)
+	{
+	    if (!prefixlen)
+	    {
+		char  fullname[PATH_MAX];
+		char *dirend;
+
+		if (!realpath(dirlen ? dirname : ".", fullname))
+		{
+		    status = -1;
+		    break;
+		}
+		remove_vroot(fullname);
+
+		// Convert it with a dummy file name on the end so we get
+		// DEV:[DIR]X and can cut the X off
+		if (strlen(fullname) + 3 > sizeof(fullname))
+		{
+		    errno = ENAMETOOLONG;
+		    status = -1;
+		    break;
+		}
+		strcat(fullname, fullname[strlen(fullname)-1] == '/' ? "X" : "/X");
+		dap_unix_to_vms(fullname, vmsname, PATH_MAX, sysdisk_name,
+				DAP_VMS_SYSDISK);
+		dirend = strrchr(vmsname, ']');
+		if (!dirend) dirend = strrchr(vmsname, '>');
+		if (!dirend) dirend = strrchr(vmsname, ':');
+		prefixlen = dirend ? dirend - vmsname + 1 : 0;
+	    }
+	    strcpy(vmsname+prefixlen, base);
+	    add_vms_suffix(vmsname+prefixlen, false);
+	    dap_vms_upcase(vmsname+prefixlen);
+	    dap_vms_legalise(vmsname+prefixlen);
+	    named = true;
+	}
+
+	status = unlinkat(dirfd, base, 0);
+	saved_errno = errno;
+
+	if (status == 0 && params.use_metafiles)
+	{
+	    char metafile[PATH_MAX];
+
+	    snprintf(metafile, sizeof(metafile), "%s/%s", METAFILE_DIR, base);
+	    unlinkat(dirfd, metafile, 0);
+	}
+
+	if (verbose > 1)
+	    DAPLOG((LOG_DEBUG, "in fal_erase: unlink '%s', result = %d\n", path, status));
+
+	if (status)
+	{
+	    errno = saved_errno;
+	    break;
+	}
+
+	// These go out with the rest of the block, not one by one
+	dap_ack_message ack;
+	if (!send_erased_name(path, vmsname, named) || !ack.write(conn))
+	{
+	    failed = NULL;
+	    status = -1;
+	    break;
+	}
+    }
+
+    saved_errno = errno;
+    if (dirfd != -1) close(dirfd);
+
+    // Name the file that failed so the error STATUS the caller sends
+    // isn't taken as being about the last one that went.
+    if (status && failed)
+	send_erased_name(failed, vmsname, named);
+    errno = saved_errno;
+
+    return status == 0;
+}
+
+// Send the NAME of a file being erased. vmsname is used if it has
+// already been made.
+bool fal_erase::send_erased_name(const char *path, char *vmsname, bool named)
+{
+    dap_name_message name_msg;
+
+    if (vms_format)
+    {
+	if (!named)
+	    make_vms_filespec(path, vmsname, true);
+	name_msg.set_namespec(vmsname);
+	name_msg.set_nametype(dap_name_message::FILESPEC);
+    }
+    else
+    {
+	strcpy(vmsname, path);
+	remove_vroot(vmsname);
+	name_msg.set_namespec(vmsname);
+	name_msg.set_nametype(dap_name_message::FILENAME);
+    }
+    return name_msg.write(conn);
+}
 
+// Plain delete of all the files, stopping at the first that fails
+bool fal_erase::unlink_files(glob_t &gl)
+{
+    int status = 0;
+
+    for (unsigned int pathno = 0; status == 0 && pathno < gl.gl_pathc; pathno++)
+    {
+	status = unlink(gl.gl_pathv[pathno]);
+
+	if (verbose > 1)
+	    DAPLOG((LOG_DEBUG, "in fal_erase: unlink '%s', result = %d\n", gl.gl_pathv[pathno], status));
+    }
+    return status == 0;
+}
@@ -7,4 +7,7 @@ class fal_erase: public fal_task
     virtual bool process_message(dap_message *m);
     
   private:
+    bool erase_files(glob_t &, bool);
+    bool unlink_files(glob_t &);
+    bool send_erased_name(const char *, char *, bool);
 };
@@ -0,0 +1,210 @@
+/******************************************************************************
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+ ******************************************************************************
+*/
+////
+// erasebench.cc
+// erasebench [-n] [-v] [files]: make <files> (default 10000) empty files
+// in a new directory under /tmp and have FAL's ERASE task delete them
+// with one wildcard ERASE over a local socketpair, timing it from the
+// ACCESS to the ACCOMP. -n asks for the name of each file (as dndel
+// does), -v sends the file spec in VMS format so the names come back
+// that way. Built alongside fal but not installed.
+////
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <glob.h>
+#include <regex.h>
+#include <netdnet/dn.h>
+#include <netdnet/dnetdb.h>
+
+#include "logging.h"
+#include "connection.h"
+#include "protocol.h"
+#include "vaxcrc.h"
+#include "params.h"
+#include "task.h"
+#include "erase.h"
+
+// Usual VMS buffer size
+#define BENCH_BUFSIZE 4096
+
+// libdap reads until it sees MSG_EOR, as DECnet sets it at the end of
+// each record. AF_UNIX doesn't, but every SOCK_SEQPACKET read is a whole
+// record anyway, so say so.
+extern "C" ssize_t recvmsg(int s, struct msghdr *msg, int flags)
+{
+    ssize_t status = syscall(SYS_recvmsg, s, msg, flags);
+
+    if (status > 0)
+	msg->msg_flags |= MSG_EOR;
+    return status;
+}
+
+static double now()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// The FAL end: run one ERASE task the way fal_server does
+static void run_fal(int sock)
+{
+    struct fal_params p;
+
+    memset(&p, 0, sizeof(p));
+    p.auto_type = fal_params::NONE;
+
+    dap_connection conn(sock, BENCH_BUFSIZE, 0);
+    dap_message *m = dap_message::read_message(conn, true);
+    if (!m)
+	_exit(1);
+
+    fal_erase task(conn, 0, p);
+    task.process_message(m);
+    delete m;
+    _exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+    char   dir[64];
+    char   spec[PATH_MAX];
+    int    nfiles = 10000;
+    int    names = 0;
+    int    errors = 0;
+    bool   vms = false;
+    bool   done = false;
+    int    sv[2];
+    int    opt;
+    pid_t  fal;
+    double start, secs;
+
+    while ((opt = getopt(argc, argv, "nv")) != EOF)
+    {
+	switch (opt)
+	{
+	case 'n':
+	    names = 1;
+	    break;
+	case 'v':
+	    vms = true;
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-n] [-v] [files]\n", argv[0]);
+	    return 2;
+	}
+    }
+    if (optind < argc)
+	nfiles = atoi(argv[optind]);
+
+    init_logging("erasebench", 'e', false);
+
+    // Lower case so the VMS form of it maps back to the same place
+    snprintf(dir, sizeof(dir), "/tmp/erasebench%d", (int)getpid());
+    if (mkdir(dir, 0700) == -1)
+    {
+	perror(dir);
+	return 1;
+    }
+    for (int i = 0; i < nfiles; i++)
+    {
+	char name[PATH_MAX];
+	int  fd;
+
+	snprintf(name, sizeof(name), "%s/f%06d.dat", dir, i);
+	if ((fd = open(name, O_WRONLY | O_CREAT, 0600)) == -1)
+	{
+	    perror(name);
+	    return 1;
+	}
+	close(fd);
+    }
+
+    if (vms)
+	snprintf(spec, sizeof(spec), "SYSDISK:[TMP.ERASEBENCH%d]*.*;*",
+		 (int)getpid());
+    else
+	snprintf(spec, sizeof(spec), "%s/*", dir);
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == -1)
+    {
+	perror("socketpair");
+	return 1;
+    }
+    if ((fal = fork()) == 0)
+    {
+	close(sv[0]);
+	run_fal(sv[1]);
+    }
+    close(sv[1]);
+
+    dap_connection conn(sv[0], BENCH_BUFSIZE, 0);
+    dap_access_message acc;
+
+    acc.set_accfunc(dap_access_message::ERASE);
+    acc.set_accopt(1);
+    acc.set_filespec(spec);
+    acc.set_display(dap_access_message::DISPLAY_MAIN_MASK |
+		    (names ? dap_access_message::DISPLAY_NAME_MASK : 0));
+
+    start = now();
+    acc.write(conn);
+
+    names = 0;
+    while (!done)
+    {
+	dap_message *m = dap_message::read_message(conn, true);
+	if (!m)
+	{
+	    fprintf(stderr, "erasebench: %s\n", conn.get_error());
+	    errors++;
+	    break;
+	}
+	switch (m->get_type())
+	{
+	case dap_message::NAME:
+	    names++;
+	    break;
+	case dap_message::STATUS:
+	    fprintf(stderr, "erasebench: %s\n",
+		    ((dap_status_message *)m)->get_message());
+	    errors++;
+	    done = true;
+	    break;
+	case dap_message::ACCOMP:
+	    done = true;
+	    break;
+	}
+	delete m;
+    }
+    secs = now() - start;
+
+    printf("%d files, %d names sent, %.3fs\n", nfiles, names, secs);
+
+    waitpid(fal, NULL, 0);
+    conn.close();
+    rmdir(dir);
+    return errors != 0;
+}
@@ -47,6 +47,14 @@
 
 #define LOCAL_AUTO_FILE ".fal_auto"
 
+#ifndef PRINT_COMMAND
+#define PRINT_COMMAND "lpr %s"
+#endif
+
+#ifndef SUBMIT_COMMAND
+#define SUBMIT_COMMAND "at -f %s now"
+#endif
+
 void usage(char *prog, FILE *f);
 
 static int verbose = 0;
@@ -67,8 +75,11 @@ int main(int argc, char *argv[])
     p.use_file  = false;            // Use built-in defaults
     p.use_metafiles = false;
     p.use_adf   = false;
+    p.use_dapframe = true;
     p.vroot[0]  = '\0';
     p.vroot_len = 0;
+    strcpy(p.submit_command, SUBMIT_COMMAND);
+    strcpy(p.print_command, PRINT_COMMAND);
 
 #ifdef NO_FORK
     dont_fork = 1;
@@ -78,7 +89,7 @@ int main(int argc, char *argv[])
     // so we can check the version number and get help without being root.
     opterr = 0;
     optind = 0;
-    while ((opt=getopt(argc,argv,"?vVhdmtul:a:f:r:")) != EOF)
+    while ((opt=getopt(argc,argv,"?vVhdmtukl:a:f:r:s:p:")) != EOF)
     {
 	switch(opt)
 	{
@@ -110,6 +121,10 @@ int main(int argc, char *argv[])
 	    p.use_adf = true;
 	    break;
 
+	case 'k':
+	    p.use_dapframe = false;
+	    break;
+
 	case 'r':
 	    strcpy(p.vroot, optarg);
 
@@ -119,6 +134,16 @@ int main(int argc, char *argv[])
 	    p.vroot_len = strlen(p.vroot);
 	    break;
 
+	case 's':
+	    strncpy(p.submit_command, optarg, PATH_MAX-1);
+	    p.submit_command[PATH_MAX-1] = '\0';
+	    break;
+
+	case 'p':
+	    strncpy(p.print_command, optarg, PATH_MAX-1);
+	    p.print_command[PATH_MAX-1] = '\0';
+	    break;
+
 	case 'V':
 	    printf("\nfal from dnprogs version %s\n\n", VERSION);
 	    exit(1);
@@ -246,6 +271,9 @@ void usage(char *prog, FILE *f)
     fprintf(f," -v        Verbose (repeat to increase verbosity)\n");
     fprintf(f," -m        Use meta-files to preserve file info\n");
     fprintf(f," -t        Use VMS NFS $ADF$ files (readonly)\n");
+    fprintf(f," -k        Don't use kernel DAP framing for block transfers\n");
+    fprintf(f," -s<cmd>   Command to run for SUBMIT (default \"%s\")\n", SUBMIT_COMMAND);
+    fprintf(f," -p<cmd>   Command to run for PRINT (default \"%s\")\n", PRINT_COMMAND);
     fprintf(f," -V        Show version\n");
     fprintf(f," -h        Help\n");
 }
@@ -18,6 +18,7 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <assert.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -43,20 +44,20 @@
 #include "task.h"
 #include "server.h"
 #include "open.h"
+#include "spool.h"
 #include "dn_endian.h"
 
-#ifndef PRINT_COMMAND
-#define PRINT_COMMAND "lpr %s"
-#endif
-
-#ifndef SUBMIT_COMMAND
-#define SUBMIT_COMMAND "at -f %s now "
-#endif
-
 // This is the initial allocation and expansion value for
 // the array or record lengths.
 #define RECORD_LENGTHS_SIZE 100
 
+// How much of each prefetched file to ask the kernel to read in
+#define PREFETCH_BYTES (64*1024)
+
+// Blocks per sendfile() call when the kernel does the DAP framing, we
+// check for messages from the client between calls.
+#define SPLICE_BLOCKS 64
+
 fal_open::fal_open(dap_connection &c, int v, fal_params &p,
 		   dap_attrib_message *att,
 		   dap_alloc_message   *alloc,
@@ -72,11 +73,16 @@ fal_open::fal_open(dap_connection &c, int v, fal_params &p,
     create       = false;
     buf          = new char[conn.get_blocksize()];
     protect_msg  = protect;
+    prefetched   = 0;
+    for (unsigned int i=0; i<PREFETCH_FILES; i++)
+	prefetch_fd[i] = -1;
     if (att->get_fop_bit(dap_attrib_message::FB$CIF)) create = true;
 }
 
 fal_open::~fal_open()
 {
+    for (unsigned int i=0; i<PREFETCH_FILES; i++)
+	if (prefetch_fd[i] != -1) close(prefetch_fd[i]);
     delete[] buf;
 }
 
@@ -131,6 +137,7 @@ bool fal_open::process_message(dap_message *m)
 		return false;
 	    }
 	    glob_entry = 0;
+	    prefetched = 0;
 	    display = am->get_display();
 
 	    // Open the file
@@ -150,6 +157,7 @@ bool fal_open::process_message(dap_message *m)
 		    return_error();
 		    return false;
 		}
+		prefetch_files();
 	    }
   	    num_records   = 0;
 	    current_record = 0;
@@ -278,6 +286,9 @@ bool fal_open::process_message(dap_message *m)
 		if (am->get_fop_bit(dap_attrib_message::FB$SPL) ||
 		    attrib_msg->get_fop_bit(dap_attrib_message::FB$SPL))
 		    print_file();
+		if (am->get_fop_bit(dap_attrib_message::FB$SCF) ||
+		    attrib_msg->get_fop_bit(dap_attrib_message::FB$SCF))
+		    submit_file();
 		if (am->get_fop_bit(dap_attrib_message::FB$DLT) ||
 		    attrib_msg->get_fop_bit(dap_attrib_message::FB$DLT))
 		    delete_file();
@@ -290,12 +301,13 @@ bool fal_open::process_message(dap_message *m)
 		if (glob_entry < gl.gl_pathc-1)
 		{
 		    glob_entry++;
-		    stream = fopen(gl.gl_pathv[glob_entry], write_access?"w":"r");
+		    stream = open_next_file();
 		    if (!stream)
 		    {
 			return_error();
 			return false;
 		    }
+		    prefetch_files();
 		    num_records    = 0;
 		    current_record = 0;
 		    if (record_lengths) delete[] record_lengths;
@@ -392,6 +404,14 @@ bool fal_open::send_file(int rac, long vbn)
 
     record_pos = ftell(stream);
 
+    // Let the kernel frame the blocks if it can
+    if (streaming && !use_records && params.use_dapframe)
+    {
+	int status = splice_file();
+	if (status >= 0)
+	    return status;
+    }
+
     while (!feof(stream))
     {
 	if (use_records)
@@ -440,6 +460,7 @@ bool fal_open::send_file(int rac, long vbn)
 	    if (!buflen) ateof = true;
 
 	    // Always send a full block or VMS complains.
+	    if (buflen < bs) memset(buf+buflen, 0, bs-buflen);
 	    buflen=bs;
 	}
 
@@ -516,6 +537,95 @@ bool fal_open::send_file(int rac, long vbn)
     return true;
 }
 
+// Send the rest of the file with sendfile() and have the kernel wrap
+// each block in a DATA message (DSO_DAPFRAME) so the data never comes
+// up to us. The messages are the same as the block loop in send_file()
+// sends, including the zero padding of the last block.
+// Returns -1 if the kernel can't do it and the caller should send
+// the file itself.
+int fal_open::splice_file()
+{
+    struct dapframe_dn df;
+    struct stat st;
+    off_t   offset = ftell(stream);
+    ssize_t sent = 0;
+    bool    aborted = false;
+
+    if (fstat(fileno(stream), &st) == -1 || !S_ISREG(st.st_mode))
+	return -1;
+
+    memset(&df, 0, sizeof(df));
+    df.dfn_chunk = block_size;
+    df.dfn_bufsize = conn.get_blocksize();
+    if (setsockopt(conn.get_fd(), DNPROTO_NSP, DSO_DAPFRAME,
+		   &df, sizeof(df)) == -1)
+    {
+	if (verbose)
+	    DAPLOG((LOG_INFO, "Can't use kernel DAP framing: %s\n",
+		    strerror(errno)));
+	params.use_dapframe = false;
+	return -1;
+    }
+
+    // Anything we have buffered has to go first
+    conn.set_blocked(false);
+
+    // Ask for exactly what is left on the last call so the kernel
+    // knows to pad and finish the final block.
+    while (offset < st.st_size && !aborted)
+    {
+	size_t count = block_size * SPLICE_BLOCKS;
+
+	if ((off_t)count > st.st_size - offset)
+	    count = st.st_size - offset;
+
+	// An interrupted call can leave a DATA message half sent and the
+	// kernel won't take anything else until it's finished, so go on.
+	sent = sendfile(conn.get_fd(), fileno(stream), &offset, count);
+	if (sent == -1 && errno == EINTR)
+	    continue;
+	if (sent <= 0)
+	    break;
+
+	// Look for the client giving up, as send_file() does
+	dap_message *d = dap_message::read_message(conn, false);
+	if (d)
+	{
+	    if (verbose > 1) DAPLOG((LOG_INFO, "Got OOB message: %s\n",
+				     d->type_name()));
+	    if (d->get_type() == dap_message::STATUS)
+	    {
+		dap_status_message *sm = (dap_status_message *)d;
+		DAPLOG((LOG_INFO, "Error sending: %s\n", sm->get_message()));
+		aborted = true;
+	    }
+	    if (d->get_type() == dap_message::ACCOMP)
+	    {
+		dap_accomp_message am;
+
+		am.set_cmpfunc(dap_accomp_message::RESPONSE);
+		am.write(conn);
+		aborted = true;
+	    }
+	    delete d;
+	}
+    }
+    fseek(stream, offset, SEEK_SET);
+
+    if (sent < 0)
+    {
+	DAPLOG((LOG_ERR, "sendfile failed: %s\n", strerror(errno)));
+	return 0;
+    }
+    if (aborted)
+	return 0;
+
+    if (verbose > 1) DAPLOG((LOG_DEBUG, "sent file contents: %ld bytes\n",
+			     (long)offset));
+    send_eof();
+    return 1;
+}
+
 // Write some data to the file
 bool fal_open::put_record(dap_data_message *dm)
 {
@@ -613,15 +723,25 @@ bool fal_open::put_record(dap_data_message *dm)
 // Print the file
 void fal_open::print_file()
 {
-    char cmd[strlen(gl.gl_pathv[glob_entry])+strlen(PRINT_COMMAND)+2];
-
-    sprintf(cmd, PRINT_COMMAND, gl.gl_pathv[glob_entry]);
+    fal_spooler spool(params.print_command, conn.get_fd(), verbose);
 
-    int status = system(cmd);
+    spool.queue(gl.gl_pathv[glob_entry]);
+    int status = spool.wait();
 
     if (verbose > 1) DAPLOG((LOG_INFO, "Print file status = %d\n", status));
 }
 
+// Submit the file as a batch job
+void fal_open::submit_file()
+{
+    fal_spooler spool(params.submit_command, conn.get_fd(), verbose);
+
+    spool.queue(gl.gl_pathv[glob_entry]);
+    int status = spool.wait();
+
+    if (verbose > 1) DAPLOG((LOG_INFO, "Submit file status = %d\n", status));
+}
+
 // Delete the file
 void fal_open::delete_file()
 {
@@ -677,6 +797,49 @@ void fal_open::send_eof()
     conn.set_blocked(false);
 }
 
+// When reading a wildcard list, open the next few files and have the
+// kernel start reading them in while we are still sending this one.
+// By the time the client asks for them the directory lookups are done
+// and their first blocks (which guess_file_type() looks at) are cached.
+void fal_open::prefetch_files()
+{
+    if (write_access || create) return;
+
+    while (prefetched+1 < gl.gl_pathc &&
+	   prefetched < glob_entry + PREFETCH_FILES)
+    {
+	int fd;
+
+	prefetched++;
+	fd = open(gl.gl_pathv[prefetched], O_RDONLY|O_CLOEXEC);
+	if (fd != -1)
+	{
+	    posix_fadvise(fd, 0, PREFETCH_BYTES, POSIX_FADV_WILLNEED);
+	    if (verbose > 2)
+		DAPLOG((LOG_DEBUG, "prefetching %s\n", gl.gl_pathv[prefetched]));
+	}
+	prefetch_fd[prefetched % PREFETCH_FILES] = fd;
+    }
+}
+
+// Open the file at glob_entry, using the prefetched descriptor if
+// there is one.
+FILE *fal_open::open_next_file()
+{
+    if (glob_entry <= prefetched &&
+	prefetch_fd[glob_entry % PREFETCH_FILES] != -1)
+    {
+	int fd = prefetch_fd[glob_entry % PREFETCH_FILES];
+	FILE *f;
+
+	prefetch_fd[glob_entry % PREFETCH_FILES] = -1;
+	f = fdopen(fd, "r");
+	if (f) return f;
+	close(fd);
+    }
+    return fopen(gl.gl_pathv[glob_entry], write_access?"w":"r");
+}
+
 // Actually create the file using (as close as we can get) the attributes
 // given us by the client
 bool fal_open::create_file(char *filespec)
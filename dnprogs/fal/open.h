@@ -15,6 +15,11 @@ class fal_open: public fal_task
     glob_t        gl;
     unsigned int  glob_entry; // file entry in the glob structure
 
+    // Files after glob_entry that we have already opened for reading
+    static const unsigned int PREFETCH_FILES = 2;
+    unsigned int  prefetched; // last glob entry opened in advance
+    int           prefetch_fd[PREFETCH_FILES];
+
     int           display;
     FILE         *stream;
     bool          use_records;
@@ -29,12 +34,16 @@ class fal_open: public fal_task
     dap_protect_message *protect_msg;
 
     bool send_file(int, long);
+    int  splice_file();
     void print_file();
+    void submit_file();
     void delete_file();
     void truncate_file();
     bool put_record(dap_data_message *);
     void set_control_options(dap_control_message *);
     bool create_file(char *);
     void send_eof();
+    void prefetch_files();
+    FILE *open_next_file();
 
 };
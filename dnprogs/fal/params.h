@@ -12,8 +12,11 @@ class fal_params
     bool  use_file;
     bool  use_metafiles;
     bool  use_adf;
+    bool  use_dapframe;
     bool  can_do_stmlf;
     int   remote_os;
+    char  submit_command[PATH_MAX];
+    char  print_command[PATH_MAX];
 
     const char *type_name()
     {
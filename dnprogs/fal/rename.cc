@@ -97,7 +97,7 @@ bool fal_rename::process_message(dap_message *m)
 	    else
 	    {
 		strcpy(newname, nm->get_namespec());
-		add_vroot(oldname);
+		add_vroot(newname);
 	    }
 	    int status = rename(oldname, newname);
 
@@ -134,24 +134,3 @@ bool fal_rename::process_message(dap_message *m)
     }
     return true;
 }
-
-bool fal_rename::send_name(char *name)
-{
-    dap_name_message name_msg;
-
-    if (vms_format)
-    {
-	char vmsname[PATH_MAX];
-	
-	make_vms_filespec(name, vmsname, true);
-	
-	name_msg.set_namespec(vmsname);
-	name_msg.set_nametype(dap_name_message::FILESPEC);
-    }
-    else
-    {
-	name_msg.set_namespec(name);
-	name_msg.set_nametype(dap_name_message::FILENAME);
-    }
-    return name_msg.write(conn);
-}
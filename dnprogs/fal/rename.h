@@ -9,6 +9,4 @@ class fal_rename: public fal_task
   private:
     char oldname[PATH_MAX];
     int  display;
-
-    bool send_name(char *);
 };
@@ -249,6 +249,21 @@ bool fal_server::exchange_config()
 	if (params.remote_os == dap_config_message::OS_RSX11M ||
 	    params.remote_os == dap_config_message::OS_RSX11MP)
 	params.can_do_stmlf = false;
+
+	// Block mode transfers to VMS can be framed by the kernel
+	// (DSO_DAPFRAME) if it knows how.
+	if (params.use_dapframe)
+	{
+	    struct dapframe_dn df;
+	    socklen_t len = sizeof(df);
+
+	    if (params.remote_os != dap_config_message::OS_VAXVMS ||
+		getsockopt(conn.get_fd(), DNPROTO_NSP, DSO_DAPFRAME,
+			   &df, &len) == -1)
+		params.use_dapframe = false;
+	    else if (verbose > 1)
+		DAPLOG((LOG_DEBUG, "Using kernel DAP framing\n"));
+	}
     }
     else
     {
@@ -0,0 +1,235 @@
+/******************************************************************************
+    (c) 1998-2006 Christine Caulfield               christine.caulfield@googlemail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+ ******************************************************************************
+ */
+// spool.cc
+// Start the SUBMIT/PRINT command for a batch of files without a shell.
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <syslog.h>
+#include <limits.h>
+#include <spawn.h>
+#include <signal.h>
+#include <string.h>
+
+#include "logging.h"
+#include "spool.h"
+
+extern char **environ;
+
+fal_spooler::fal_spooler(const char *command, int fd, int v):
+    closefd(fd),
+    verbose(v),
+    jobs(NULL),
+    num_jobs(0),
+    max_jobs(0),
+    running(0)
+{
+    int      argc = 0;
+    char    *tok;
+    sigset_t ss;
+
+    // Like system(3), keep SIGCHLD to ourself while the jobs run. A
+    // handler inherited from the daemon would reap them before we can.
+    sigemptyset(&ss);
+    sigaddset(&ss, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &ss, &saved_sigmask);
+
+    // Split the command into words. The one with %s in it is where the
+    // file name goes, if there isn't one it goes on the end.
+    cmdbuf = strdup(command);
+    fileslot = -1;
+    slotpattern = NULL;
+    for (tok = strtok(cmdbuf, " \t"); tok && argc < MAX_ARGS;
+	 tok = strtok(NULL, " \t"))
+    {
+	if (fileslot == -1 && strstr(tok, "%s"))
+	{
+	    fileslot = argc;
+	    slotpattern = tok;
+	}
+	argv[argc++] = tok;
+    }
+    if (fileslot == -1)
+	fileslot = argc++;
+    argv[argc] = NULL;
+}
+
+fal_spooler::~fal_spooler()
+{
+    wait();
+    for (int i=0; i<num_jobs; i++)
+	free(jobs[i].name);
+    delete[] jobs;
+    free(cmdbuf);
+    sigprocmask(SIG_SETMASK, &saved_sigmask, NULL);
+}
+
+void fal_spooler::grow()
+{
+    max_jobs += 32;
+    struct job *newjobs = new struct job[max_jobs];
+    if (jobs)
+    {
+	memcpy(newjobs, jobs, sizeof(struct job)*num_jobs);
+	delete[] jobs;
+    }
+    jobs = newjobs;
+}
+
+bool fal_spooler::queue(const char *file)
+{
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t attr;
+    char  arg[PATH_MAX*2];
+    pid_t pid;
+    int   err;
+
+    if (!argv[0])
+    {
+	errno = EINVAL;
+	return false;
+    }
+
+    // Wait for a slot
+    while (running >= MAX_RUNNING)
+	if (!reap()) break;
+
+    if (num_jobs == max_jobs)
+	grow();
+
+    // Put the file name in place of the first %s. The rest of the
+    // argument is copied as it is, it's not a printf format.
+    if (slotpattern)
+    {
+	const char *pct = strstr(slotpattern, "%s");
+	size_t      prelen = pct - slotpattern;
+	size_t      namelen = strlen(file);
+	size_t      postlen = strlen(pct+2);
+
+	if (prelen + namelen + postlen + 1 > sizeof(arg))
+	{
+	    jobs[num_jobs].name   = strdup(file);
+	    jobs[num_jobs].pid    = 0;
+	    jobs[num_jobs].status = -1;
+	    jobs[num_jobs].error  = ENAMETOOLONG;
+	    num_jobs++;
+	    DAPLOG((LOG_ERR, "Can't run %s for %s: %s\n", argv[0], file,
+		    strerror(ENAMETOOLONG)));
+	    errno = ENAMETOOLONG;
+	    return false;
+	}
+	memcpy(arg, slotpattern, prelen);
+	memcpy(arg+prelen, file, namelen);
+	memcpy(arg+prelen+namelen, pct+2, postlen+1);
+	argv[fileslot] = arg;
+    }
+    else
+    {
+	argv[fileslot] = (char *)file;
+    }
+
+    // The job doesn't get our DECnet link or anything it sends
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, 0, "/dev/null", O_RDONLY, 0);
+    if (closefd > 2)
+	posix_spawn_file_actions_addclose(&fa, closefd);
+
+    // ...and gets the signal mask we had before blocking SIGCHLD
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &saved_sigmask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    err = posix_spawnp(&pid, argv[0], &fa, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+
+    jobs[num_jobs].name = strdup(file);
+    if (err)
+    {
+	jobs[num_jobs].pid    = 0;
+	jobs[num_jobs].status = -1;
+	jobs[num_jobs].error  = err;
+	num_jobs++;
+	DAPLOG((LOG_ERR, "Can't run %s for %s: %s\n", argv[0], file, strerror(err)));
+	errno = err;
+	return false;
+    }
+    jobs[num_jobs].pid    = pid;
+    jobs[num_jobs].status = 0;
+    jobs[num_jobs].error  = 0;
+    num_jobs++;
+    running++;
+
+    if (verbose > 1)
+	DAPLOG((LOG_DEBUG, "fal_spooler: started %s for '%s', pid %d\n",
+		argv[0], file, pid));
+    return true;
+}
+
+// Collect one finished job
+bool fal_spooler::reap()
+{
+    int   status;
+    pid_t pid;
+
+    if (!running) return false;
+
+    do
+    {
+	pid = waitpid(-1, &status, 0);
+    } while (pid == -1 && errno == EINTR);
+
+    if (pid <= 0) return false;
+
+    for (int i=0; i<num_jobs; i++)
+    {
+	if (jobs[i].pid == pid)
+	{
+	    jobs[i].pid = 0;
+	    jobs[i].status = status;
+	    if (!WIFEXITED(status) || WEXITSTATUS(status))
+	    {
+		jobs[i].error = EIO;
+		DAPLOG((LOG_ERR, "%s for %s failed, status = %d\n",
+			argv[0], jobs[i].name, status));
+	    }
+	    else if (verbose > 1)
+	    {
+		DAPLOG((LOG_DEBUG, "fal_spooler: '%s', result = %d\n",
+			jobs[i].name, status));
+	    }
+	    running--;
+	    break;
+	}
+    }
+    return true;
+}
+
+int fal_spooler::wait()
+{
+    int failed = 0;
+
+    while (running)
+	if (!reap()) break;
+
+    for (int i=0; i<num_jobs; i++)
+	if (jobs[i].error) failed++;
+
+    return failed;
+}
@@ -0,0 +1,51 @@
+#include <sys/types.h>
+#include <signal.h>
+
+
+// Runs the SUBMIT or PRINT command for a batch of files. The command
+// is split into an argument vector once and each file gets its own
+// process started with posix_spawnp(3), there is no shell involved.
+// Up to MAX_RUNNING of them are in flight at a time.
+class fal_spooler
+{
+  public:
+    fal_spooler(const char *command, int closefd, int v);
+    ~fal_spooler();
+
+    bool queue(const char *file);  // Start the command for a file
+    int  wait();                   // Wait for all of them, returns #failed
+
+    // Per-file results, in the order they were queued
+    int         get_count()        { return num_jobs; }
+    const char *get_name(int n)    { return jobs[n].name; }
+    int         get_status(int n)  { return jobs[n].status; }
+    int         get_errno(int n)   { return jobs[n].error; }
+
+  private:
+    static const int MAX_RUNNING = 8;
+    static const int MAX_ARGS = 32;
+
+    struct job
+    {
+	char  *name;
+	pid_t  pid;
+	int    status;   // Wait status, -1 if it could not be started
+	int    error;    // errno to return if it failed
+    };
+
+    bool reap();
+    void grow();
+
+    char  *cmdbuf;
+    char  *argv[MAX_ARGS+2];
+    int    fileslot;          // argv index that gets the file name
+    char  *slotpattern;       // The argument containing %s
+    int    closefd;
+    sigset_t saved_sigmask;
+    int    verbose;
+
+    struct job *jobs;
+    int    num_jobs;
+    int    max_jobs;
+    int    running;
+};
@@ -42,11 +42,7 @@
 #include "task.h"
 #include "server.h"
 #include "submit.h"
-
-#ifndef SUBMIT_COMMAND
-#define SUBMIT_COMMAND "at -f %s now "
-#endif
-
+#include "spool.h"
 
 fal_submit::fal_submit(dap_connection &c, int v, fal_params &p):
     fal_task(c,v,p)
@@ -123,23 +119,33 @@ bool fal_submit::process_message(dap_message *m)
 		}
 	    }
 
-	    // Submit all the files
-	    do
-	    {
-	        char cmd[PATH_MAX + strlen(SUBMIT_COMMAND)+1];
-
-		sprintf(cmd, SUBMIT_COMMAND, gl.gl_pathv[pathno]);
-		status = system(cmd);
+	    // Submit all the files in one go, then report on each of them
+	    fal_spooler spool(params.submit_command, conn.get_fd(), verbose);
+	    for (pathno = 0; pathno < (int)gl.gl_pathc; pathno++)
+		spool.queue(gl.gl_pathv[pathno]);
 
-		if (verbose > 1)
-		    DAPLOG((LOG_DEBUG, "in fal_submit: '%s', result = %d\n", gl.gl_pathv[pathno], status));
+	    int failed = spool.wait();
+	    if (verbose > 1)
+		DAPLOG((LOG_DEBUG, "in fal_submit: %d files, %d failed\n",
+			spool.get_count(), failed));
 
-		pathno++;
-	    } while (status == 0 && gl.gl_pathv[pathno]);
+	    int error = 0;
+	    for (pathno = 0; pathno < spool.get_count(); pathno++)
+	    {
+		if (spool.get_errno(pathno))
+		{
+		    if (!error) error = spool.get_errno(pathno);
+		}
+		else if (gl.gl_pathc > 1 &&
+			 (am->get_display() & dap_access_message::DISPLAY_NAME_MASK))
+		{
+		    send_name(gl.gl_pathv[pathno]);
+		}
+	    }
 
-	    if (status) // Send error code
+	    if (error) // Send error code
 	    {
-		return_error();
+		return_error(error);
 	    }
 	    else
 	    {
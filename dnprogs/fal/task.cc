@@ -41,6 +41,7 @@
 #include "connection.h"
 #include "protocol.h"
 #include "vaxcrc.h"
+#include "filespec.h"
 #include "params.h"
 #include "task.h"
 #include "server.h"
@@ -212,12 +213,11 @@ void fal_task::split_filespec(char *volume, char *directory, char *file)
 void fal_task::make_vms_filespec(const char *unixname, char *vmsname, bool full)
 {
     char        fullname[PATH_MAX];
-    int         i;
     char       *lastslash;
     struct stat st;
 
     // Resolve all relative bits and symbolic links
-    realpath(unixname, fullname);
+    dap_realpath(unixname, fullname, &st);
 
     // Remove the vroot, but leave a leading slash
     remove_vroot(fullname);
@@ -226,146 +226,50 @@ void fal_task::make_vms_filespec(const char *unixname, char *vmsname, bool full)
     lastslash = fullname + strlen(fullname);
     while (*(--lastslash) != '/') ;
 
-    // If the filename has no extension then add one. VMS seems to
-    // expect one as does dapfs.
-    if (!strchr(lastslash, '.'))
-        strcat(fullname, ".");
-
-    // If it's a directory then add .DIR;1
-    if (lstat(unixname, &st)==0 && S_ISDIR(st.st_mode))
-    {
-        // Take care of dots embedded in directory names (/etc/rc.d)
-        if (fullname[strlen(fullname)-1] != '.')
-	    strcat(fullname, ".");
-
-        strcat(fullname, "DIR;1"); // last dot has already been added
-    }
-    else // else just add a version number unless the file already has one
-    {
-	if (!strchr(fullname, ';'))
-	    strcat(fullname, ";1");
-    }
+    add_vms_suffix(lastslash, S_ISDIR(st.st_mode));
 
     // If we were only asked for the short name then return that bit now
     if (!full)
     {
-	i=strlen(fullname);
-	while (fullname[i--] != '/') ;
-	strcpy(vmsname, &fullname[i+2]);
+	strcpy(vmsname, strrchr(fullname, '/')+1);
 
 	// Make it all uppercase
-	dap_connection::makeupper(vmsname);
+	dap_vms_upcase(vmsname);
 	return;
     }
 
-    // Count the slashes. If there is one slash we emit a filename like:
-    // SYSDISK:[000000]filename
-    // For two we use:
-    // SYSDISK:[DIR]filename
-    // for three or more we use:
-    // DIR:[DIR1]filename
-    // and so on...
-
-    int slashes = 0;
-
-    // Oh, also make it all upper case for VMS's benefit.
-    for (i=0; i<(int)strlen(fullname); i++)
-    {
-	if (islower(fullname[i])) fullname[i] = toupper(fullname[i]);
-	if (fullname[i] == '/')
-	{
-	    slashes++;
-	}
-    }
+    dap_unix_to_vms(fullname, vmsname, PATH_MAX, sysdisk_name, DAP_VMS_SYSDISK);
+}
 
-    // File is in the root directory
-    if (slashes == 1)
-    {
-	sprintf(vmsname, "%s:[000000]%s", sysdisk_name, fullname+1);
-	return;
-    }
+// Add the extension and version VMS expects to the last part of a
+// Unix file name.
+void fal_task::add_vms_suffix(char *name, bool isdir)
+{
+    // If the filename has no extension then add one. VMS seems to
+    // expect one as does dapfs.
+    if (!strchr(name, '.'))
+        strcat(name, ".");
 
-    // File is in a directory immediately below the root directory
-    if (slashes == 2)
+    // If it's a directory then add .DIR;1
+    if (isdir)
     {
-	char *second_slash = strchr(fullname+1, '/');
-
-	*second_slash = '\0';
-
-	strcpy(vmsname, sysdisk_name);
-	strcat(vmsname, ":[");
-	strcat(vmsname, fullname+1);
-	strcat(vmsname, "]");
-	strcat(vmsname, second_slash+1);
+        // Take care of dots embedded in directory names (/etc/rc.d)
+        if (name[strlen(name)-1] != '.')
+	    strcat(name, ".");
 
-	return;
+        strcat(name, "DIR;1"); // last dot has already been added
     }
-
-    // Most user filenames end up here
-    char *slash2 = strchr(fullname+1, '/');
-
-    *slash2 = '\0';
-    strcpy(vmsname, fullname+1);
-    strcat(vmsname, ":[");
-
-    // Do the directory depth
-    lastslash = slash2;
-
-    for (i=1; i<slashes-1; i++)
+    else // else just add a version number unless the file already has one
     {
-	char *slash = strchr(lastslash+1, '/');
-	if (slash)
-	{
-	    *slash = '\0';
-	    strcat(vmsname, lastslash+1);
-	    strcat(vmsname, ".");
-	    lastslash = slash;
-	}
+	if (!strchr(name, ';'))
+	    strcat(name, ";1");
     }
-    vmsname[strlen(vmsname)-1] = ']';
-    strcat(vmsname, lastslash+1);
 }
 
 // Split out the volume, directory and file portions of a VMS file spec
-// We assume that the VMS name is (quite) well formed.
 void fal_task::parse_vms_filespec(char *volume, char *directory, char *file)
 {
-    char *colon = strchr(file, ':');
-    char *ptr = file;
-
-    volume[0] = '\0';
-    directory[0] = '\0';
-
-    if (colon) // We have a volume name
-    {
-	char saved = *(colon+1);
-	*(colon+1) = '\0';
-	strcpy(volume, file);
-	ptr = colon+1;
-	*ptr = saved;
-    }
-
-    char *enddir = strchr(ptr, ']');
-
-    // Don't get caught out by concatenated filespecs
-    // like dua0:[home.christine.][test]
-    if (enddir && enddir[1] == '[')
-	enddir=strchr(enddir+1, ']');
-
-    if (*ptr == '[' && enddir) // we have a directory
-    {
-	char saved = *(enddir+1);
-
-	*(enddir+1) = '\0';
-	strcpy(directory, ptr);
-	ptr = enddir+1;
-	*ptr = saved;
-    }
-
-    // Copy the rest of the filename using memmove 'cos it might overlap
-    if (ptr != file)
-	memmove(file, ptr, strlen(ptr)+1);
-
+    dap_parse_vms_filespec(volume, directory, file);
 }
 
 // Convert a VMS filespec into a Unix filespec
@@ -373,140 +277,17 @@ void fal_task::parse_vms_filespec(char *volume, char *directory, char *file)
 // (unless they are SYSDISK which is our pseudo name)
 void fal_task::make_unix_filespec(char *unixname, char *vmsname)
 {
-    char volume[PATH_MAX];
-    char dir[PATH_MAX];
-    char file[PATH_MAX];
-    int  ptr;
-    int  i;
-
-    strcpy(file, vmsname);
-
-    // Remove the trailing version number
-    char *semi = strchr(file, ';');
-    if (semi) *semi = '\0';
-
-    // If the filename has a trailing dot them remove that too
-    if (file[strlen(file)-1] == '.')
-        file[strlen(file)-1] = '\0';
-
-    unixname[0] = '\0';
-
-    // Split it into its component parts
-    parse_vms_filespec(volume, dir, file);
-
-    // Remove the trailing colon from the volume name
-    if (volume[strlen(volume)-1] == ':')
-	volume[strlen(volume)-1] = '\0';
-
-    // If the filename has the dummy SYSDISK volume then start from the
-    // filesystem root
-    if (strcasecmp(volume, sysdisk_name) == 0)
-    {
-	strcpy(unixname, "/");
-    }
-    else
-    {
-	if (volume[0] != '\0')
-	{
-	    strcpy(unixname, "/");
-	    strcat(unixname, volume);
-	}
-    }
-    ptr = strlen(unixname);
-
-    // Copy the directory
-    for (i=0; i< (int)strlen(dir); i++)
-    {
-	// Remove '[]' as it's a no-op
-	if (dir[i] == '[' &&
-	    dir[i+1] == ']')
-	{
-	    i++;
-	    ptr = 0;
-	    continue;
-	}
-
-	// If the directory name starts [. then it is relative to the
-	// user's home directory and we lose the starting slash
-	// If there is also a volume name present then it all falls
-	// to bits but then it's pretty dodgy on VMS too.
-	if (dir[i] == '[' &&
-	    dir[i+1] == '.')
-	{
-	    i++;
-	    ptr = 0;
-	    continue;
-	}
-
-	if (dir[i] == '[' ||
-	    dir[i] == ']' ||
-	    dir[i] == '.')
-	{
-	    unixname[ptr++] = '/';
-	}
-	else
-	{
-	    // Skip root directory specs
-	    if (dir[i] == '0' && (strncmp(&dir[i], "000000", 6) == 0))
-	    {
-		i += 5;
-		continue;
-	    }
-	    if (dir[i] == '0' && (strncmp(&dir[i], "0,0", 3) == 0))
-	    {
-		i += 2;
-		continue;
-	    }
-	    unixname[ptr++] = dir[i];
-	}
-    }
-    unixname[ptr++] = '\0'; // so that strcat will work properly
-
-    // A special case (ugh!), if VMS sent us '*.*' (maybe as part of *.*;*)
-    // then change it to just '*' so we get all the files.
-    if (strcmp(file, "*.*") == 0) strcpy(file, "*");
-
-    strcat(unixname, file);
-
-    // Finally convert it all to lower case. This is not the greatest way to
-    // cope with it but because VMS will upper-case everything anyway we
-    // can't really distinguish case. I know samba does fancy stuff with
-    // matching various combinations of case but I really can't be bothered.
-    dap_connection::makelower(unixname);
-
-    // If the name ends in .dir and there is a directory of that name without
-    // the .dir then remove it (the .dir, not the directory!)
-    if (strstr(unixname, ".dir") == unixname+strlen(unixname)-4)
-    {
-	char dirname[strlen(unixname)+1];
-	struct stat st;
-
-	strcpy(dirname, unixname);
-	char *ext = strstr(dirname, ".dir");
-	if (ext) *ext = '\0';
-	if (stat(dirname, &st) == 0 &&
-	    S_ISDIR(st.st_mode))
-	{
-	    char *ext = strstr(unixname, ".dir");
-	    if (ext) *ext = '\0';
-	}
-    }
+    dap_vms_to_unix(vmsname, unixname, PATH_MAX - params.vroot_len, sysdisk_name);
     add_vroot(unixname);
 }
 
 // Convert VMS wildcards to Unix wildcards
 // In fact all this does is substitute ? for % in the string.
-// elipses are NOT catered for because there is no Unix equivalent.
 // This is NOT done in the normal VMS->Unix conversion for all sorts of
 // complicated reasons.
 void fal_task::convert_vms_wildcards(char *filespec)
 {
-    unsigned int i = strlen(filespec);
-
-    while (i--)
-    {
-	if (filespec[i] == '%') filespec[i] = '?';
-    }
+    dap_vms_wildcards(filespec);
 }
 
 //
@@ -624,6 +405,28 @@ bool fal_task::send_file_attributes(unsigned int &block_size,
     return true;
 }
 
+// Send the name of a file we have worked on
+bool fal_task::send_name(char *name)
+{
+    dap_name_message name_msg;
+
+    if (vms_format)
+    {
+	char vmsname[PATH_MAX];
+	
+	make_vms_filespec(name, vmsname, true);
+	
+	name_msg.set_namespec(vmsname);
+	name_msg.set_nametype(dap_name_message::FILESPEC);
+    }
+    else
+    {
+	name_msg.set_namespec(name);
+	name_msg.set_nametype(dap_name_message::FILENAME);
+    }
+    return name_msg.write(conn);
+}
+
 // Send an ACK and the whole block.
 bool fal_task::send_ack_and_unblock()
 {
@@ -50,6 +50,7 @@ class fal_task
     void return_error(int);
     void split_filespec(char *, char *, char *);
     void make_vms_filespec(const char *, char *, bool);
+    void add_vms_suffix(char *, bool);
     void parse_vms_filespec(char *, char *, char *);
     void make_unix_filespec(char *, char *);
     void convert_vms_wildcards(char *);
@@ -57,6 +58,7 @@ class fal_task
     void remove_vroot(char *);
     bool is_vms_name(char *);
     bool send_ack_and_unblock();
+    bool send_name(char *);
 
     void open_auto_types_file();
     int  unlink(char *);
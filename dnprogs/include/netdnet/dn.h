@@ -50,7 +50,9 @@
 #define DSO_CORK        13       /* Wait for more data!                 */
 #define DSO_SERVICES	14       /* NSP Services field                  */
 #define DSO_INFO	15       /* NSP Info field                      */
-#define DSO_MAX         15       /* Maximum option number               */
+#define DSO_LISTENINFO  16       /* Get listen queue statistics         */
+#define DSO_DAPFRAME    17       /* DAP DATA framing for sendfile       */
+#define DSO_MAX         17       /* Maximum option number               */
 
 
 /* LINK States */
@@ -117,6 +119,44 @@ struct linkinfo_dn {
         unsigned char   idn_linkstate;  /* Logical link state    */
 };
 
+/*
+ * DECnet listening socket statistics (DSO_LISTENINFO)
+ */
+struct listeninfo_dn {
+        unsigned int    ldn_backlog;    /* Maximum queued connects     */
+        unsigned int    ldn_qlen;       /* Connects waiting for accept */
+        unsigned int    ldn_queued;     /* Total connects queued       */
+        unsigned int    ldn_overflows;  /* Connects dropped, queue full */
+        unsigned int    ldn_filtered;   /* Connects rejected by filter */
+};
+
+/*
+ * What a socket filter (SO_ATTACH_FILTER) on a listening socket sees of
+ * each incoming connect. Returning 0 rejects it.
+ */
+struct cifilter_dn {
+        unsigned char   cfn_srcnode[2];         /* Remote node, high byte first */
+        unsigned char   cfn_dstobjnum;
+        unsigned char   cfn_dstobjnamel;
+        unsigned char   cfn_dstobjname[16];
+        unsigned char   cfn_srcobjnum;
+        unsigned char   cfn_srcobjnamel;
+        unsigned char   cfn_srcobjname[16];
+        unsigned char   cfn_userl;              /* Access control user name */
+        unsigned char   cfn_user[39];
+};
+
+/*
+ * DAP DATA framing of data sent with sendfile() or splice() (DSO_DAPFRAME)
+ */
+struct dapframe_dn {
+        unsigned short  dfn_chunk;      /* Data bytes per DATA msg, 0=off */
+        unsigned short  dfn_bufsize;    /* Largest DAP record to send     */
+        unsigned int    dfn_flags;
+        unsigned int    dfn_recnum;     /* Next record number             */
+};
+#define DN_DAPFRAME_RECNUM 0x0001       /* Send a four byte RECNUM field  */
+
 /*
  * Ethernet address format (for DECnet)
  */
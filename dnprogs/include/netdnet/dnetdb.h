@@ -39,17 +39,20 @@ extern  char             *getexecdev(void);
 extern  void              setnodeent(int);
 extern  void             *dnet_getnode(void);
 extern  char             *dnet_nextnode(void *);
+extern  struct  nodeent  *dnet_nextnodeent(void *);
 extern  void              dnet_endnode(void *);
 extern  int               dnet_recv(int s, void *buf, int len, unsigned int flags);
 extern  int               dnet_pton(int af, const char *src, void *addr);
 extern  const char       *dnet_ntop(int af, const void *addr, char *str, size_t len);
 
 /* DECnet daemon functions in libdnet_daemon */
+#define DNETD_STATUS_SOCKET "/var/run/dnetd.status"
 extern int   dnet_daemon(int object, char *named_object, 
 			 int verbosity, int do_fork);
 extern void  dnet_accept(int sockfd, short status, char *data, int len);
 extern void  dnet_reject(int sockfd, short status, char *data, int len);
 extern void  dnet_set_optdata(char *data, int len);
+extern void  dnet_set_backlog(int backlog);
 extern char *dnet_daemon_name(void);
 extern int   getnodename(char *, size_t);
 extern int   setnodename(char *, size_t);
@@ -60,6 +63,7 @@ extern void  dnetlog(int level, char *fmt, ...);
 
 int dnet_priv_check(const char * file, const char * proc,
                     const struct sockaddr_dn * local, const struct sockaddr_dn * remote);
+int dnet_priv_filter(int sockfd, const char * allowfile, const char * denyfile);
 
 /* Used by dnet_ntop/dnet_pton */
 #define DNET_ADDRSTRLEN  8
@@ -29,7 +29,10 @@
 #include <string.h>
 #include <syslog.h>
 #include <limits.h>
+#include <stddef.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/select.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
@@ -49,6 +52,8 @@
 #define FALSE 0
 #endif
 #define MAX_FORKS 10
+#define DEFAULT_BACKLOG 5
+#define FILTER_RECHECK  10  // Seconds between looks at nodes.allow/deny
 typedef int bool;
 
 #define NODE_LENGTH 20
@@ -80,10 +85,35 @@ struct object
     char  user[USERNAME_LENGTH]; // User to use if proxies not used
     char  daemon[PATH_MAX];      // Name of daemon
     int   auto_accept;           // Auto Accept incoming connections
+    int   max_active;            // Links allowed at once, 0 = no limit
+    int   max_queued;            // Links held back when max_active is reached
+
+    // Statistics, shown on the status socket
+    unsigned int accepted;       // Links started
+    unsigned int rejected;       // Links turned away because we were full
+    int   active;                // Links running now
+    int   queued;                // Links waiting to be started
+    struct pending *queue_head;
+    struct pending *queue_tail;
 
     struct object *next;
 };
 
+// Incoming link waiting for its object to have room
+struct pending
+{
+    int sockfd;
+    struct pending *next;
+};
+
+// Running child process and the object it is serving
+struct child
+{
+    pid_t pid;
+    struct object *obj;
+    struct child *next;
+};
+
 static struct proxy  *proxy_db  = NULL;
 static struct object *object_db = NULL;
 static struct object *thisobj   = NULL;
@@ -95,8 +125,39 @@ static char errstring[1024];
 static struct optdata_dn optdata;
 static bool have_optdata = FALSE;
 static char *lasterror="";
+static int listen_backlog = DEFAULT_BACKLOG;
+static unsigned int listen_overflows = 0;
+static unsigned int listen_filtered = 0;
+static int filter_kernel = 0;  // Kernel runs our filter: 1 yes, -1 no, 0 don't know
+static struct stat allow_stat, deny_stat;
+static struct child *children = NULL;
+static int status_socket = -1;
+static sigset_t wait_sigmask;  // Signal mask while waiting for connections
+static sigset_t saved_sigmask; // Signal mask to give to children
+
+// Forget about a child process, its object has room for another link.
+static void child_exited(pid_t pid)
+{
+    struct child **cp = &children;
+
+    while (*cp)
+    {
+	struct child *c = *cp;
+
+	if (c->pid == pid)
+	{
+	    c->obj->active--;
+	    *cp = c->next;
+	    free(c);
+	    return;
+	}
+	cp = &c->next;
+    }
+}
 
-// Catch child process shutdown
+// Catch child process shutdown. SIGCHLD is only unblocked while
+// we are waiting in pselect() so it is safe to update the object
+// counts from here.
 static void sigchild(int s)
 {
     int status, pid;
@@ -105,7 +166,11 @@ static void sigchild(int s)
     do
     {
 	pid = waitpid(-1, &status, WNOHANG);
-	if (pid > 0 && verbose) DNETLOG((LOG_INFO, "Reaped child process %d\n", pid));
+	if (pid > 0)
+	{
+	    child_exited(pid);
+	    if (verbose) DNETLOG((LOG_INFO, "Reaped child process %d\n", pid));
+	}
     }
     while (pid > 0);
 }
@@ -312,6 +377,227 @@ static bool check_proxy_database(char *nodename,
     return found;
 }
 
+// Open the Unix socket that the object statistics are written to
+static void open_status_socket(void)
+{
+    struct sockaddr_un sockaddr;
+    mode_t oldmode;
+
+    unlink(DNETD_STATUS_SOCKET);
+    status_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (status_socket < 0)
+    {
+	DNETLOG((LOG_ERR, "Can't open status socket: %m\n"));
+	return;
+    }
+    fcntl(status_socket, F_SETFL, fcntl(status_socket, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(status_socket, F_SETFD, FD_CLOEXEC);
+
+    memset(&sockaddr, 0, sizeof(sockaddr));
+    sockaddr.sun_family = AF_UNIX;
+    strcpy(sockaddr.sun_path, DNETD_STATUS_SOCKET);
+
+    oldmode = umask(0117);
+    if (bind(status_socket, (struct sockaddr *)&sockaddr, sizeof(sockaddr)) ||
+	listen(status_socket, 5))
+    {
+	DNETLOG((LOG_ERR, "Can't bind status socket: %m\n"));
+	close(status_socket);
+	status_socket = -1;
+    }
+    umask(oldmode);
+}
+
+// Write the per-object link counts to whoever connected to the
+// status socket
+static void show_status(void)
+{
+    struct object *obj;
+    FILE *fp;
+    int fd;
+
+    fd = accept(status_socket, NULL, NULL);
+    if (fd < 0)
+	return;
+
+    fp = fdopen(fd, "w");
+    if (!fp)
+    {
+	close(fd);
+	return;
+    }
+
+    fprintf(fp, "Object           Number  Limit  Queue  Active  Queued  Accepted  Rejected\n");
+    for (obj = object_db; obj; obj = obj->next)
+    {
+	char limit[12] = "-";
+	char queue[12] = "-";
+
+	if (obj->max_active)
+	{
+	    snprintf(limit, sizeof(limit), "%d", obj->max_active);
+	    snprintf(queue, sizeof(queue), "%d", obj->max_queued);
+	}
+	fprintf(fp, "%-16s %6u %6s %6s %7d %7d %9u %9u\n",
+		obj->name, obj->number, limit, queue,
+		obj->active, obj->queued, obj->accepted, obj->rejected);
+    }
+    fclose(fp);
+}
+
+// Look up the dnetd.conf entry for an incoming connection
+static struct object *find_object(int sockfd)
+{
+    struct sockaddr_dn sockaddr;
+    unsigned int namlen = sizeof(sockaddr);
+    struct object *obj;
+
+    memset(&sockaddr, 0, sizeof(sockaddr));
+    getsockname(sockfd, (struct sockaddr *)&sockaddr, &namlen);
+
+    for (obj = object_db; obj; obj = obj->next)
+    {
+	if ((sockaddr.sdn_objnamel && !obj->number &&
+	     (!strcmp((char *)sockaddr.sdn_objname, obj->name) ||
+	      !strcmp(obj->name, "*"))) ||
+	    (sockaddr.sdn_objnum == obj->number && obj->number))
+	    return obj;
+    }
+    return NULL;
+}
+
+// Admission control. Returns TRUE if the link can be started now,
+// otherwise it has been queued until one of the object's running
+// links finishes, or rejected because the queue is full too.
+static bool admit(struct object *obj, int sockfd)
+{
+    struct pending *p;
+
+    if (!obj || !obj->max_active || obj->active < obj->max_active)
+	return TRUE;
+
+    if (obj->queued < obj->max_queued &&
+	(p = malloc(sizeof(struct pending))))
+    {
+	p->sockfd = sockfd;
+	p->next = NULL;
+	if (obj->queue_tail)
+	    obj->queue_tail->next = p;
+	else
+	    obj->queue_head = p;
+	obj->queue_tail = p;
+	obj->queued++;
+	if (verbose > 1) DNETLOG((LOG_INFO, "Object %s busy, connection queued\n", obj->name));
+	return FALSE;
+    }
+
+    obj->rejected++;
+    if (verbose) DNETLOG((LOG_INFO, "Object %s busy, connection rejected\n", obj->name));
+    dnet_reject(sockfd, DNSTAT_OBJRESOURCES, NULL, 0);
+    return FALSE;
+}
+
+// Find a queued link whose object now has room for it.
+// Returns the fd or -1.
+static int next_queued(struct object **objp)
+{
+    struct object *obj;
+
+    for (obj = object_db; obj; obj = obj->next)
+    {
+	if (obj->queue_head && obj->active < obj->max_active)
+	{
+	    struct pending *p = obj->queue_head;
+	    int sockfd = p->sockfd;
+
+	    obj->queue_head = p->next;
+	    if (!obj->queue_head)
+		obj->queue_tail = NULL;
+	    obj->queued--;
+	    free(p);
+
+	    *objp = obj;
+	    return sockfd;
+	}
+    }
+    return -1;
+}
+
+// In a new child: the links still waiting for room belong to our
+// parent, don't keep them open or they won't go away when it closes
+// them.
+static void close_queued_links(void)
+{
+    struct object *obj;
+    struct pending *p;
+
+    for (obj = object_db; obj; obj = obj->next)
+	for (p = obj->queue_head; p; p = p->next)
+	    close(p->sockfd);
+}
+
+// Has the file changed since we last looked?
+static bool file_changed(const char *name, struct stat *last)
+{
+    struct stat st;
+
+    if (stat(name, &st))
+	memset(&st, 0, sizeof(st));
+
+    if (st.st_dev == last->st_dev && st.st_ino == last->st_ino &&
+	st.st_size == last->st_size && st.st_mtime == last->st_mtime)
+	return FALSE;
+
+    *last = st;
+    return TRUE;
+}
+
+// If the kernel can check incoming connects against a filter on the
+// listening socket then give it nodes.allow and nodes.deny, and keep
+// it up to date. node_allowed() still checks every connect we get so
+// this only saves us the connects that would be rejected anyway.
+static void update_filter(int sockfd)
+{
+    bool changed;
+
+    if (filter_kernel < 0)
+	return;
+
+#ifdef DSO_LISTENINFO
+    // Kernels that know about connect filters say how many they rejected
+    if (filter_kernel == 0)
+    {
+	struct listeninfo_dn li;
+	socklen_t lilen = sizeof(li);
+
+	filter_kernel = -1;
+	if (getsockopt(sockfd, DNPROTO_NSP, DSO_LISTENINFO, &li, &lilen) == 0 &&
+	    lilen >= offsetof(struct listeninfo_dn, ldn_filtered) + sizeof(li.ldn_filtered))
+	    filter_kernel = 1;
+    }
+#else
+    filter_kernel = -1;
+#endif
+    if (filter_kernel < 0)
+	return;
+
+    changed  = file_changed(ALLOW_FILE, &allow_stat);
+    changed |= file_changed(DENY_FILE, &deny_stat);
+    if (!changed)
+	return;
+
+    if (dnet_priv_filter(sockfd, ALLOW_FILE, DENY_FILE) == 0)
+    {
+	if (verbose > 1) DNETLOG((LOG_DEBUG, "Loaded connect filter\n"));
+    }
+    else
+    {
+	// Don't leave old rules turning away nodes that are now allowed
+	DNETLOG((LOG_WARNING, "Can't load connect filter: %m\n"));
+	setsockopt(sockfd, SOL_SOCKET, SO_DETACH_FILTER, NULL, 0);
+    }
+}
+
 //
 // Wait for an incoming connection
 // Returns a new fd or -1
@@ -321,6 +607,8 @@ static int waitfor(int sockfd)
     int                  newsock;
     unsigned int         len;
     struct sockaddr_dn	 sockaddr;
+    fd_set               fds;
+    struct timespec      recheck = {FILTER_RECHECK, 0};
     static bool listening = FALSE;
 
     memset(&sockaddr, 0, sizeof(sockaddr));
@@ -328,7 +616,7 @@ static int waitfor(int sockfd)
     // Set up the listing context
     if (!listening)
     {
-	status = listen(sockfd, 5);
+	status = listen(sockfd, listen_backlog);
 	if (status)
 	{
 	    snprintf(errstring, sizeof(errstring),
@@ -338,8 +626,28 @@ static int waitfor(int sockfd)
 	}
 	listening = TRUE;
     }
+    update_filter(sockfd);
+
+    // Wait for a connection or a status request. Child exits and
+    // SIGTERM are only delivered while we wait here. With a connect
+    // filter in the kernel we wake up now and again to see if the
+    // rules have changed, as we might not be given any connects.
+    FD_ZERO(&fds);
+    FD_SET(sockfd, &fds);
+    if (status_socket != -1)
+	FD_SET(status_socket, &fds);
+
+    status = pselect(FD_SETSIZE, &fds, NULL, NULL,
+		     filter_kernel > 0 ? &recheck : NULL, &wait_sigmask);
+    if (status <= 0)
+	return -1;
+
+    if (status_socket != -1 && FD_ISSET(status_socket, &fds))
+	show_status();
+
+    if (!FD_ISSET(sockfd, &fds))
+	return -1;
 
-    // Wait for a connection
     memset(&sockaddr, 0, sizeof(sockaddr));
     len = sizeof(sockaddr);
     newsock = accept(sockfd, (struct sockaddr *)&sockaddr, &len);
@@ -354,6 +662,30 @@ static int waitfor(int sockfd)
     // We were interrupted, return a bad fd
     if (newsock < 0 && errno == EINTR) return -1;
 
+#ifdef DSO_LISTENINFO
+    // Let the admin know if the kernel has been dropping connects
+    // because we couldn't keep up.
+    {
+	struct listeninfo_dn li;
+	socklen_t lilen = sizeof(li);
+
+	if (getsockopt(sockfd, DNPROTO_NSP, DSO_LISTENINFO, &li, &lilen) == 0 &&
+	    li.ldn_overflows != listen_overflows)
+	{
+	    DNETLOG((LOG_WARNING, "%u incoming connects dropped, listen queue full (backlog %u)\n",
+		     li.ldn_overflows - listen_overflows, li.ldn_backlog));
+	    listen_overflows = li.ldn_overflows;
+	}
+	if (filter_kernel > 0 && li.ldn_filtered != listen_filtered)
+	{
+	    if (verbose)
+		DNETLOG((LOG_INFO, "%u incoming connects rejected by the kernel\n",
+			 li.ldn_filtered - listen_filtered));
+	    listen_filtered = li.ldn_filtered;
+	}
+    }
+#endif
+
     // Return the new fd
     return newsock;
 }
@@ -398,29 +730,6 @@ static int fork_and_setuid(int sockfd)
 		 sockaddr.sdn_add.a_addr[0]));
     }
 
-    // Only do this if we are dnetd
-    if (object_db)
-    {
-	struct  sockaddr_dn  sockaddr;
-	struct object *obj = object_db;
-
-    	memset(&sockaddr, 0, sizeof(sockaddr));
-	getsockname(sockfd, (struct sockaddr *)&sockaddr, &namlen);
-
-	while (obj)
-	{
-	    if ((sockaddr.sdn_objnamel && !obj->number &&
-		 (!strcmp((char *)sockaddr.sdn_objname, obj->name) ||
-		  !strcmp(obj->name, "*"))) ||
-		(sockaddr.sdn_objnum == obj->number && obj->number))
-		 {
-		     thisobj = obj;
-		     break;
-		 }
-	    obj = obj->next;
-	}
-    }
-
 // Get the remote user spec.
     if (getsockopt(sockfd, DNPROTO_NSP, SO_CONACCESS, &accessdata,
 		   &len) < 0)
@@ -599,6 +908,10 @@ static int fork_and_setuid(int sockfd)
 
     case 0: // Child
 #ifndef NO_FORK
+	sigprocmask(SIG_SETMASK, &saved_sigmask, NULL);
+	if (status_socket != -1)
+	    close(status_socket);
+	close_queued_links();
         if (initgroups(username, newgid) < 0)
 	{
 	    error_return("init groups failed");
@@ -650,6 +963,7 @@ static void load_dnetd_conf(void)
 	char tmpbuf[1024];
 	char *bufp;
 	char *comment;
+	char *opt;
 	struct object *newobj;
 	int    state = 1;
 
@@ -673,6 +987,7 @@ static void load_dnetd_conf(void)
 
 	// Split into fields
 	newobj = malloc(sizeof(struct object));
+	memset(newobj, 0, sizeof(struct object));
 	state = 1;
 	bufp = strtok(bufp, " \t");
 	while(bufp)
@@ -714,6 +1029,21 @@ static void load_dnetd_conf(void)
 			    break;
 		    }
 		}
+
+		// Connection limits: ,limit=n[,queue=n]
+		opt = strchr(bufp, ',');
+		if (opt) opt = strchr(opt+1, ',');
+		while (opt)
+		{
+		    opt++;
+		    if (!strncasecmp(opt, "limit=", 6))
+			newobj->max_active = atoi(opt+6);
+		    else if (!strncasecmp(opt, "queue=", 6))
+			newobj->max_queued = atoi(opt+6);
+		    else
+			DNETLOG((LOG_ERR, "Unknown option in dnetd.conf line %d: %s\n", line, opt));
+		    opt = strchr(opt, ',');
+		}
 		break;
 	    case 4:
 		strcpy(newobj->user, bufp);
@@ -828,6 +1158,49 @@ bool bind_wild(int sockfd)
 }
 
 
+// Check /etc/nodes.{allow,deny} to see if the connection is allowed.
+// Rejects the connection and returns FALSE if it isn't.
+static bool node_allowed(int newone)
+{
+    struct sockaddr_dn  sa, remotesa;
+    unsigned int        namelen;
+    const char        * proc = NULL;
+
+    memset(&sa, 0, sizeof(sa));
+    namelen = sizeof(sa);
+
+    if (getsockname(newone, (struct sockaddr *)&sa, &namelen) == -1) {
+	dnet_reject(newone, DNSTAT_FAILED, NULL, 0);
+	DNETLOG((LOG_ALERT, "Can not read local sockname\n"));
+    }
+
+    namelen = sizeof(remotesa);
+
+    if ( getpeername(newone, (struct sockaddr *) &remotesa, &namelen) == -1 ) {
+	dnet_reject(newone, DNSTAT_FAILED, NULL, 0);
+	DNETLOG((LOG_ALERT, "Can not read peers sockname\n"));
+	return FALSE;
+    }
+
+    // first we check if we do not have a allow match, if we have we can continue.
+    // if we don't have one we need to check the deny list.
+    if ( dnet_priv_check(ALLOW_FILE, proc, &sa, &remotesa) != 1 ) {
+	// check deny list.
+	// if we have a nodes.deny file we continue, if we don't we ignore it.
+	// we check for file existance not readability here to avoid
+	// errors by wrong file permittions and such.
+	if ( access(DENY_FILE, F_OK) == 0 ) {
+	    // check the file itself. We do not reject in case of no match (0).
+	    // in case of match (1) or error (-1) we reject.
+	    if ( dnet_priv_check(DENY_FILE, proc, &sa, &remotesa) != 0 ) {
+		dnet_reject(newone, DNSTAT_ACCCONTROL, NULL, 0);
+		return FALSE;
+	    }
+	}
+    }
+    return TRUE;
+}
+
 // Called by DECnet daemons. If stdin is already a DECnet socket then
 // just return 0 (stdin's file descriptor). otherwise we
 // bind to the object and wait. When we get a connection we fork
@@ -839,7 +1212,7 @@ bool bind_wild(int sockfd)
 int dnet_daemon(int object, char *named_object,
 		int verbosity, bool do_fork)
 {
-    struct sockaddr_dn  sa, remotesa;
+    struct sockaddr_dn  sa;
     unsigned int        namelen = sizeof(struct sockaddr_dn);
     bool                bind_status  = FALSE;
     pid_t               pid;
@@ -848,7 +1221,6 @@ int dnet_daemon(int object, char *named_object,
     int                 i;
     struct              sigaction siga;
     sigset_t            ss;
-    const char        * proc = NULL;
 
     memset(&sa, 0, sizeof(sa));
 
@@ -913,6 +1285,14 @@ int dnet_daemon(int object, char *named_object,
     siga.sa_handler=sigterm;
     sigaction(SIGTERM, &siga, NULL);
 
+    // Only take SIGCHLD and SIGTERM while waiting for connections
+    sigemptyset(&ss);
+    sigaddset(&ss, SIGCHLD);
+    sigaddset(&ss, SIGTERM);
+    sigprocmask(SIG_BLOCK, &ss, &saved_sigmask);
+    wait_sigmask = saved_sigmask;
+    sigdelset(&wait_sigmask, SIGCHLD);
+    sigdelset(&wait_sigmask, SIGTERM);
 
     verbose = verbosity;
 
@@ -953,6 +1333,14 @@ int dnet_daemon(int object, char *named_object,
 	return -1; // Can't bind
     }
 
+    // We are dnetd, read the object database now so the status
+    // socket can show it.
+    if (!object && !named_object)
+    {
+	load_dnetd_conf();
+	open_status_socket();
+    }
+
     if (verbose) DNETLOG((LOG_INFO, "Ready\n"));
 
     // Main loop.
@@ -961,84 +1349,76 @@ int dnet_daemon(int object, char *named_object,
 	int fork_fail = 0;
 	int newone;
 	int ret;
+	struct object *obj;
 
-	// Wait for a new connection.
-	newone = waitfor(sockfd);
-	if (newone > -1)
+	// Start any queued links whose objects now have room,
+	// otherwise wait for a new connection.
+	newone = next_queued(&obj);
+	if (newone < 0)
 	{
-	    // check /etc/nodes.{allow,deny} if connection is allowed
-	    namelen = sizeof(remotesa);
-
-	    if (getsockname(newone, (struct sockaddr *)&sa, &namelen) == -1) {
-		dnet_reject(newone, DNSTAT_FAILED, NULL, 0);
-		DNETLOG((LOG_ALERT, "Can not read local sockname\n"));
-	    }
-
-	    namelen = sizeof(remotesa);
-
-	    if ( getpeername(newone, (struct sockaddr *) &remotesa, &namelen) == -1 ) {
-		dnet_reject(newone, DNSTAT_FAILED, NULL, 0);
-		DNETLOG((LOG_ALERT, "Can not read peers sockname\n"));
+	    newone = waitfor(sockfd);
+	    if (newone < 0 || !node_allowed(newone))
 		continue;
-	    }
-
-	    // first we check if we do not have a allow match, if we have we can continue.
-	    // if we don't have one we need to check the deny list.
-	    if ( dnet_priv_check(ALLOW_FILE, proc, &sa, &remotesa) != 1 ) {
-		// check deny list.
-		// if we have a nodes.deny file we continue, if we don't we ignore it.
-		// we check for file existance not readability here to avoid
-		// errors by wrong file permittions and such.
-		if ( access(DENY_FILE, F_OK) == 0 ) {
-		    // check the file itself. We do not reject in case of no match (0).
-		    // in case of match (1) or error (-1) we reject.
-		    if ( dnet_priv_check(DENY_FILE, proc, &sa, &remotesa) != 0 ) {
-			dnet_reject(newone, DNSTAT_ACCCONTROL, NULL, 0);
-			continue;
-		    }
-		}
-	    }
 
 	    // load dnetd's object databse if we don't have it already loaded.
 	    if (!object_db) load_dnetd_conf();
 
-	    ret = fork_and_setuid(newone);
+	    obj = find_object(newone);
+	    if (!admit(obj, newone))
+		continue;
+	}
+
+	thisobj = obj;
+	ret = fork_and_setuid(newone);
 
-	    switch (ret)
+	switch (ret)
+	{
+	case -1:
+	    if (++fork_fail > MAX_FORKS)
 	    {
-	    case -1:
-		if (++fork_fail > MAX_FORKS)
-		{
-		    DNETLOG((LOG_ALERT, "fork failed too often. giving up\n"));
-		    exit(100);
-		}
+		DNETLOG((LOG_ALERT, "fork failed too often. giving up\n"));
+		exit(100);
+	    }
 
-		// Oh no, it all went horribly wrong.
-		DNETLOG((LOG_ERR, "Fork_and_setuid failed: %s\n", lasterror));
-		close(newone);
-		continue;
+	    // Oh no, it all went horribly wrong.
+	    DNETLOG((LOG_ERR, "Fork_and_setuid failed: %s\n", lasterror));
+	    close(newone);
+	    continue;
 
-	    case 0: // child
-		if (object_db && thisobj != NULL) {
-		    // check if we are going to do auto accept or reject.
-		    switch (thisobj->auto_accept) {
-			case  1:
-			    dnet_accept(newone, 0, NULL, 0);
-			    break;
-			case -1:
-			    dnet_reject(newone, DNSTAT_REJECTED, NULL, 0);
-			    exit(101);
-			    break;
-		    }
+	case 0: // child
+	    if (object_db && thisobj != NULL) {
+		// check if we are going to do auto accept or reject.
+		switch (thisobj->auto_accept) {
+		    case  1:
+			dnet_accept(newone, 0, NULL, 0);
+			break;
+		    case -1:
+			dnet_reject(newone, DNSTAT_REJECTED, NULL, 0);
+			exit(101);
+			break;
 		}
-		return newone;
-		break;
+	    }
+	    return newone;
+	    break;
 
-	    default: // parent, just tidy up and loop back
-		fork_fail = 0;
-		close(newone);
-		break;
+	default: // parent, just tidy up and loop back
+	    fork_fail = 0;
+	    if (obj)
+	    {
+		struct child *c = malloc(sizeof(struct child));
+
+		obj->accepted++;
+		if (c)
+		{
+		    c->pid = ret;
+		    c->obj = obj;
+		    c->next = children;
+		    children = c;
+		    obj->active++;
+		}
 	    }
+	    close(newone);
+	    break;
 	}
     }
     while (!do_shutdown);
@@ -1089,6 +1469,14 @@ char *dnet_daemon_name(void)
 	return NULL;
 }
 
+// Number of incoming connects the kernel will queue for us
+// while we are busy. Must be called before dnet_daemon().
+void dnet_set_backlog(int backlog)
+{
+    if (backlog > 0)
+	listen_backlog = backlog;
+}
+
 // For daemons not run by dnetd and using Eduardo's kernel
 void dnet_set_optdata(char *data, int len)
 {
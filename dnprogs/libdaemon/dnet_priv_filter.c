@@ -0,0 +1,279 @@
+/******************************************************************************
+    dnet_priv_filter.c from libdnet_daemon
+
+    Copyright (C) 1999 Christine Caulfield       christine.caulfield@googlemail.com
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// Compile nodes.allow and nodes.deny into a socket filter for a
+// listening socket, so the kernel can turn away connects from nodes
+// that dnet_priv_check() would reject without waking us up. The rules
+// are read exactly as dnet_priv_check() reads them, node and object
+// names are looked up when the filter is built.
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+
+#include <netdnet/dn.h>
+#include <netdnet/dnetdb.h>
+
+#define LINELEN       1024
+#define LISTDELM      " \t,"
+
+#define CI_OFF(f)     offsetof(struct cifilter_dn, f)
+
+struct jumplist
+{
+    int n;
+    int at[BPF_MAXINSNS];
+};
+
+struct cif_prog
+{
+    struct sock_filter insn[BPF_MAXINSNS];
+    int                len;
+    int                overflow;
+    struct jumplist    accept;     // Jumps to "let it in"
+    struct jumplist    reject;     // Jumps to "turn it away"
+    struct jumplist    clients;    // Object matched, go and check the node
+    struct jumplist    nextline;   // Object didn't match
+};
+
+static int emit(struct cif_prog *p, unsigned short code, unsigned char jt,
+		unsigned char jf, unsigned int k)
+{
+    if (p->len >= BPF_MAXINSNS)
+    {
+	p->overflow = 1;
+	return p->len;
+    }
+    p->insn[p->len].code = code;
+    p->insn[p->len].jt = jt;
+    p->insn[p->len].jf = jf;
+    p->insn[p->len].k = k;
+    return p->len++;
+}
+
+// Unconditional jump to a label that isn't known yet
+static void jump_to(struct cif_prog *p, struct jumplist *l)
+{
+    int at = emit(p, BPF_JMP|BPF_JA, 0, 0, 0);
+
+    if (!p->overflow)
+	l->at[l->n++] = at;
+}
+
+// The label is here, fill in the jumps to it
+static void land(struct cif_prog *p, struct jumplist *l)
+{
+    int i;
+
+    for (i=0; i<l->n; i++)
+	p->insn[l->at[i]].k = p->len - l->at[i] - 1;
+    l->n = 0;
+}
+
+// A = byte or halfword of the connect summary, jump if it equals k
+static void match_value(struct cif_prog *p, int size, int off, unsigned int k,
+			struct jumplist *match)
+{
+    emit(p, BPF_LD|size|BPF_ABS, 0, 0, off);
+    emit(p, BPF_JMP|BPF_JEQ|BPF_K, 0, 1, k);
+    jump_to(p, match);
+}
+
+// dnet_priv_check() compares the object name against the start of
+// the rule with strncmp(), so any leading part of the rule matches.
+static void match_objname(struct cif_prog *p, const char *name,
+			  struct jumplist *match)
+{
+    int n = strlen(name);
+    int fail[2+DN_MAXOBJL];
+    int nfail = 0;
+    int hit[DN_MAXOBJL];
+    int nhit = 0;
+    int i, ja;
+
+    if (n > DN_MAXOBJL) n = DN_MAXOBJL;
+
+    emit(p, BPF_LD|BPF_B|BPF_ABS, 0, 0, CI_OFF(cfn_dstobjnamel));
+    fail[nfail++] = emit(p, BPF_JMP|BPF_JEQ|BPF_K, 0, 0, 0);
+    fail[nfail++] = emit(p, BPF_JMP|BPF_JGT|BPF_K, 0, 0, n);
+    emit(p, BPF_MISC|BPF_TAX, 0, 0, 0);
+    for (i=0; i<n; i++)
+    {
+	if (i)
+	{
+	    // Run out of name to compare? then it matched
+	    emit(p, BPF_MISC|BPF_TXA, 0, 0, 0);
+	    hit[nhit++] = emit(p, BPF_JMP|BPF_JGT|BPF_K, 0, 0, i);
+	}
+	emit(p, BPF_LD|BPF_B|BPF_ABS, 0, 0, CI_OFF(cfn_dstobjname) + i);
+	fail[nfail++] = emit(p, BPF_JMP|BPF_JEQ|BPF_K, 0, 0,
+			     (unsigned char)name[i]);
+    }
+    jump_to(p, match);
+    ja = p->len - 1;
+
+    if (p->overflow) return;
+    for (i=0; i<nhit; i++)
+	p->insn[hit[i]].jf = ja - hit[i] - 1;
+
+    // A "jump if equal" that fails the test does so on the false branch,
+    // except the first two which fail when they are true.
+    p->insn[fail[0]].jt = p->len - fail[0] - 1;
+    p->insn[fail[1]].jt = p->len - fail[1] - 1;
+    for (i=2; i<nfail; i++)
+	p->insn[fail[i]].jf = p->len - fail[i] - 1;
+}
+
+static void match_object(struct cif_prog *p, char *c)
+{
+    if ( !strcmp(c, "ALL") ) {
+	jump_to(p, &p->clients);
+    } else if ( *c == '$' ) {
+	c++;
+	if ( *c == '#' ) {
+	    int num;
+
+	    c++;
+	    num = isalpha(*c) ? getobjectbyname(c) : atoi(c);
+	    if (num >= 0 && num <= 255)
+		match_value(p, BPF_B, CI_OFF(cfn_dstobjnum), num, &p->clients);
+	} else {
+	    if ( *c == '=' )
+		c++;
+	    match_objname(p, c, &p->clients);
+	}
+    }
+    // Process names never match, the kernel doesn't know them.
+}
+
+static void match_client(struct cif_prog *p, char *c, struct jumplist *match)
+{
+    struct nodeent *ne;
+    char            check[16];
+    char            extra;
+    int             area, node;
+
+    if ( !strcmp(c, "ALL") ) {
+	jump_to(p, match);
+    } else if ( sscanf(c, "%d.%d%c", &area, &node, &extra) == 2 ) {
+	// dnet_priv_check() compares the text, so only the canonical
+	// form of the address matches.
+	snprintf(check, sizeof(check), "%i.%i", area, node);
+	if (!strcmp(check, c) && area >= 0 && area < 64 &&
+	    node >= 0 && node < 1024)
+	    match_value(p, BPF_H, CI_OFF(cfn_srcnode), (area << 10) | node, match);
+    } else if ( isalpha(*c) ) {
+	if ( (ne = getnodebyname(c)) != NULL )
+	    match_value(p, BPF_H, CI_OFF(cfn_srcnode),
+			(ne->n_addr[1] << 8) | ne->n_addr[0], match);
+    }
+}
+
+// Jump to "match" if any line in the file matches the connect,
+// otherwise fall through.
+static void compile_file(struct cif_prog *p, FILE *fh, struct jumplist *match)
+{
+    char   line[LINELEN];
+    char * clients;
+    char * c;
+    char * tokptr = NULL;
+
+    while (fgets(line, LINELEN, fh) != NULL && !p->overflow) {
+	if ( line[0] == '#' )
+	    continue;
+
+	if ( (clients = strchr(line, ':')) == NULL )
+	    continue;
+
+	*clients = 0;
+	clients++;
+
+	c = &clients[strlen(clients) - 1];
+	if ( *c == '\n' )
+	    *c = 0;
+
+	for (c = strtok_r(line, LISTDELM, &tokptr); c != NULL;
+	     c = strtok_r(NULL, LISTDELM, &tokptr))
+	    match_object(p, c);
+	jump_to(p, &p->nextline);
+
+	land(p, &p->clients);
+	for (c = strtok_r(clients, LISTDELM, &tokptr); c != NULL;
+	     c = strtok_r(NULL, LISTDELM, &tokptr))
+	    match_client(p, c, match);
+	land(p, &p->nextline);
+    }
+}
+
+// Build the filter for the allow and deny files and attach it to a
+// listening socket. The result is the same as node_allowed() in
+// dnet_daemon.c. Returns 0 if the filter was attached.
+int dnet_priv_filter(int sockfd, const char *allowfile, const char *denyfile)
+{
+    struct cif_prog *p;
+    struct sock_fprog fprog;
+    FILE *fh;
+    int   status;
+
+    p = calloc(1, sizeof(*p));
+    if (!p)
+	return -1;
+
+    // Allowed nodes get in
+    if ( (fh = fopen(allowfile, "r")) != NULL ) {
+	compile_file(p, fh, &p->accept);
+	fclose(fh);
+    }
+
+    // Otherwise it's up to the deny list, if there is one
+    if ( access(denyfile, F_OK) == 0 ) {
+	if ( (fh = fopen(denyfile, "r")) != NULL ) {
+	    compile_file(p, fh, &p->reject);
+	    fclose(fh);
+	} else {
+	    jump_to(p, &p->reject);
+	}
+    }
+
+    land(p, &p->accept);
+    emit(p, BPF_RET|BPF_K, 0, 0, 0xffffffff);
+    land(p, &p->reject);
+    emit(p, BPF_RET|BPF_K, 0, 0, 0);
+
+    if (p->overflow)
+    {
+	free(p);
+	errno = E2BIG;
+	return -1;
+    }
+
+    fprog.len = p->len;
+    fprog.filter = p->insn;
+    status = setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_FILTER,
+			&fprog, sizeof(fprog));
+    free(p);
+    return status;
+}
@@ -0,0 +1,187 @@
+/******************************************************************************
+    broker.cc from libdap
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// Client and server ends of the dapbroker socket.
+//
+// The broker listens on an abstract Unix socket named after the user's
+// uid. Links are passed across it as SCM_RIGHTS so the client ends up
+// with a DECnet socket that is indistinguishable from one it connected
+// itself.
+#include <unistd.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netdnet/dn.h>
+
+#include "broker.h"
+
+static socklen_t broker_address(struct sockaddr_un *sun)
+{
+    memset(sun, 0, sizeof(*sun));
+    sun->sun_family = AF_UNIX;
+
+    // Abstract namespace: leading NUL, not NUL-terminated
+    snprintf(sun->sun_path+1, sizeof(sun->sun_path)-1, "dapbroker.%d",
+             (int)getuid());
+    return offsetof(struct sockaddr_un, sun_path) + 1 + strlen(sun->sun_path+1);
+}
+
+// Connect to this user's broker. Returns -1 if there isn't one, which
+// is not an error, it just means the caller has to connect for itself.
+int dap_broker_connect()
+{
+    struct sockaddr_un sun;
+    struct ucred cred;
+    socklen_t credlen = sizeof(cred);
+    struct timeval tv = {2, 0};
+    socklen_t len;
+    int sock;
+
+    sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (sock == -1)
+        return -1;
+
+    len = broker_address(&sun);
+    if (connect(sock, (struct sockaddr *)&sun, len) == -1)
+    {
+        close(sock);
+        return -1;
+    }
+
+    // Anyone can bind an abstract name, make sure it's really ours
+    // before we send it any passwords.
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) == -1 ||
+        cred.uid != getuid())
+    {
+        close(sock);
+        return -1;
+    }
+
+    // Don't let a wedged broker hold up the client
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return sock;
+}
+
+// Create the broker's listening socket
+int dap_broker_listen()
+{
+    struct sockaddr_un sun;
+    socklen_t len;
+    int sock;
+
+    sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (sock == -1)
+        return -1;
+
+    len = broker_address(&sun);
+    if (bind(sock, (struct sockaddr *)&sun, len) == -1 ||
+        listen(sock, 5) == -1)
+    {
+        int saved_errno = errno;
+        close(sock);
+        errno = saved_errno;
+        return -1;
+    }
+    return sock;
+}
+
+// Send a message, with a file descriptor attached if fd != -1
+bool dap_broker_send(int sock, struct dap_broker_msg *msg, int fd)
+{
+    struct msghdr mh;
+    struct iovec iov;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+
+    memset(&mh, 0, sizeof(mh));
+    iov.iov_base = msg;
+    iov.iov_len = sizeof(*msg);
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+
+    if (fd != -1)
+    {
+        struct cmsghdr *cmsg;
+
+        memset(cbuf, 0, sizeof(cbuf));
+        mh.msg_control = cbuf;
+        mh.msg_controllen = sizeof(cbuf);
+        cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    return sendmsg(sock, &mh, MSG_NOSIGNAL) == (ssize_t)sizeof(*msg);
+}
+
+// Receive a message. *fd is set to the attached descriptor or -1.
+bool dap_broker_recv(int sock, struct dap_broker_msg *msg, int *fd)
+{
+    struct msghdr mh;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    ssize_t len;
+
+    *fd = -1;
+    memset(&mh, 0, sizeof(mh));
+    iov.iov_base = msg;
+    iov.iov_len = sizeof(*msg);
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = cbuf;
+    mh.msg_controllen = sizeof(cbuf);
+
+    len = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+    if (len <= 0)
+        return false;
+
+    for (cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+
+    if (len != (ssize_t)sizeof(*msg) || (mh.msg_flags & MSG_CTRUNC))
+    {
+        if (*fd != -1) close(*fd);
+        *fd = -1;
+        return false;
+    }
+    return true;
+}
+
+// Do two requests refer to the same node, object and user ?
+// Callers zero the whole message before filling it in so that
+// unused bytes compare equal.
+bool dap_broker_match(const struct dap_broker_msg *a,
+                      const struct dap_broker_msg *b)
+{
+    return memcmp(a->node, b->node, sizeof(a->node)) == 0 &&
+        a->objnum == b->objnum &&
+        a->objnamel == b->objnamel &&
+        memcmp(a->objname, b->objname, sizeof(a->objname)) == 0 &&
+        memcmp(&a->access, &b->access, sizeof(a->access)) == 0;
+}
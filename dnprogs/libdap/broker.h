@@ -0,0 +1,36 @@
+#ifndef LIBDAP_BROKER_H
+#define LIBDAP_BROKER_H
+
+// broker.h
+//
+// Talking to the per-user DAP session broker (dapbroker). The broker
+// keeps FAL links that have already done the CONFIG exchange open for a
+// short while after a client has finished with them so the next
+// command to the same node can skip the connect and the handshake.
+//
+
+struct dap_broker_msg
+{
+    int            type;
+    unsigned char  node[2];         // DECnet address of the remote node
+    unsigned short objnum;
+    unsigned short objnamel;
+    unsigned char  objname[16];
+    struct accessdata_dn access;
+    int            blocksize;       // Agreed in the CONFIG exchange
+    int            remote_os;
+};
+
+// Message types
+#define DAP_BROKER_GET  1    // Client wants a link, no fd
+#define DAP_BROKER_PUT  2    // Client hands back an idle link, fd attached
+#define DAP_BROKER_HIT  3    // Broker reply, fd attached
+#define DAP_BROKER_MISS 4    // Broker reply, connect yourself
+
+int  dap_broker_connect();
+int  dap_broker_listen();
+bool dap_broker_send(int sock, struct dap_broker_msg *msg, int fd);
+bool dap_broker_recv(int sock, struct dap_broker_msg *msg, int *fd);
+bool dap_broker_match(const struct dap_broker_msg *a,
+                      const struct dap_broker_msg *b);
+#endif
@@ -47,6 +47,7 @@
 #include "logging.h"
 #include "connection.h"
 #include "protocol.h"
+#include "broker.h"
 #include "dn_endian.h"
 
 #define min(a,b) (a)<(b)?(a):(b)
@@ -90,7 +91,10 @@ void dap_connection::initialise(int verbosity)
     lasterror   = errstring;
     errstring[0]= '\0';
     closed      = false;
+    pin_buffers = want_pinned_buffers();
     connect_timeout = 60;
+    broker_key  = NULL;
+    configured  = false;
 
 #ifdef NO_BLOCKING
     blocking_allowed = false; // More useful for debugging
@@ -115,14 +119,59 @@ void dap_connection::close()
 
         delete[] buf;
         delete[] outbuf;
+        delete broker_key;
+        broker_key = NULL;
         closed = true;
     }
 }
 
+// A kernel that has net.decnet.moderate_rcvbuf sizes DECnet socket
+// buffers from the round trip time and the rate the application drains
+// them. Setting SO_SNDBUF/SO_RCVBUF turns that off for the socket, so
+// we only size them ourselves if the kernel won't.
+bool dap_connection::kernel_sizes_buffers()
+{
+    static int tuned = -1;
+
+    if (tuned == -1)
+    {
+        FILE *f = fopen("/proc/sys/net/decnet/moderate_rcvbuf", "r");
+
+        tuned = 0;
+        if (f)
+        {
+            if (fscanf(f, "%d", &tuned) != 1)
+                tuned = 0;
+            fclose(f);
+        }
+    }
+    return tuned != 0;
+}
+
+// DAP_PIN_BUFFERS=1 in the environment (or pin_socket_buffers()) sizes
+// the buffers for our blocks whatever the kernel does, DAP_PIN_BUFFERS=0
+// never does. Otherwise follow the kernel.
+bool dap_connection::want_pinned_buffers()
+{
+    const char *env = getenv("DAP_PIN_BUFFERS");
+
+    if (env && *env)
+        return atoi(env) != 0;
+    return !kernel_sizes_buffers();
+}
+
+void dap_connection::pin_socket_buffers(bool onoff)
+{
+    pin_buffers = onoff;
+    if (pin_buffers) set_socket_buffer_size();
+}
+
 bool dap_connection::set_socket_buffer_size()
 {
     int bs;
 
+    if (!pin_buffers) return true;
+
     // Make sure the kernel buffer is large enough for our blocks
     if (setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &blocksize, sizeof(blocksize)) < 0)
     {
@@ -299,6 +348,25 @@ bool dap_connection::do_connect(const char *node, const char *user,
     accessdata.acc_userl = strlen(user);
     accessdata.acc_passl = strlen(password);
 
+    // See if the session broker has a link we can have
+    delete broker_key;
+    broker_key = new dap_broker_msg;
+    memset(broker_key, 0, sizeof(*broker_key));
+    memcpy(broker_key->node, s.sdn_add.a_addr, sizeof(broker_key->node));
+    broker_key->objnum = s.sdn_objnum;
+    broker_key->objnamel = s.sdn_objnamel;
+    memcpy(broker_key->objname, s.sdn_objname,
+           min(sizeof(broker_key->objname), dn_ntohs(s.sdn_objnamel)));
+    broker_key->access.acc_accl = accessdata.acc_accl;
+    memcpy(broker_key->access.acc_acc, accessdata.acc_acc, accessdata.acc_accl);
+    broker_key->access.acc_userl = accessdata.acc_userl;
+    memcpy(broker_key->access.acc_user, accessdata.acc_user, accessdata.acc_userl);
+    broker_key->access.acc_passl = accessdata.acc_passl;
+    memcpy(broker_key->access.acc_pass, accessdata.acc_pass, accessdata.acc_passl);
+
+    if (broker_get())
+        return true;
+
     if (setsockopt(sockfd, DNPROTO_NSP, SO_CONACCESS, &accessdata,
                    sizeof(accessdata)) < 0)
     {
@@ -626,7 +694,9 @@ dap_connection *dap_connection::waitfor()
     if (status < 0 && errno == EINTR) return NULL;
 
     // Return a new connection object
-    return new dap_connection(status, blocksize, verbose);
+    dap_connection *newconn = new dap_connection(status, blocksize, verbose);
+    newconn->pin_buffers = pin_buffers;
+    return newconn;
 }
 
 
@@ -981,6 +1051,9 @@ bool dap_connection::error_return(char *txt)
 // Exchange CONFIG messages with the other side.
 bool dap_connection::exchange_config()
 {
+// A link from the session broker has already done this
+    if (configured) return true;
+
 // Send our config message
     dap_config_message *newcm = new dap_config_message(MAX_READ_SIZE);
     if (!newcm->write(*this)) return false;
@@ -1012,6 +1085,7 @@ bool dap_connection::exchange_config()
             DAPLOG((LOG_DEBUG, "Using block size %d\n", get_blocksize()));
 
         remote_os = cm->get_os();
+        configured = true;
         if (verbose > 1)
         {
             DAPLOG((LOG_DEBUG, "Remote OS is %d\n", remote_os));
@@ -1028,6 +1102,77 @@ bool dap_connection::exchange_config()
     return true;
 }
 
+// Ask the session broker for an idle link that matches broker_key.
+// If it has one, it replaces our unconnected socket.
+bool dap_connection::broker_get()
+{
+    struct dap_broker_msg msg;
+    int bsock;
+    int fd;
+
+    bsock = dap_broker_connect();
+    if (bsock == -1) return false;
+
+    memcpy(&msg, broker_key, sizeof(msg));
+    msg.type = DAP_BROKER_GET;
+    if (!dap_broker_send(bsock, &msg, -1) ||
+        !dap_broker_recv(bsock, &msg, &fd))
+    {
+        ::close(bsock);
+        return false;
+    }
+    ::close(bsock);
+
+    if (msg.type != DAP_BROKER_HIT || fd == -1)
+    {
+        if (fd != -1) ::close(fd);
+        return false;
+    }
+
+    if (verbose > 1)
+        DAPLOG((LOG_DEBUG, "Using link from session broker\n"));
+
+    ::close(sockfd);
+    sockfd = fd;
+    set_blocksize(msg.blocksize);
+    remote_os = msg.remote_os;
+    configured = true;
+
+    bufptr = buflen = 0;
+    connected = true;
+    return true;
+}
+
+// Hand the link to the session broker instead of closing it, so that
+// the next connect to the same place can reuse it. Only call this when
+// the last operation finished cleanly and FAL is waiting for a new
+// ACCESS. Closes the connection either way.
+bool dap_connection::park()
+{
+    struct dap_broker_msg msg;
+    bool parked = false;
+    int bsock;
+
+    if (closed) return false;
+
+    if (broker_key && configured && outbufptr == 0 && bufptr >= buflen &&
+        (bsock = dap_broker_connect()) != -1)
+    {
+        memcpy(&msg, broker_key, sizeof(msg));
+        msg.type = DAP_BROKER_PUT;
+        msg.blocksize = blocksize;
+        msg.remote_os = remote_os;
+        parked = dap_broker_send(bsock, &msg, sockfd);
+        ::close(bsock);
+
+        if (parked && verbose > 1)
+            DAPLOG((LOG_DEBUG, "Link parked with session broker\n"));
+    }
+
+    close();
+    return parked;
+}
+
 // Return the text of a connection error
 const char *dap_connection::connerror(char *default_msg)
 {
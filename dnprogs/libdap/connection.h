@@ -6,6 +6,8 @@
 // Encapsulates a DAP connection. Incoming and Outgoing
 //
 
+struct dap_broker_msg;
+
 class dap_connection
 {
  public:
@@ -39,6 +41,7 @@ class dap_connection
     bool  have_bytes(int);
     int   set_blocked(bool onoff);
     void  allow_blocking(bool onoff);
+    void  pin_socket_buffers(bool onoff);
     int   verbosity() {return verbose;};
     bool  parse(const char *fname,
 		struct accessdata_dn &accessdata, char *node, char *filespec);
@@ -46,6 +49,7 @@ class dap_connection
     int  get_fd() { return sockfd; }
     int  get_remote_os() { return remote_os; };
     bool exchange_config();
+    bool park();
     void clear_output_buffer();
     void set_connect_timeout(int seconds);
     
@@ -68,11 +72,14 @@ class dap_connection
     bool   blocked;
     bool   blocking_allowed;
     bool   closed;
+    bool   pin_buffers;
     int    last_msg_start;
     int    end_of_msg;
     int    remote_os;
     int    connect_timeout;
     struct nodeent *binadr;
+    struct dap_broker_msg *broker_key;
+    bool   configured;
     
     char *lasterror;
     char  errstring[256];
@@ -82,6 +89,9 @@ class dap_connection
     void create_socket();
     void initialise(int);
     bool set_socket_buffer_size();
+    static bool kernel_sizes_buffers();
+    static bool want_pinned_buffers();
+    bool broker_get();
     bool do_connect(const char *node, const char *user,
 		    const char *password, sockaddr_dn &sockaddr);
 
@@ -0,0 +1,524 @@
+/******************************************************************************
+    filespec.cc from libdap
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// VMS <-> Unix file name translation.
+//
+// This used to live (twice) in FAL and dapfs as a chain of strcpy/strcat
+// calls. Here the name is walked once, each character being looked up
+// in a table that gives its case mapping and whether it is a directory
+// delimiter. $, - and _ are legal in file names on both systems so they
+// go straight through, characters VMS doesn't like are turned into -.
+// The ;version is stripped by the VMS->Unix translation and added by
+// the callers in the other direction because that depends on what is
+// on disk.
+//
+// The translation itself is cheaper than looking it up in a cache would
+// be. What isn't cheap is resolving the Unix name first, so
+// dap_realpath() keeps the resolved names of the last few directories.
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "filespec.h"
+
+#define CACHE_SLOTS 16
+
+// Character classes
+#define CL_DIRSEP  0x01    // [ ] and . inside a VMS directory spec
+#define CL_ROOT    0x02    // Start of 000000 or 0,0
+
+struct dir_entry
+{
+    dev_t  dev;
+    ino_t  ino;
+    char  *dir;
+    char  *resolved;
+};
+
+static struct dir_entry cache[CACHE_SLOTS];
+static int next_slot;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned char upper_map[256];
+static unsigned char lower_map[256];
+static unsigned char wild_map[256];
+static unsigned char legal_map[256];
+static unsigned char char_class[256];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void init_tables()
+{
+    int i;
+
+    for (i=0; i<256; i++)
+        upper_map[i] = lower_map[i] = wild_map[i] = legal_map[i] = i;
+
+    for (i='a'; i<='z'; i++)
+    {
+        upper_map[i] = i - 'a' + 'A';
+        lower_map[i - 'a' + 'A'] = i;
+    }
+
+    // elipses are NOT catered for because there is no Unix equivalent.
+    wild_map['%'] = '?';
+
+    // There may need to be more here as odd characters seem to upset
+    // VMS greatly.
+    legal_map['~'] = '-';
+    legal_map[' '] = '-';
+
+    char_class['['] = CL_DIRSEP;
+    char_class[']'] = CL_DIRSEP;
+    char_class['.'] = CL_DIRSEP;
+    char_class['0'] = CL_ROOT;
+}
+
+// Convert a VMS filespec into a Unix filespec
+// volume names are turned into directories in the root directory
+// (unless they are SYSDISK which is our pseudo name)
+static int vms_to_unix_name(const char *vms, char *unixname, int size,
+                            const char *sysdisk)
+{
+    const char *end;
+    const char *colon;
+    const char *dir;
+    const char *enddir;
+    const char *file;
+    const char *p;
+    char *out = unixname;
+    int dirlen = 0;
+    int i;
+
+    // Remove the trailing version number
+    end = vms + strcspn(vms, ";");
+
+    // Every character maps to at most one, plus a leading slash for
+    // the volume.
+    if (end - vms + 2 > size)
+        return -1;
+
+    // If the filename has a trailing dot them remove that too
+    if (end > vms && end[-1] == '.')
+        end--;
+
+    colon = (const char *)memchr(vms, ':', end - vms);
+    dir = colon ? colon+1 : vms;
+
+    enddir = (const char *)memchr(dir, ']', end - dir);
+
+    // Don't get caught out by concatenated filespecs
+    // like dua0:[home.chrissie.][test]
+    if (enddir && enddir+1 < end && enddir[1] == '[')
+        enddir = (const char *)memchr(enddir+1, ']', end - enddir - 1);
+
+    if (dir < end && *dir == '[' && enddir)
+        dirlen = enddir - dir + 1;
+    file = dir + dirlen;
+
+    // If the filename has the dummy SYSDISK volume then start from the
+    // filesystem root
+    if (colon && colon > vms)
+    {
+        *out++ = '/';
+        if ((int)strlen(sysdisk) != colon - vms ||
+            strncasecmp(vms, sysdisk, colon - vms) != 0)
+        {
+            for (p = vms; p < colon; p++)
+                *out++ = lower_map[(unsigned char)*p];
+        }
+    }
+
+    // Copy the directory
+    for (i=0; i<dirlen; i++)
+    {
+        unsigned char c = dir[i];
+
+        // Remove '[]' as it's a no-op.
+        // If the directory name starts [. then it is relative to the
+        // user's home directory and we lose the starting slash
+        // If there is also a volume name present then it all falls
+        // to bits but then it's pretty dodgy on VMS too.
+        if (c == '[' && i+1 < dirlen && (dir[i+1] == ']' || dir[i+1] == '.'))
+        {
+            i++;
+            out = unixname;
+            continue;
+        }
+
+        switch (char_class[c])
+        {
+        case CL_DIRSEP:
+            *out++ = '/';
+            continue;
+
+        case CL_ROOT:
+            // Skip root directory specs
+            if (dirlen - i >= 6 && memcmp(&dir[i], "000000", 6) == 0)
+            {
+                i += 5;
+                continue;
+            }
+            if (dirlen - i >= 3 && memcmp(&dir[i], "0,0", 3) == 0)
+            {
+                i += 2;
+                continue;
+            }
+            break;
+        }
+        *out++ = lower_map[c];
+    }
+
+    // A special case (ugh!), if VMS sent us '*.*' (maybe as part of *.*;*)
+    // then change it to just '*' so we get all the files.
+    if (end - file == 3 && memcmp(file, "*.*", 3) == 0)
+    {
+        *out++ = '*';
+    }
+    else
+    {
+        // Finally convert it all to lower case. This is not the greatest
+        // way to cope with it but because VMS will upper-case everything
+        // anyway we can't really distinguish case.
+        for (p = file; p < end; p++)
+            *out++ = lower_map[(unsigned char)*p];
+    }
+    *out = '\0';
+    return 0;
+}
+
+// Convert a Unix-style filename to a VMS-style name
+static int unix_to_vms_name(const char *unixname, char *vmsname, int size,
+                            const char *sysdisk, int flags)
+{
+    const char *name = unixname;
+    const char *p;
+    char *out = vmsname;
+    int slashes = 0;
+    int thisslash = 1;
+
+    // Worst case is SYSDISK:[000000]name.
+    if ((int)(strlen(unixname) + strlen(sysdisk)) + 12 > size)
+        return -1;
+
+    for (p = unixname; *p; p++)
+        if (*p == '/')
+            slashes++;
+
+    if (*name == '/')
+        name++;
+
+    if (flags & DAP_VMS_RELATIVE)
+    {
+        // Files in the top directory go as they are
+        if (slashes <= 1)
+        {
+            strcpy(vmsname, name);
+            return 0;
+        }
+        *out++ = '[';
+        *out++ = '.';
+    }
+    else
+    {
+        // Count the slashes. If there is one slash we emit a filename like:
+        // SYSDISK:[000000]filename
+        // For two we use:
+        // SYSDISK:[DIR]filename
+        // for three or more we use:
+        // DIR:[DIR1]filename
+        // and so on...
+        if (slashes == 1 || slashes == 2)
+        {
+            strcpy(out, sysdisk);
+            out += strlen(sysdisk);
+            if (slashes == 1)
+            {
+                memcpy(out, ":[000000]", 9);
+                out += 9;
+            }
+            else
+            {
+                *out++ = ':';
+                *out++ = '[';
+            }
+        }
+    }
+
+    for (p = name; *p; p++)
+    {
+        if (*p != '/')
+        {
+            *out++ = upper_map[(unsigned char)*p];
+            continue;
+        }
+
+        thisslash++;
+        if (thisslash == slashes)
+        {
+            *out++ = ']';
+        }
+        else if (thisslash == 2 && !(flags & DAP_VMS_RELATIVE))
+        {
+            *out++ = ':';
+            *out++ = '[';
+        }
+        else
+        {
+            *out++ = '.';
+        }
+    }
+
+    // VMS reads a trailing dot as an empty version number
+    if (flags & DAP_VMS_ADDDOT)
+        *out++ = '.';
+    *out = '\0';
+    return 0;
+}
+
+int dap_vms_to_unix(const char *vmsname, char *unixname, int size,
+                    const char *sysdisk)
+{
+    int len;
+
+    pthread_once(&tables_once, init_tables);
+
+    if (vms_to_unix_name(vmsname, unixname, size, sysdisk) == -1)
+    {
+        unixname[0] = '\0';
+        return -1;
+    }
+
+    // If the name ends in .dir and there is a directory of that name without
+    // the .dir then remove it (the .dir, not the directory!)
+    len = strlen(unixname);
+    if (len >= 4 && strcmp(unixname+len-4, ".dir") == 0)
+    {
+        struct stat st;
+
+        unixname[len-4] = '\0';
+        if (stat(unixname, &st) != 0 || !S_ISDIR(st.st_mode))
+            unixname[len-4] = '.';
+    }
+    return 0;
+}
+
+int dap_unix_to_vms(const char *unixname, char *vmsname, int size,
+                    const char *sysdisk, int flags)
+{
+    pthread_once(&tables_once, init_tables);
+
+    if (unix_to_vms_name(unixname, vmsname, size, sysdisk, flags) == -1)
+    {
+        vmsname[0] = '\0';
+        return -1;
+    }
+    return 0;
+}
+
+// Split out the volume, directory and file portions of a VMS file spec
+// We assume that the VMS name is (quite) well formed.
+void dap_parse_vms_filespec(char *volume, char *directory, char *file)
+{
+    char *colon = strchr(file, ':');
+    char *ptr = file;
+    char *enddir;
+
+    volume[0] = '\0';
+    directory[0] = '\0';
+
+    if (colon) // We have a volume name
+    {
+        memcpy(volume, file, colon - file + 1);
+        volume[colon - file + 1] = '\0';
+        ptr = colon+1;
+    }
+
+    enddir = strchr(ptr, ']');
+
+    // Don't get caught out by concatenated filespecs
+    // like dua0:[home.christine.][test]
+    if (enddir && enddir[1] == '[')
+        enddir = strchr(enddir+1, ']');
+
+    if (*ptr == '[' && enddir) // we have a directory
+    {
+        memcpy(directory, ptr, enddir - ptr + 1);
+        directory[enddir - ptr + 1] = '\0';
+        ptr = enddir+1;
+    }
+
+    // Copy the rest of the filename using memmove 'cos it might overlap
+    if (ptr != file)
+        memmove(file, ptr, strlen(ptr)+1);
+}
+
+// Convert VMS wildcards to Unix wildcards
+// In fact all this does is substitute ? for % in the string.
+void dap_vms_wildcards(char *filespec)
+{
+    pthread_once(&tables_once, init_tables);
+
+    for (; *filespec; filespec++)
+        *filespec = wild_map[(unsigned char)*filespec];
+}
+
+void dap_vms_upcase(char *s)
+{
+    pthread_once(&tables_once, init_tables);
+
+    for (; *s; s++)
+        *s = upper_map[(unsigned char)*s];
+}
+
+void dap_unix_downcase(char *s)
+{
+    pthread_once(&tables_once, init_tables);
+
+    for (; *s; s++)
+        *s = lower_map[(unsigned char)*s];
+}
+
+// Hack the name around to keep VMS happy. If there is more than one dot
+// in the name then convert the first ones to hyphens, also convert some
+// other illegal characters to hyphens too.
+void dap_vms_legalise(char *name)
+{
+    char *lastdot = strrchr(name, '.');
+
+    pthread_once(&tables_once, init_tables);
+
+    for (; *name; name++)
+    {
+        if (*name == '.' && name != lastdot)
+            *name = '-';
+        else
+            *name = legal_map[(unsigned char)*name];
+    }
+}
+
+// realpath() for lots of files in the same few directories, as in a
+// directory listing. The resolved directory part is cached so only the
+// last component needs looking at, and that lstat() is passed back to
+// the caller who nearly always wants it anyway. A directory is only
+// taken from the cache if it is still the same directory so a change
+// of working directory doesn't confuse relative names.
+// Symlinks, and anything odd, go to realpath() as before.
+char *dap_realpath(const char *path, char *resolved, struct stat *st)
+{
+    char dir[PATH_MAX];
+    const char *name;
+    struct stat dirst;
+    int dirlen;
+    int len;
+    int i;
+
+    if (lstat(path, st) == -1)
+        memset(st, 0, sizeof(*st));
+
+    if (S_ISLNK(st->st_mode) || st->st_nlink == 0)
+        return realpath(path, resolved);
+
+    // glob(GLOB_MARK) puts slashes on the end of directories
+    len = strlen(path);
+    while (len > 1 && path[len-1] == '/')
+        len--;
+    if (len >= PATH_MAX)
+        return realpath(path, resolved);
+
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+
+    // ...and lstat() follows a symlink with a slash on the end
+    if (path[len] == '/' &&
+        (lstat(dir, &dirst) == -1 || S_ISLNK(dirst.st_mode)))
+        return realpath(path, resolved);
+
+    name = strrchr(dir, '/');
+    if (name)
+    {
+        dirlen = name - dir;
+        dir[dirlen ? dirlen : 1] = '\0';
+        name = path + (name - dir) + 1;
+    }
+    else
+    {
+        strcpy(dir, ".");
+        dirlen = 1;
+        name = path;
+    }
+    len -= name - path;
+
+    if (len == 0 ||
+        (len == 1 && name[0] == '.') ||
+        (len == 2 && name[0] == '.' && name[1] == '.') ||
+        stat(dir, &dirst) == -1)
+        return realpath(path, resolved);
+
+    pthread_mutex_lock(&cache_lock);
+    for (i=0; i<CACHE_SLOTS; i++)
+    {
+        if (cache[i].dir &&
+            cache[i].dev == dirst.st_dev && cache[i].ino == dirst.st_ino &&
+            strcmp(cache[i].dir, dir) == 0)
+            break;
+    }
+    if (i < CACHE_SLOTS &&
+        strlen(cache[i].resolved) + len + 2 <= PATH_MAX)
+    {
+        strcpy(resolved, cache[i].resolved);
+        pthread_mutex_unlock(&cache_lock);
+    }
+    else
+    {
+        pthread_mutex_unlock(&cache_lock);
+
+        if (!realpath(dir, resolved))
+            return realpath(path, resolved);
+
+        pthread_mutex_lock(&cache_lock);
+        i = next_slot;
+        next_slot = (next_slot + 1) % CACHE_SLOTS;
+        free(cache[i].dir);
+        free(cache[i].resolved);
+        cache[i].dev = dirst.st_dev;
+        cache[i].ino = dirst.st_ino;
+        cache[i].dir = strdup(dir);
+        cache[i].resolved = strdup(resolved);
+        if (!cache[i].dir || !cache[i].resolved)
+        {
+            free(cache[i].dir);
+            free(cache[i].resolved);
+            cache[i].dir = cache[i].resolved = NULL;
+        }
+        pthread_mutex_unlock(&cache_lock);
+
+        if (strlen(resolved) + len + 2 > PATH_MAX)
+            return realpath(path, resolved);
+    }
+
+    dirlen = strlen(resolved);
+    if (resolved[dirlen-1] != '/')
+        resolved[dirlen++] = '/';
+    memcpy(resolved + dirlen, name, len);
+    resolved[dirlen + len] = '\0';
+    return resolved;
+}
@@ -0,0 +1,39 @@
+#ifndef LIBDAP_FILESPEC_H
+#define LIBDAP_FILESPEC_H
+
+// filespec.h
+//
+// VMS <-> Unix file name translation shared by FAL and dapfs.
+//
+// The translation is done in one pass using character tables.
+// dap_realpath() caches resolved directories by path so that naming
+// every file in a big directory doesn't resolve the directory every time.
+//
+// These are plain C functions so that dapfs can call them.
+
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Layouts for dap_unix_to_vms()
+#define DAP_VMS_SYSDISK  0x01  // SYSDISK:[000000]FILE, SYSDISK:[DIR]FILE, DIR:[D1.D2]FILE
+#define DAP_VMS_RELATIVE 0x02  // [.DIR1.DIR2]FILE relative to the login directory
+#define DAP_VMS_ADDDOT   0x04  // Add a dot (empty version) to names in subdirectories
+
+int  dap_vms_to_unix(const char *vmsname, char *unixname, int size,
+                     const char *sysdisk);
+int  dap_unix_to_vms(const char *unixname, char *vmsname, int size,
+                     const char *sysdisk, int flags);
+void dap_parse_vms_filespec(char *volume, char *directory, char *file);
+void dap_vms_wildcards(char *filespec);
+void dap_vms_upcase(char *s);
+void dap_unix_downcase(char *s);
+void dap_vms_legalise(char *name);
+char *dap_realpath(const char *path, char *resolved, struct stat *st);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
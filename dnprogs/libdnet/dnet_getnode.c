@@ -31,6 +31,8 @@ struct getnode_struct
 {
     FILE *fp;
     char node[32];
+    struct nodeent ent;
+    unsigned char addr[2];
 };
 /*--------------------------------------------------------------------------*/
 void *dnet_getnode(void)
@@ -42,6 +44,7 @@ void *dnet_getnode(void)
     if ((gs->fp = fopen(SYSCONF_PREFIX "/etc/decnet.conf","r")) == NULL)
     {
 	fprintf(stderr, "dnet_htoa: Can not open " SYSCONF_PREFIX "/etc/decnet.conf\n");
+	free(gs);
 	return NULL;
     }
     
@@ -72,6 +75,33 @@ char *dnet_nextnode(void *g)
     }
 }
 
+/* Like dnet_nextnode but also returns the address from the same line
+   so callers don't need to look each name up again */
+struct nodeent *dnet_nextnodeent(void *g)
+{
+    struct getnode_struct *gs = (struct getnode_struct *)g;
+    int area, node;
+    char *name;
+
+    while ((name = dnet_nextnode(g)))
+    {
+	if (sscanf(nodeadr, "%d.%d", &area, &node) != 2 ||
+	    area < 1 || area > 63 || node < 1 || node > 1023)
+	    continue;
+
+	gs->addr[0] = node & 0xFF;
+	gs->addr[1] = (area << 2) | ((node & 0x300) >> 8);
+
+	gs->ent.n_name     = name;
+	gs->ent.n_addrtype = AF_DECnet;
+	gs->ent.n_length   = 2;
+	gs->ent.n_addr     = gs->addr;
+	gs->ent.n_params   = NULL;
+	return &gs->ent;
+    }
+    return NULL;
+}
+
 void dnet_endnode(void *g)
 {
     struct getnode_struct *gs = (struct getnode_struct *)g;
@@ -44,6 +44,8 @@ int rms_close(RMSHANDLE h)
     dap_message *m;
     int r = rms_getreply(h, 1, NULL, &m);
 
+    // File closed cleanly, the session broker can keep the link
+    if (r == 0) conn->park();
     conn->close();
     
     delete conn;
@@ -147,3 +147,12 @@ int rms_lasterrorcode(RMSHANDLE h)
 
     return rc->lasterr;
 }
+
+// Size of the DAP buffer negotiated with the remote end in the CONFIG
+// exchange. DATA messages (including their headers) never exceed this.
+int rms_blocksize(RMSHANDLE h)
+{
+    rms_conn *rc = (rms_conn *)h;
+
+    return rc->conn->get_blocksize();
+}
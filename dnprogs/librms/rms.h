@@ -41,6 +41,7 @@ int   rms_truncate(RMSHANDLE h, struct RAB *);
 char *rms_lasterror(RMSHANDLE h);
 int   rms_lasterrorcode(RMSHANDLE h);
 char *rms_openerror(void);
+int   rms_blocksize(RMSHANDLE h);
 
 RMSHANDLE rms_t_open(char *name, int mode, char *options, ...);
 int   rms_t_close(RMSHANDLE h);
@@ -14,11 +14,13 @@
 */
 #include <stdio.h>
 #include <unistd.h>
+#include <stdlib.h>
 #include <string.h>
 
 char config_hostname[1024];
 char config_vmsmailuser[1024];
 char config_smtphost[1024];
+int  config_smtppool;
 
 //
 // Read the VMSmail config file ($SYSCONF_PREFIX/etc/vmsmail.conf) to determine parameters
@@ -34,6 +36,7 @@ void read_configfile(void)
     strcpy(config_vmsmailuser, "vmsmail");
     gethostname(config_hostname, sizeof(config_hostname));
     config_smtphost[0] = '\0'; // Use sendmail.
+    config_smtppool = 30;
     
     cf = fopen(SYSCONF_PREFIX "/etc/vmsmail.conf", "r");
     if (cf)
@@ -58,6 +61,8 @@ void read_configfile(void)
 		    strcpy(config_vmsmailuser, eq+1);
 		if (strcasecmp(cfgline, "smtphost") == 0)
 		    strcpy(config_smtphost, eq+1);
+		if (strcasecmp(cfgline, "smtppool") == 0)
+		    config_smtppool = atoi(eq+1);
 	    }
 	    fgets(cfgline, sizeof(cfgline), cf);
 	}
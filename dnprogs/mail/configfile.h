@@ -8,6 +8,7 @@ void read_configfile(void);
 extern char config_hostname[1024];
 extern char config_vmsmailuser[1024];
 extern char config_smtphost[1024];
+extern int  config_smtppool;
 
 #ifdef __cplusplus
 }
@@ -42,6 +42,7 @@
 #include <uudeview.h>
 #include <dn_endian.h>
 #include "configfile.h"
+#include "smtp.h"
 
 #ifndef SENDMAIL_COMMAND
 #define SENDMAIL_COMMAND "/usr/sbin/sendmail -oem"
@@ -80,7 +81,6 @@ struct config_data
 };
 extern int block_mode;
 
-char response[1024];
 int send_smtp(int sock,
 	      char *addressees,
 	      char *cc_addressees,
@@ -100,9 +100,6 @@ int send_smail(int sock,
 	      );
 int send_body(int dnsock, FILE *unixfile);
 
-int smtp_response(FILE *sockstream);
-int smtp_error(FILE *sockstream);
-
 
 extern int verbosity;
 static int is_binary = 0;
@@ -113,7 +110,7 @@ void receive_mail(int sock)
 {
     char   remote_user[256]; // VMS only sends 12 but...just in case!
     char   local_user[256];
-    char   addressees[65536];
+    char  *addressees;
     char   cc_addressees[65536];
     char   full_user[256];
     char   subject[256];
@@ -121,6 +118,8 @@ void receive_mail(int sock)
     struct sockaddr_dn sockaddr;
     struct optdata_dn  optdata;
     int    num_addressees=0;
+    int    addrlen=0;
+    int    addrsize=1024;
     int    i;
     int    stat;
     socklen_t namlen = sizeof(sockaddr);
@@ -175,22 +174,46 @@ void receive_mail(int sock)
     // The rest of the message should be the local user names. These could
     // be a real local user or an internet mail name. They are not
     // padded.
+    // Distribution lists can be long, so this grows as needed.
+    addressees = malloc(addrsize);
+    if (!addressees)
+    {
+	DNETLOG((LOG_ERR, "Can't allocate addressee list: %m\n"));
+	return;
+    }
     addressees[0] = '\0';
     do
     {
-	stat = read(sock, local_user, sizeof(local_user));
+	stat = read(sock, local_user, sizeof(local_user)-1);
 	if (stat == -1)
 	{
 	    DNETLOG((LOG_ERR, "Error reading local user: %m\n"));
+	    free(addressees);
 	    return;
 	}
 	if (local_user[0] != '\0')
 	{
 	    local_user[stat] = '\0';
 	    DNETLOG((LOG_DEBUG, "got local user: %s\n", local_user));
-	    strcat(addressees, local_user);
-	    strcat(addressees, ",");
-	    
+	    if (addrlen + stat + 2 > addrsize)
+	    {
+		char *newaddr;
+
+		addrsize = (addrlen + stat + 2) * 2;
+		newaddr = realloc(addressees, addrsize);
+		if (!newaddr)
+		{
+		    DNETLOG((LOG_ERR, "Can't allocate addressee list: %m\n"));
+		    free(addressees);
+		    return;
+		}
+		addressees = newaddr;
+	    }
+	    memcpy(addressees+addrlen, local_user, stat);
+	    addrlen += stat;
+	    addressees[addrlen++] = ',';
+	    addressees[addrlen] = '\0';
+
 	    // Send acknowledge
 	    write(sock, "\001\000\000\000", 4);
 	    num_addressees++;
@@ -199,11 +222,12 @@ void receive_mail(int sock)
     while (local_user[0] != '\0');
 
     // Remove trailing comma
-    addressees[strlen(addressees)-1] = '\0';
+    if (addrlen)
+	addressees[addrlen-1] = '\0';
 
     // TODO: This should be more intelligent and only lower-case the
     // addressable part of the email name.
-    for (i=0; i<strlen(addressees); i++)
+    for (i=0; i<addrlen; i++)
 	addressees[i] = tolower(addressees[i]);
     
     // This is the collected list of users to send the message to,
@@ -213,6 +237,7 @@ void receive_mail(int sock)
     if (stat == -1)
     {
 	DNETLOG((LOG_ERR, "Error reading full_user: %m\n"));
+	free(addressees);
 	return;
     }
     full_user[stat] = '\0';
@@ -233,6 +258,7 @@ void receive_mail(int sock)
     if (stat == -1)
     {
 	DNETLOG((LOG_ERR, "Error reading subject: %m\n"));
+	free(addressees);
 	return;
     }
     subject[stat] = '\0';
@@ -270,6 +296,7 @@ void receive_mail(int sock)
 	    write(sock, "\001\000\000\000", 4);
 	}
     }
+    free(addressees);
     close(sock);
 }
 
@@ -282,110 +309,63 @@ int send_smtp(int sock,
 	      char *full_user
 	      )
 {
-    FILE              *sockfile;
-    struct sockaddr_in serv_addr;
-    struct hostent    *host_info;
-    struct servent    *servent;
-    int                port;
+    struct smtp_conn   conn;
+    char               from[2048];
+    char             **rcpts;
+    char              *rcptbuf;
     char              *addr;
+    char              *p;
+    int                nrcpts = 0;
+    int                len;
     int                stat;
-    int                numbytes;
-    int                smtpsock;
 
-    smtpsock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (smtpsock == -1)
+    // Split the addressees up without spoiling the To: and Cc: headers
+    len = strlen(addressees) + strlen(cc_addressees) + 2;
+    rcptbuf = malloc(len);
+    rcpts = malloc(len * sizeof(char *));
+    if (!rcptbuf || !rcpts)
     {
-	DNETLOG((LOG_ERR, "Can't open socket for SMTP: %m\n"));
+	DNETLOG((LOG_ERR, "Can't allocate recipient list: %m\n"));
+	free(rcptbuf);
+	free(rcpts);
 	return -1;
     }
-    
-    host_info = gethostbyname(config_smtphost);
-    if (host_info == NULL)
-    {
-        DNETLOG((LOG_ERR, "Cannot resolve host name: %s\n", config_smtphost));
-        return -1;
-    }
-    
-    servent = getservbyname("smtp", "tcp");
-    if (servent != NULL)
-    {
-	port = ntohs(servent->s_port);
-    }
-    if (port == 0) port = 25;
-
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(port);
-    
-    serv_addr.sin_addr.s_addr = *(int*)host_info->h_addr_list[0];
-    
-    if (connect(smtpsock, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) == -1)
-    {
-	DNETLOG((LOG_ERR, "Cannot connect to SMTP server: %m\n"));
+    sprintf(rcptbuf, "%s,%s", addressees, cc_addressees);
+    for (addr = strtok_r(rcptbuf, ",", &p); addr; addr = strtok_r(NULL, ",", &p))
+	rcpts[nrcpts++] = addr;
+
+    sprintf(from, "%s@%s", config_vmsmailuser, config_hostname);
+    stat = smtp_begin(&conn, from, rcpts, nrcpts);
+    free(rcpts);
+    free(rcptbuf);
+    if (stat)
 	return -1;
-    }
-
-/* Send initial SMTP commands and swallow responses */
-    sockfile = fdopen(smtpsock, "a+");
-    if (smtp_response(sockfile) != 220) return smtp_error(sockfile);
-	
-    fprintf(sockfile, "HELO %s\n", config_hostname);
-    stat = smtp_response(sockfile);
-    if (stat == 220)
-	stat = smtp_response(sockfile);
-    if (stat != 250) return smtp_error(sockfile);
-    
-    fprintf(sockfile, "MAIL FROM: <%s@%s>\n",
-	    config_vmsmailuser, config_hostname);
-    if (smtp_response(sockfile) != 250) return smtp_error(sockfile);
-
-    addr = strtok(addressees, ",");
-    while(addr)
-    {
-	fprintf(sockfile, "RCPT TO:<%s>\n", addr);
-	if (smtp_response(sockfile) != 250) return smtp_error(sockfile);
-	
-	addr = strtok(NULL, ",");
-    }
-
-    addr = strtok(cc_addressees, ",");
-    while(addr)
-    {
-	fprintf(sockfile, "RCPT TO:<%s>\n", addr);
-	if (smtp_response(sockfile) != 250) return smtp_error(sockfile);
-	
-	addr = strtok(NULL, ",");
-    }
-    
-    fprintf(sockfile, "DATA\n");
-    if (smtp_response(sockfile) != 354) return smtp_error(sockfile);
 
     // Send the header
-    fprintf(sockfile, "From: %s@%s (%s::%s)\n",
+    fprintf(conn.out, "From: %s@%s (%s::%s)\n",
 	    config_vmsmailuser, config_hostname, remote_hostname,
 	    remote_user);
-    fprintf(sockfile, "Subject: %s\n", subject);
-    fprintf(sockfile, "To: %s\n", addressees);
-    fprintf(sockfile, "Cc: %s\n", cc_addressees);
+    fprintf(conn.out, "Subject: %s\n", subject);
+    fprintf(conn.out, "To: %s\n", addressees);
+    fprintf(conn.out, "Cc: %s\n", cc_addressees);
     if (is_binary)
     {
-	fprintf(sockfile, "Mime-Version: 1.0\n");
-	fprintf(sockfile, "Content-Type: application/octet-stream\n");
-	fprintf(sockfile, "Content-Transfer-Encoding: base64\n");
+	fprintf(conn.out, "Mime-Version: 1.0\n");
+	fprintf(conn.out, "Content-Type: application/octet-stream\n");
+	fprintf(conn.out, "Content-Transfer-Encoding: base64\n");
     }
-    fprintf(sockfile, "X-VMSmail: %s\n", full_user);
-    
-    fprintf(sockfile, "\n");
-    
-    send_body(sock, sockfile);
+    fprintf(conn.out, "X-VMSmail: %s\n", full_user);
 
-    fprintf(sockfile, ".\n");
-    if (smtp_response(sockfile) != 250) return smtp_error(sockfile);
-    
-    fprintf(sockfile, "QUIT\n");
-    if (smtp_response(sockfile) != 221) return smtp_error(sockfile);
+    fprintf(conn.out, "\n");
 
-    fclose(sockfile);
-    return 0;
+    // Don't let the relay deliver half a message
+    if (send_body(sock, conn.out))
+    {
+	smtp_abort(&conn);
+	return -1;
+    }
+
+    return smtp_end(&conn);
 }
 
 
@@ -398,13 +378,20 @@ int send_smail(int sock,
 	       char *full_user
     )
 {
-    char   buf[65536];
+    char  *buf;
     FILE  *mailpipe;
     int    stat;
-     
+
     // Open a pipe to sendmail.
+    buf = malloc(strlen(SENDMAIL_COMMAND) + strlen(addressees) + 4);
+    if (!buf)
+    {
+	DNETLOG((LOG_ERR, "Can't open pipe to sendmail: %m\n"));
+	return -1;
+    }
     sprintf(buf, "%s '%s'" , SENDMAIL_COMMAND, addressees);
     mailpipe = popen(buf, "w");
+    free(buf);
     if (mailpipe != NULL)
     {
 	// Send the header
@@ -438,36 +425,6 @@ int send_smail(int sock,
 }
 
 
-/*
-  Read a response from the MTA and return the code number
-  and the text of the response.
- */
-int smtp_response(FILE *sockstream)
-{
-    int   status;
-    int   len;
-    char  codestring[5];
-
-    if (fgets(response, sizeof(response), sockstream) == NULL)
-    {
-	strcpy(response, strerror(errno));
-	return 0;
-    }
-    
-    strncpy(codestring, response, 3);
-    codestring[3] = '\0';
-    status = atoi(codestring);
-
-    return status;
-}
-
-int smtp_error(FILE *sockstream)
-{
-    DNETLOG((LOG_ERR, "SMTP Error: %s\n", response));
-    fclose(sockstream);
-    return -1;
-}
-
 int send_with_nlreplacement(FILE *f, char *buf, int len, char nlchar)
 {
     int i,j;
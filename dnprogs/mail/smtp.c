@@ -0,0 +1,758 @@
+/******************************************************************************
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+ ******************************************************************************
+*/
+////
+// smtp.c
+// SMTP client for vmsmaild with a pool of relay connections.
+//
+// Each incoming VMS message is handled by its own vmsmaild process so
+// a connection to the relay can't just be kept in a variable. Instead,
+// when a message has been sent, the connection is passed (SCM_RIGHTS)
+// to a small holder process listening on an abstract Unix socket. The
+// next vmsmaild asks the holder for it and carries on with MAIL FROM.
+// The holder is started by the first vmsmaild that finds it missing,
+// resolves the relay address once, QUITs connections that have been
+// idle for smtppool seconds and exits when it has nothing left to do.
+//
+// If the relay advertises PIPELINING the whole envelope goes in one
+// write and the replies are collected afterwards.
+////
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <signal.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+// Horrible hack for glibc 2.1+ which defines getnodebyname
+#if (__GLIBC__ >= 2 && __GLIBC_MINOR__ >= 1) || __GLIBC__ >= 3
+#define getnodebyname ipv6_getnodebyname
+#endif
+
+#include <netdb.h>
+
+#if (__GLIBC__ >= 2 && __GLIBC_MINOR__ >= 1) || __GLIBC__ >= 3
+#undef getnodebyname
+#endif
+
+#include <netinet/in.h>
+#include <netdnet/dnetdb.h>
+#include "configfile.h"
+#include "smtp.h"
+
+#define SMTP_TIMEOUT 300  /* RFC 5321 minimum for most replies */
+#define MAX_IDLE       8
+
+/* Messages between vmsmaild and the pool holder */
+#define POOL_GET  1   /* Want a connection, no fd */
+#define POOL_PUT  2   /* Finished with a connection, fd attached */
+#define POOL_HIT  3   /* Here's one, fd attached */
+#define POOL_MISS 4   /* Connect yourself, addr is the relay's */
+#define POOL_QUIT 5   /* Close everything and exit */
+
+struct pool_msg
+{
+    int       type;
+    int       pipelining;
+    socklen_t addrlen;    /* 0 if the holder couldn't resolve the relay */
+    struct sockaddr_storage addr;
+};
+
+struct idle_conn
+{
+    int    fd;
+    int    pipelining;
+    time_t parked;
+};
+
+int smtp_use_pipelining = 1;
+static char smtp_reply[1024];
+
+// smtphost can be "host" or "host:port"
+static int resolve_relay(struct sockaddr_storage *addr, socklen_t *len)
+{
+    char  host[1024];
+    char *port = "smtp";
+    char *colon;
+    struct addrinfo hints;
+    struct addrinfo *res;
+    int   stat;
+
+    strcpy(host, config_smtphost);
+    colon = strchr(host, ':');
+    if (colon && !strchr(colon+1, ':'))
+    {
+	*colon = '\0';
+	port = colon+1;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    stat = getaddrinfo(host, port, &hints, &res);
+
+    // No smtp in /etc/services
+    if (stat == EAI_SERVICE && strcmp(port, "smtp") == 0)
+	stat = getaddrinfo(host, "25", &hints, &res);
+
+    if (stat)
+    {
+        DNETLOG((LOG_ERR, "Cannot resolve host name: %s: %s\n",
+		 config_smtphost, gai_strerror(stat)));
+        return -1;
+    }
+    memcpy(addr, res->ai_addr, res->ai_addrlen);
+    *len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return 0;
+}
+
+// One holder per user and relay
+static socklen_t pool_address(struct sockaddr_un *sun)
+{
+    unsigned int hash = 5381;
+    char *p;
+
+    for (p = config_smtphost; *p; p++)
+	hash = hash*33 + (unsigned char)*p;
+
+    memset(sun, 0, sizeof(*sun));
+    sun->sun_family = AF_UNIX;
+
+    // Abstract namespace: leading NUL, not NUL-terminated
+    snprintf(sun->sun_path+1, sizeof(sun->sun_path)-1, "vmsmaild.smtp.%d.%08x",
+	     (int)getuid(), hash);
+    return offsetof(struct sockaddr_un, sun_path) + 1 + strlen(sun->sun_path+1);
+}
+
+static int pool_send(int sock, struct pool_msg *msg, int fd)
+{
+    struct msghdr mh;
+    struct iovec iov;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+
+    memset(&mh, 0, sizeof(mh));
+    iov.iov_base = msg;
+    iov.iov_len = sizeof(*msg);
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+
+    if (fd != -1)
+    {
+	struct cmsghdr *cmsg;
+
+	memset(cbuf, 0, sizeof(cbuf));
+	mh.msg_control = cbuf;
+	mh.msg_controllen = sizeof(cbuf);
+	cmsg = CMSG_FIRSTHDR(&mh);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    return sendmsg(sock, &mh, MSG_NOSIGNAL) == (ssize_t)sizeof(*msg);
+}
+
+static int pool_recv(int sock, struct pool_msg *msg, int *fd)
+{
+    struct msghdr mh;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    ssize_t len;
+
+    *fd = -1;
+    memset(&mh, 0, sizeof(mh));
+    iov.iov_base = msg;
+    iov.iov_len = sizeof(*msg);
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = cbuf;
+    mh.msg_controllen = sizeof(cbuf);
+
+    len = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+    if (len <= 0)
+	return 0;
+
+    for (cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg))
+    {
+	if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+	    memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+
+    if (len != (ssize_t)sizeof(*msg) || (mh.msg_flags & MSG_CTRUNC))
+    {
+	if (*fd != -1) close(*fd);
+	*fd = -1;
+	return 0;
+    }
+    return 1;
+}
+
+static int peer_is_us(int sock)
+{
+    struct ucred cred;
+    socklen_t credlen = sizeof(cred);
+
+    return getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) == 0 &&
+	cred.uid == getuid();
+}
+
+static void set_timeout(int sock, int secs)
+{
+    struct timeval tv = {secs, 0};
+
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+static void drop_idle(struct idle_conn *idle, int *nidle, int i, int quit)
+{
+    if (quit)
+	write(idle[i].fd, "QUIT\r\n", 6);
+    close(idle[i].fd);
+    memmove(&idle[i], &idle[i+1], (*nidle-i-1)*sizeof(struct idle_conn));
+    (*nidle)--;
+}
+
+static void pool_holder(int lsock)
+{
+    struct idle_conn idle[MAX_IDLE];
+    struct pollfd pfds[MAX_IDLE+1];
+    struct sockaddr_storage relay;
+    socklen_t relaylen = 0;
+    time_t last_used = time(NULL);
+    int nidle = 0;
+
+    if (resolve_relay(&relay, &relaylen))
+	relaylen = 0;
+
+    for (;;)
+    {
+	time_t now = time(NULL);
+	time_t expires;
+	int i;
+
+	i = 0;
+	while (i < nidle)
+	{
+	    if (now - idle[i].parked >= config_smtppool)
+		drop_idle(idle, &nidle, i, 1);
+	    else
+		i++;
+	}
+
+	// Nothing to look after and nobody has wanted us for a while
+	if (!nidle && now - last_used >= config_smtppool)
+	    return;
+
+	// The oldest connection is the next one to expire
+	expires = nidle ? idle[0].parked : last_used;
+
+	pfds[0].fd = lsock;
+	pfds[0].events = POLLIN;
+	for (i = 0; i < nidle; i++)
+	{
+	    pfds[i+1].fd = idle[i].fd;
+	    pfds[i+1].events = POLLIN;
+	}
+
+	if (poll(pfds, nidle+1, (expires + config_smtppool - now) * 1000) < 0)
+	{
+	    if (errno == EINTR) continue;
+	    DNETLOG((LOG_ERR, "smtp pool: poll: %m\n"));
+	    return;
+	}
+
+	// An idle relay connection should have nothing to say. If it
+	// has then it's gone away or is telling us it's about to (421).
+	for (i = nidle-1; i >= 0; i--)
+	{
+	    if (pfds[i+1].revents)
+		drop_idle(idle, &nidle, i, 0);
+	}
+
+	if (pfds[0].revents & POLLIN)
+	{
+	    struct pool_msg msg;
+	    int csock;
+	    int fd;
+
+	    csock = accept(lsock, NULL, NULL);
+	    if (csock == -1)
+		continue;
+	    last_used = time(NULL);
+
+	    // Relay connections are only for us
+	    if (!peer_is_us(csock))
+	    {
+		close(csock);
+		continue;
+	    }
+	    set_timeout(csock, 2);
+
+	    if (pool_recv(csock, &msg, &fd))
+	    {
+		switch (msg.type)
+		{
+		case POOL_GET:
+		    // Most recently used at the end
+		    if (nidle)
+		    {
+			msg.type = POOL_HIT;
+			msg.pipelining = idle[nidle-1].pipelining;
+			if (pool_send(csock, &msg, idle[nidle-1].fd))
+			    drop_idle(idle, &nidle, nidle-1, 0);
+		    }
+		    else
+		    {
+			msg.type = POOL_MISS;
+			msg.addrlen = relaylen;
+			memcpy(&msg.addr, &relay, sizeof(relay));
+			pool_send(csock, &msg, -1);
+		    }
+		    break;
+
+		case POOL_PUT:
+		    if (fd == -1)
+			break;
+		    if (nidle == MAX_IDLE)
+			drop_idle(idle, &nidle, 0, 1);
+		    idle[nidle].fd = fd;
+		    idle[nidle].pipelining = msg.pipelining;
+		    idle[nidle].parked = last_used;
+		    nidle++;
+		    fd = -1;
+		    break;
+
+		case POOL_QUIT:
+		    while (nidle)
+			drop_idle(idle, &nidle, 0, 1);
+		    close(csock);
+		    return;
+		}
+	    }
+	    if (fd != -1) close(fd);
+	    close(csock);
+	}
+    }
+}
+
+// Start a holder process on an already listening socket. It's
+// double-forked so nobody has to wait for it.
+static void start_holder(int lsock)
+{
+    pid_t pid;
+    int i;
+
+    pid = fork();
+    if (pid == 0)
+    {
+	if (fork() != 0)
+	    _exit(0);
+
+	setsid();
+	chdir("/");
+
+	// Don't keep the DECnet link, or anything else, open
+	for (i=0; i<FD_SETSIZE; i++)
+	    if (i != lsock) close(i);
+
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGCHLD, SIG_DFL);
+	pool_holder(lsock);
+	_exit(0);
+    }
+    if (pid > 0)
+	waitpid(pid, NULL, 0);
+}
+
+// Connect to the pool holder, starting one if there isn't one.
+static int pool_connect(int start)
+{
+    struct sockaddr_un sun;
+    socklen_t len = pool_address(&sun);
+    int sock;
+    int lsock;
+
+    sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (sock == -1)
+	return -1;
+
+    if (connect(sock, (struct sockaddr *)&sun, len) == -1)
+    {
+	if (!start)
+	{
+	    close(sock);
+	    return -1;
+	}
+
+	// If the bind fails someone else got there first, which is fine
+	lsock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (lsock != -1)
+	{
+	    if (bind(lsock, (struct sockaddr *)&sun, len) == 0 &&
+		listen(lsock, 16) == 0)
+		start_holder(lsock);
+	    close(lsock);
+	}
+
+	if (connect(sock, (struct sockaddr *)&sun, len) == -1)
+	{
+	    close(sock);
+	    return -1;
+	}
+    }
+
+    // Anyone can bind an abstract name
+    if (!peer_is_us(sock))
+    {
+	close(sock);
+	return -1;
+    }
+    set_timeout(sock, 2);
+    return sock;
+}
+
+/* Read one line from the relay into line, without the CRLF */
+static int get_line(struct smtp_conn *c, char *line, int size)
+{
+    for (;;)
+    {
+	char *nl = memchr(c->buf, '\n', c->len);
+	int   n;
+
+	if (nl)
+	{
+	    n = nl - c->buf + 1;
+	    if (n > size)
+		n = size;
+	    memcpy(line, c->buf, n-1);
+	    line[n-1] = '\0';
+	    if (n > 1 && line[n-2] == '\r')
+		line[n-2] = '\0';
+	    c->len -= nl - c->buf + 1;
+	    memmove(c->buf, nl+1, c->len);
+	    return 0;
+	}
+
+	// Overlong line, lose it.
+	if (c->len == sizeof(c->buf))
+	    c->len = 0;
+
+	n = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len);
+	if (n == -1 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	{
+	    strcpy(smtp_reply, n ? strerror(errno) : "Connection closed");
+	    return -1;
+	}
+	c->len += n;
+    }
+}
+
+/*
+  Read a (possibly multi-line) reply from the MTA and return the code
+  number. The text of the last line is left in smtp_reply. If
+  pipelining is not NULL it is set if the reply advertises PIPELINING.
+ */
+static int read_reply(struct smtp_conn *c, int *pipelining)
+{
+    char line[1024];
+
+    do
+    {
+	if (get_line(c, line, sizeof(line)) == -1)
+	    return 0;
+
+	if (pipelining && strlen(line) > 4 &&
+	    strncasecmp(line+4, "PIPELINING", 10) == 0)
+	    *pipelining = 1;
+    }
+    while (strlen(line) > 3 && line[3] == '-');
+
+    strcpy(smtp_reply, line);
+    return atoi(line);
+}
+
+static void smtp_close(struct smtp_conn *c)
+{
+    if (c->out)
+	fclose(c->out);
+    if (c->fd != -1)
+	close(c->fd);
+    c->out = NULL;
+    c->fd = -1;
+}
+
+// Say hello to a new connection
+static int greet(struct smtp_conn *c)
+{
+    int stat;
+
+    if (read_reply(c, NULL) != 220)
+	return -1;
+
+    fprintf(c->out, "EHLO %s\r\n", config_hostname);
+    fflush(c->out);
+    stat = read_reply(c, &c->pipelining);
+    if (stat != 250)
+    {
+	// Not an ESMTP server
+	c->pipelining = 0;
+	fprintf(c->out, "HELO %s\r\n", config_hostname);
+	fflush(c->out);
+	stat = read_reply(c, NULL);
+    }
+    if (!smtp_use_pipelining)
+	c->pipelining = 0;
+    return stat == 250 ? 0 : -1;
+}
+
+// Get a connection from the pool or make a new one
+static int get_conn(struct smtp_conn *c, int fresh)
+{
+    struct pool_msg msg;
+    int psock;
+    int fd = -1;
+
+    memset(c, 0, sizeof(*c));
+    memset(&msg, 0, sizeof(msg));
+    c->fd = -1;
+    signal(SIGPIPE, SIG_IGN);
+
+    if (config_smtppool > 0 && !fresh && (psock = pool_connect(1)) != -1)
+    {
+	msg.type = POOL_GET;
+	if (pool_send(psock, &msg, -1) && pool_recv(psock, &msg, &fd))
+	{
+	    if (msg.type == POOL_HIT && fd != -1)
+	    {
+		close(psock);
+		c->fd = fd;
+		c->pipelining = msg.pipelining;
+		c->pooled = 1;
+		c->out = fdopen(dup(fd), "w");
+		if (c->out)
+		    return 0;
+		smtp_close(c);
+		return -1;
+	    }
+	    if (fd != -1) close(fd);
+	}
+	close(psock);
+    }
+
+    if (msg.type != POOL_MISS || msg.addrlen == 0)
+    {
+	if (resolve_relay(&msg.addr, &msg.addrlen))
+	    return -1;
+    }
+
+    c->fd = socket(msg.addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (c->fd == -1)
+    {
+	DNETLOG((LOG_ERR, "Can't open socket for SMTP: %m\n"));
+	return -1;
+    }
+
+    if (connect(c->fd, (struct sockaddr *)&msg.addr, msg.addrlen) == -1)
+    {
+	DNETLOG((LOG_ERR, "Cannot connect to SMTP server: %m\n"));
+	smtp_close(c);
+	return -1;
+    }
+    set_timeout(c->fd, SMTP_TIMEOUT);
+
+    c->out = fdopen(dup(c->fd), "w");
+    if (!c->out || greet(c))
+    {
+	DNETLOG((LOG_ERR, "SMTP Error: %s\n", smtp_reply));
+	smtp_close(c);
+	return -1;
+    }
+    return 0;
+}
+
+/*
+  Send MAIL FROM, RCPT TO and DATA. Returns 0 if the relay is ready for
+  the message, -2 if the connection had gone away before we started,
+  otherwise -1.
+ */
+static int send_envelope(struct smtp_conn *c, char *from,
+			 char **rcpts, int nrcpts)
+{
+    char failure[1024] = "";
+    int  stat;
+    int  i;
+
+    fprintf(c->out, "MAIL FROM:<%s>\r\n", from);
+
+    if (c->pipelining)
+    {
+	// Send the whole envelope then collect the replies (RFC 2920)
+	for (i=0; i<nrcpts; i++)
+	    fprintf(c->out, "RCPT TO:<%s>\r\n", rcpts[i]);
+	fprintf(c->out, "DATA\r\n");
+	if (fflush(c->out) == EOF)
+	    return -2;
+
+	stat = read_reply(c, NULL);
+	if (stat == 0 || stat == 421)
+	    return -2;
+	if (stat != 250)
+	    strcpy(failure, smtp_reply);
+
+	for (i=0; i<nrcpts; i++)
+	{
+	    stat = read_reply(c, NULL);
+	    if (stat == 0)
+		return -1;
+	    if (stat != 250 && stat != 251 && !failure[0])
+		strcpy(failure, smtp_reply);
+	}
+
+	// If DATA was accepted anyway the only way out is to
+	// drop the connection, which the caller will do.
+	stat = read_reply(c, NULL);
+	if (failure[0])
+	    strcpy(smtp_reply, failure);
+	if (stat != 354 || failure[0])
+	    return -1;
+	return 0;
+    }
+
+    if (fflush(c->out) == EOF)
+	return -2;
+    stat = read_reply(c, NULL);
+    if (stat == 0 || stat == 421)
+	return -2;
+    if (stat != 250)
+	return -1;
+
+    for (i=0; i<nrcpts; i++)
+    {
+	fprintf(c->out, "RCPT TO:<%s>\r\n", rcpts[i]);
+	fflush(c->out);
+	stat = read_reply(c, NULL);
+	if (stat != 250 && stat != 251)
+	    return -1;
+    }
+
+    fprintf(c->out, "DATA\r\n");
+    fflush(c->out);
+    if (read_reply(c, NULL) != 354)
+	return -1;
+    return 0;
+}
+
+/*
+  Start a message. On success the header and body should be written to
+  c->out and then smtp_end() called.
+ */
+int smtp_begin(struct smtp_conn *c, char *from, char **rcpts, int nrcpts)
+{
+    int fresh = 0;
+    int stat;
+
+    for (;;)
+    {
+	if (get_conn(c, fresh))
+	    return -1;
+
+	stat = send_envelope(c, from, rcpts, nrcpts);
+	if (stat == 0)
+	    return 0;
+
+	// The relay may have timed out a pooled connection while it
+	// sat idle, that's not an error. Try again with a new one.
+	if (stat == -2 && c->pooled)
+	{
+	    smtp_close(c);
+	    fresh = 1;
+	    continue;
+	}
+
+	DNETLOG((LOG_ERR, "SMTP Error: %s\n", smtp_reply));
+	smtp_close(c);
+	return -1;
+    }
+}
+
+/* Finish a message and put the connection back in the pool */
+int smtp_end(struct smtp_conn *c)
+{
+    struct pool_msg msg;
+    int psock;
+
+    fprintf(c->out, ".\r\n");
+    if (fflush(c->out) == EOF || read_reply(c, NULL) != 250)
+    {
+	DNETLOG((LOG_ERR, "SMTP Error: %s\n", smtp_reply));
+	smtp_close(c);
+	return -1;
+    }
+
+    // Anything left over means we've lost track of the conversation
+    if (config_smtppool > 0 && c->len == 0 && (psock = pool_connect(1)) != -1)
+    {
+	memset(&msg, 0, sizeof(msg));
+	msg.type = POOL_PUT;
+	msg.pipelining = c->pipelining;
+	pool_send(psock, &msg, c->fd);
+	close(psock);
+    }
+    else
+    {
+	fprintf(c->out, "QUIT\r\n");
+	fflush(c->out);
+	read_reply(c, NULL);
+    }
+    smtp_close(c);
+    return 0;
+}
+
+/* Give up on a message. The relay will discard it when the connection
+   closes, which is the only way to get out of DATA. */
+void smtp_abort(struct smtp_conn *c)
+{
+    smtp_close(c);
+}
+
+/* Ask the pool holder, if there is one, to QUIT its connections and exit */
+void smtp_pool_shutdown(void)
+{
+    struct pool_msg msg;
+    int psock;
+
+    psock = pool_connect(0);
+    if (psock == -1)
+	return;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.type = POOL_QUIT;
+    pool_send(psock, &msg, -1);
+    close(psock);
+}
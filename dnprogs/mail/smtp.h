@@ -0,0 +1,22 @@
+/* smtp.h */
+#include <stdio.h>
+
+/* A connection to the SMTP relay. Connections that end cleanly are
+   handed to a pool holder process so that the next vmsmaild can use
+   them without connecting and saying EHLO again. */
+struct smtp_conn
+{
+    int   fd;
+    int   pipelining;  /* Relay does RFC 2920 PIPELINING */
+    int   pooled;      /* Came from the pool, might have gone stale */
+    int   len;         /* Bytes waiting in buf */
+    char  buf[1024];
+    FILE *out;         /* Commands and message text go here */
+};
+
+int  smtp_begin(struct smtp_conn *c, char *from, char **rcpts, int nrcpts);
+int  smtp_end(struct smtp_conn *c);
+void smtp_abort(struct smtp_conn *c);
+void smtp_pool_shutdown(void);
+
+extern int smtp_use_pipelining;
@@ -0,0 +1,248 @@
+/******************************************************************************
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+ ******************************************************************************
+*/
+////
+// smtpbench.c
+// smtpbench <count>: push messages through vmsmaild's SMTP code to a
+// loopback sink, first the old way (a new connection and lock-step
+// commands for each message) and then pooled and pipelined, and report
+// messages/second. Built alongside vmsmaild but not installed.
+////
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <signal.h>
+#include <unistd.h>
+#include <netdnet/dn.h>
+#include <netdnet/dnetdb.h>
+#include "configfile.h"
+#include "smtp.h"
+
+#define BENCH_RCPTS 5
+
+// Just enough of an SMTP server to swallow mail. Like a real server
+// that offers PIPELINING it only sends its replies when it has run out
+// of input, otherwise Nagle holds back every reply after the first.
+static void sink_session(int fd)
+{
+    char  in[8192];
+    char  out[4096];
+    int   inlen = 0;
+    int   outlen;
+    int   data = 0;
+    int   quit = 0;
+    int   n;
+
+    outlen = sprintf(out, "220 localhost vmsmaild benchmark sink\r\n");
+    write(fd, out, outlen);
+    while (!quit && (n = read(fd, in+inlen, sizeof(in)-inlen)) > 0)
+    {
+	char *line = in;
+	char *eol;
+
+	inlen += n;
+	outlen = 0;
+	while ((eol = memchr(line, '\n', in+inlen-line)))
+	{
+	    char *reply = NULL;
+
+	    *eol = '\0';
+	    if (data)
+	    {
+		if (strcmp(line, ".\r") == 0 || strcmp(line, ".") == 0)
+		{
+		    data = 0;
+		    reply = "250 Ok\r\n";
+		}
+	    }
+	    else if (strncasecmp(line, "EHLO", 4) == 0)
+		reply = "250-localhost\r\n250 PIPELINING\r\n";
+	    else if (strncasecmp(line, "DATA", 4) == 0)
+	    {
+		reply = "354 End data with <CR><LF>.<CR><LF>\r\n";
+		data = 1;
+	    }
+	    else if (strncasecmp(line, "QUIT", 4) == 0)
+	    {
+		reply = "221 Bye\r\n";
+		quit = 1;
+	    }
+	    else
+		reply = "250 Ok\r\n";
+
+	    if (reply && outlen + strlen(reply) < sizeof(out))
+	    {
+		strcpy(out+outlen, reply);
+		outlen += strlen(reply);
+	    }
+	    line = eol+1;
+	}
+	inlen -= line-in;
+	memmove(in, line, inlen);
+	if (inlen == sizeof(in))
+	    inlen = 0;  // Overlong line, nobody cares here
+	if (outlen)
+	    write(fd, out, outlen);
+    }
+    exit(0);
+}
+
+static pid_t start_sink(int *port)
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+    pid_t pid;
+    int one = 1;
+    int lsock;
+
+    lsock = socket(AF_INET, SOCK_STREAM, 0);
+    if (lsock == -1)
+    {
+	perror("benchmark sink");
+	return -1;
+    }
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(lsock, (struct sockaddr *)&sin, sizeof(sin)) == -1 ||
+	listen(lsock, 128) == -1 ||
+	getsockname(lsock, (struct sockaddr *)&sin, &len) == -1)
+    {
+	perror("benchmark sink");
+	close(lsock);
+	return -1;
+    }
+    *port = ntohs(sin.sin_port);
+
+    pid = fork();
+    if (pid == 0)
+    {
+	signal(SIGCHLD, SIG_IGN);
+	for (;;)
+	{
+	    int fd = accept(lsock, NULL, NULL);
+
+	    if (fd == -1)
+		continue;
+	    if (fork() == 0)
+	    {
+		close(lsock);
+		sink_session(fd);
+	    }
+	    close(fd);
+	}
+    }
+    close(lsock);
+    return pid;
+}
+
+static int run(char *name, int count)
+{
+    struct smtp_conn c;
+    struct timeval start, end;
+    char   from[2048];
+    char   addr[BENCH_RCPTS][32];
+    char  *rcpts[BENCH_RCPTS];
+    double secs;
+    int    i, j;
+
+    sprintf(from, "%s@%s", config_vmsmailuser, config_hostname);
+    for (i=0; i<BENCH_RCPTS; i++)
+    {
+	sprintf(addr[i], "user%d@localhost", i);
+	rcpts[i] = addr[i];
+    }
+
+    gettimeofday(&start, NULL);
+    for (i=0; i<count; i++)
+    {
+	if (smtp_begin(&c, from, rcpts, BENCH_RCPTS))
+	{
+	    fprintf(stderr, "%s: message %d failed\n", name, i);
+	    return -1;
+	}
+	fprintf(c.out, "From: %s (BENCH::SYSTEM)\n", from);
+	fprintf(c.out, "Subject: benchmark message %d\n", i);
+	fprintf(c.out, "To: user0@localhost\n\n");
+	for (j=0; j<30; j++)
+	    fprintf(c.out, "This is line %d of a typical distribution list message.\n", j);
+	if (smtp_end(&c))
+	{
+	    fprintf(stderr, "%s: message %d failed\n", name, i);
+	    return -1;
+	}
+    }
+    gettimeofday(&end, NULL);
+
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+    printf("%-24s %6d messages in %7.3fs  %8.1f msgs/sec\n",
+	   name, count, secs, count / secs);
+    return 0;
+}
+
+static int smtp_benchmark(int count)
+{
+    int   saved_pool = config_smtppool;
+    int   port;
+    int   stat;
+    pid_t sink;
+
+    sink = start_sink(&port);
+    if (sink == -1)
+	return -1;
+    sprintf(config_smtphost, "127.0.0.1:%d", port);
+    signal(SIGCHLD, SIG_DFL);
+
+    printf("\nSMTP relay benchmark: loopback sink on port %d, %d recipients per message\n\n",
+	   port, BENCH_RCPTS);
+
+    config_smtppool = 0;
+    smtp_use_pipelining = 0;
+    stat = run("new connection, lockstep", count);
+
+    if (stat == 0)
+    {
+	config_smtppool = saved_pool > 0 ? saved_pool : 30;
+	smtp_use_pipelining = 1;
+	stat = run("pooled, pipelined", count);
+	smtp_pool_shutdown();
+    }
+    printf("\n");
+
+    kill(sink, SIGTERM);
+    waitpid(sink, NULL, 0);
+    return stat;
+}
+
+int main(int argc, char *argv[])
+{
+    int count;
+
+    if (argc != 2 || (count = atoi(argv[1])) < 1)
+    {
+	fprintf(stderr, "usage: %s <count>\n", argv[0]);
+	return 2;
+    }
+
+    read_configfile();
+    init_daemon_logging("smtpbench", 'e');
+    return smtp_benchmark(count) ? 1 : 0;
+}
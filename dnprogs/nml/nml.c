@@ -432,7 +432,7 @@ static int get_neighbour_nodes(int sock, neigh_fn_t neigh_fn)
 static int send_all_nodes(int sock, unsigned char perm_only)
 {
         void *nodelist;
-        char *nodename;
+        struct nodeent *n;
 
         send_exec(sock);
 
@@ -443,13 +443,12 @@ static int send_all_nodes(int sock, unsigned char perm_only)
 
         /* Now iterate the permanent database */
         nodelist = dnet_getnode();
-        nodename = dnet_nextnode(nodelist);
-        while (nodename)
-        {
-                struct nodeent *n = getnodebyname(nodename);
+        if (!nodelist)
+                return 0;
 
+        while ((n = dnet_nextnodeent(nodelist)))
+        {
                 send_node(sock, n, 0, NULL, adjacent_node(n)?NODESTATE_REACHABLE:NODESTATE_UNKNOWN);
-                nodename = dnet_nextnode(nodelist);
         }
         dnet_endnode(nodelist);
         return 0;
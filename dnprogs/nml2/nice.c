@@ -18,7 +18,10 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <string.h>
+#include <errno.h>
 #include <syslog.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <netdnet/dn.h>
 #include <netdnet/dnetdb.h>
 #include "nice.h"
@@ -28,8 +31,23 @@ extern int verbosity;
 /*
  * All access to the outbound NICE response buffer MUST go through these
  * routines.
+ *
+ * Responses are built in a queue of message buffers rather than being
+ * written one at a time. Once half the queue is in use we hand whatever
+ * the link will accept to the kernel with a single sendmmsg(), one NSP
+ * message per response, and carry on building the following responses
+ * while those wait for flow control credit. We only block when the
+ * queue is full or before reading the next request.
  */
-static unsigned char outbuf[512], inbuf[512];
+#define NICE_OUTQ_DEPTH         32
+
+static struct {
+  unsigned char data[512];
+  int len;
+} outq[NICE_OUTQ_DEPTH];
+static int outq_head, outq_count;
+
+static unsigned char *outbuf, inbuf[512];
 static int outptr, inptr;
 static ssize_t inlen;
 static int sock;
@@ -42,9 +60,61 @@ void NICEinit(
 )
 {
   sock = insock;
+  outq_head = outq_count = 0;
+  outbuf = outq[0].data;
   outptr = 0;
 }
 
+/*
+ * Send queued responses. If wait is FALSE only send as many as the link
+ * will take without blocking.
+ */
+static void NICEsend(
+  int wait
+)
+{
+  struct mmsghdr msgs[NICE_OUTQ_DEPTH];
+  struct iovec iov[NICE_OUTQ_DEPTH];
+
+  while (outq_count) {
+    int i, sent;
+
+    memset(msgs, 0, outq_count * sizeof(struct mmsghdr));
+    for (i = 0; i < outq_count; i++) {
+      int slot = (outq_head + i) % NICE_OUTQ_DEPTH;
+
+      iov[i].iov_base = outq[slot].data;
+      iov[i].iov_len = outq[slot].len;
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    sent = sendmmsg(sock, msgs, outq_count, wait ? 0 : MSG_DONTWAIT);
+    if (sent < 0) {
+      if (errno == EINTR)
+        continue;
+      if (!wait && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        return;
+
+      /*
+       * The link has gone, throw away anything we still have. The next
+       * read will notice and shut down.
+       */
+      dnetlog(LOG_WARNING, "Discarding %d NICE response(s): %s\n",
+              outq_count, strerror(errno));
+      outq_head = (outq_head + outq_count) % NICE_OUTQ_DEPTH;
+      outq_count = 0;
+      return;
+    }
+
+    outq_head = (outq_head + sent) % NICE_OUTQ_DEPTH;
+    outq_count -= sent;
+
+    if (!wait)
+      return;
+  }
+}
+
 /*
  * Flush any data in the outbound buffer
  */
@@ -64,11 +134,41 @@ void NICEflush(void)
       
       dnetlog(LOG_DEBUG, "%s\n", buf);
     }
-    write(sock, outbuf, outptr);
+    outq[(outq_head + outq_count) % NICE_OUTQ_DEPTH].len = outptr;
+    outq_count++;
+
+    if (outq_count == NICE_OUTQ_DEPTH)
+      NICEsend(TRUE);
+    else if (outq_count >= NICE_OUTQ_DEPTH / 2)
+      NICEsend(FALSE);
+
+    outbuf = outq[(outq_head + outq_count) % NICE_OUTQ_DEPTH].data;
   }
   outptr = 0;
 }
 
+/*
+ * Send whatever is still queued before the link is closed
+ */
+void NICEclose(void)
+{
+  NICEflush();
+  NICEsend(TRUE);
+}
+
+/*
+ * Queue a complete, fixed response message
+ */
+static void NICEresponse(
+  char *msg,
+  int len
+)
+{
+  memcpy(&outbuf[outptr], msg, len);
+  outptr += len;
+  NICEflush();
+}
+
 /*
  * Write parameter + data to outbound buffer
  */
@@ -250,7 +350,7 @@ void NICEformatResponse(void)
 {
   char imf[3] = { NICE_RET_INVALID, 0, 0 };
 
-  write(sock, imf, sizeof(imf));
+  NICEresponse(imf, sizeof(imf));
 }
 
 /*
@@ -260,7 +360,7 @@ void NICEunsupportedResponse(void)
 {
   char unsupp[3] = { NICE_RET_UNRECOG, 0, 0 };
 
-  write(sock, unsupp, sizeof(unsupp));
+  NICEresponse(unsupp, sizeof(unsupp));
 }
 
 /*
@@ -270,7 +370,7 @@ void NICEtoolongResponse(void)
 {
   char toolong[3] = { NICE_RET_TOOLONG, 0, 0 };
 
-  write(sock, toolong, sizeof(toolong));
+  NICEresponse(toolong, sizeof(toolong));
 }
 
 /*
@@ -283,7 +383,7 @@ void NICEunrecognizedComponentResponse(
   char unrecog[3] = { NICE_RET_BADCOMPONENT, 0, 0 };
 
   unrecog[1] = component;
-  write(sock, &unrecog, sizeof(unrecog));
+  NICEresponse(unrecog, sizeof(unrecog));
 }
 
 /*
@@ -293,7 +393,7 @@ void NICEacceptedResponse(void)
 {
   char accepted = NICE_RET_ACCEPTED;
 
-  write(sock, &accepted, sizeof(accepted));
+  NICEresponse(&accepted, sizeof(accepted));
 }
 
 /*
@@ -303,7 +403,7 @@ void NICEpartialResponse(void)
 {
   char partial = NICE_RET_PARTIAL;
 
-  write(sock, &partial, sizeof(partial));
+  NICEresponse(&partial, sizeof(partial));
 }
 
 /*
@@ -323,7 +423,7 @@ void NICEdoneResponse(void)
 {
   char done = NICE_RET_DONE;
 
-  write(sock, &done, sizeof(done));
+  NICEresponse(&done, sizeof(done));
 }
 
 /*
@@ -331,6 +431,11 @@ void NICEdoneResponse(void)
  */
 int NICEread(void)
 {
+  /*
+   * Everything we have queued must go before we wait for the next request
+   */
+  NICEsend(TRUE);
+
   inlen = read(sock, inbuf, sizeof(inbuf));
   inptr = 0;
 
@@ -725,6 +725,7 @@
 
 extern void NICEinit(int);
 extern void NICEflush(void);
+extern void NICEclose(void);
 extern void NICEparamDU1(uint16_t, uint8_t);
 extern void NICEparamDU2(uint16_t, uint16_t);
 extern void NICEparamAIn(uint16_t, char *);
@@ -53,11 +53,19 @@ static struct links {
 } links[MAX_ACTIVE_NODES];
 static uint16_t num_nodes = 0, num_links = 0;
 
-#define MAX_NODES               65536
-uint16_t knownaddr[MAX_NODES + 1];
-uint16_t nodecount;
-
 #define MAX_NODEADDRESS         65536
+
+/*
+ * Node addresses which are relevant to a multi-node request, one bit per
+ * address so that duplicates cost nothing and walking the map returns
+ * them in ascending order. Names are saved for nodes found in the node
+ * database so we don't have to look them up again.
+ */
+static uint8_t knownmap[MAX_NODEADDRESS / 8];
+static char *knownname[MAX_NODEADDRESS];
+
+#define NODE_KNOWN(addr)        (knownmap[(addr) >> 3] & (1 << ((addr) & 7)))
+
 uint16_t nexthop[MAX_NODEADDRESS];
 
 /*
@@ -230,33 +238,32 @@ uint8_t active_connections(
  * already present.
  */
 static void add_to_node_table(
-  uint16_t addr
+  uint16_t addr,
+  char *name
 )
 {
-  int i;
-
-  for (i = 0; i < nodecount; i++)
-    if (knownaddr[i] == addr)
-        return;
+  knownmap[addr >> 3] |= 1 << (addr & 7);
 
-  if (nodecount < MAX_NODES)
-    knownaddr[nodecount++] = addr;
+  if (name && !knownname[addr])
+    knownname[addr] = strdup(name);
 }
 
-static int nodecompare(
-  const void *paddr1,
-  const void *paddr2
-)
+/*
+ * Empty the node address table, releasing any saved names.
+ */
+static void clear_node_table(void)
 {
-  uint16_t addr1 = *((uint16_t *)paddr1);
-  uint16_t addr2 = *((uint16_t *)paddr2);
+  int i, bit;
 
-  if (addr1 != addr2) {
-    if (addr1 < addr2)
-      return -1;
-    return 1;
+  for (i = 0; i < sizeof(knownmap); i++) {
+    if (knownmap[i]) {
+      for (bit = 0; bit < 8; bit++) {
+        free(knownname[(i << 3) | bit]);
+        knownname[(i << 3) | bit] = NULL;
+      }
+      knownmap[i] = 0;
+    }
   }
-  return 0;
 }
 
 /*
@@ -269,42 +276,36 @@ static void build_node_table(
 {
   int i;
 
-  nodecount = 0;
+  clear_node_table();
 
   /*
    * Start with those nodes which have active logical links
    */
   for (i = 0; i < num_nodes; i++)
-    knownaddr[nodecount++] = links[i].addr;
+    add_to_node_table(links[i].addr, NULL);
 
   /*
    * ACTIVE and KNOWN nodes include the designated router is any.
    */
   if ((entity == NICE_NFMT_ACTIVE) || (entity == NICE_NFMT_KNOWN))
     if (router)
-      add_to_node_table(router);
+      add_to_node_table(router, routername[0] ? routername : NULL);
 
   /*
-   * KNOWN nodes includes any named nodes.
+   * KNOWN nodes includes any named nodes. A single pass over the node
+   * database gives us both the names and the addresses.
    */
   if (entity == NICE_NFMT_KNOWN) {
     void *opaque = dnet_getnode();
-    char *nodename = dnet_nextnode(opaque);
 
-    while (nodename) {
-      struct nodeent *dp = getnodebyname(nodename);
-      
-      add_to_node_table(*((uint16_t *)dp->n_addr));
-      nodename = dnet_nextnode(opaque);
+    if (opaque) {
+      struct nodeent *dp;
+
+      while ((dp = dnet_nextnodeent(opaque)) != NULL)
+        add_to_node_table(*((uint16_t *)dp->n_addr), dp->n_name);
+      dnet_endnode(opaque);
     }
-    dnet_endnode(opaque);
   }
-
-  /*
-   * Now we sort the array to get it into ascending order
-   */
-  if (nodecount)
-    qsort(knownaddr, nodecount, sizeof(uint16_t), nodecompare);
 }
 
 /*
@@ -423,36 +424,32 @@ static void read_node_executor(
 }
 
 /*
- * Process read information requests about a single node
+ * Return the name of a node, using the node address table if it has one.
  */
-static void read_node_single(
-  uint16_t address,
-  char *name,
-  unsigned char how
+static char *node_name(
+  uint16_t address
 )
 {
   struct nodeent *dp;
-  uint16_t next;
-  
-  /*
-   * If we only have a nodename, try to get it's associated address. If this
-   * fails we just have to give up. If we only have a nodeaddress, try to
-   * find it's associated name. We can continue if this fails.
-   */
-  if (name) {
-    int i;
 
-    for (i = 0; name[i]; i++)
-      name[i] = tolower(name[i]);
+  if (knownname[address])
+    return knownname[address];
 
-    if ((dp = getnodebyname(name)) == NULL)
-      return;
+  if ((dp = getnodebyaddr((char *)&address, 2, PF_DECnet)) != NULL)
+    return dp->n_name;
+  return NULL;
+}
 
-    address = *((uint16_t *)dp->n_addr);
-  } else {
-    if ((dp = getnodebyaddr((char *)&address, 2, PF_DECnet)) != NULL)
-      name = dp->n_name;
-  }
+/*
+ * Send the information about a node whose address and name are known.
+ */
+static void read_node_entry(
+  uint16_t address,
+  char *name,
+  unsigned char how
+)
+{
+  uint16_t next;
 
   if (address == localaddr) {
     read_node_executor(how);
@@ -483,11 +480,8 @@ static void read_node_single(
         if (next) {
           char *nextname = routername;
 
-          if (next != router) {
-            if ((dp = getnodebyaddr((char *)&next, 2, PF_DECnet)) != NULL)
-              nextname = dp->n_name;
-            else nextname = NULL;
-          }
+          if (next != router)
+            nextname = node_name(next);
           NICEparamNodeID(NICE_P_N_NEXTNODE, next, nextname);
         }
       }
@@ -500,6 +494,37 @@ static void read_node_single(
   }
 }
 
+/*
+ * Process read information requests about a single node
+ */
+static void read_node_single(
+  uint16_t address,
+  char *name,
+  unsigned char how
+)
+{
+  struct nodeent *dp;
+
+  /*
+   * If we only have a nodename, try to get it's associated address. If this
+   * fails we just have to give up. If we only have a nodeaddress, try to
+   * find it's associated name. We can continue if this fails.
+   */
+  if (name) {
+    int i;
+
+    for (i = 0; name[i]; i++)
+      name[i] = tolower(name[i]);
+
+    if ((dp = getnodebyname(name)) == NULL)
+      return;
+
+    address = *((uint16_t *)dp->n_addr);
+  } else name = node_name(address);
+
+  read_node_entry(address, name, how);
+}
+
 /*
  * Process read information requests about, potentially, multiple nodes
  */
@@ -508,7 +533,7 @@ static void read_node_multi(
   unsigned char how
 )
 {
-  int i;
+  int i, bit;
 
   build_node_table(subset);
 
@@ -521,11 +546,20 @@ static void read_node_multi(
     read_node_executor(how);
 
   /*
-   * Iterate over the table of addressses.
+   * Iterate over the table of addressses, responses are sent as we go.
    */
-  for (i = 0; i < nodecount; i++)
-    if (knownaddr[i] != localaddr)
-      read_node_single(knownaddr[i], NULL, how);
+  for (i = 0; i < sizeof(knownmap); i++) {
+    if (knownmap[i] == 0)
+      continue;
+
+    for (bit = 0; bit < 8; bit++) {
+      uint16_t addr = (i << 3) | bit;
+
+      if (NODE_KNOWN(addr) && (addr != localaddr))
+        read_node_entry(addr, node_name(addr), how);
+    }
+  }
+  clear_node_table();
 }
 
 /*
@@ -786,6 +820,7 @@ void process_request(
       }
     }
   }
+  NICEclose();
   close(sock);
 }
 
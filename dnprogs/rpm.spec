@@ -31,6 +31,7 @@ that use the DECnet protocol
 %%PREFIX%%/bin/dntask
 %%PREFIX%%/bin/dndel
 %%PREFIX%%/bin/dndir
+%%PREFIX%%/bin/dapbroker
 %%PREFIX%%/bin/dnprint
 %%PREFIX%%/bin/dnsubmit
 %%PREFIX%%/bin/sethost
@@ -48,6 +49,7 @@ that use the DECnet protocol
 %%PREFIX%%/sbin/dnroute
 %%PREFIX%%/sbin/dnetinfo
 %%PREFIX%%/sbin/dneigh
+%%PREFIX%%/sbin/dnl1
 %%PREFIX%%/sbin/decnetconf
 %%PREFIX%%/sbin/setether
 %%PREFIX%%/sbin/sendvmsmail
@@ -61,6 +63,7 @@ that use the DECnet protocol
 %%PREFIX%%/share/man/man1/dntask.1.gz
 %%PREFIX%%/share/man/man1/dndel.1.gz
 %%PREFIX%%/share/man/man1/dndir.1.gz
+%%PREFIX%%/share/man/man1/dapbroker.1.gz
 %%PREFIX%%/share/man/man1/dnprint.1.gz
 %%PREFIX%%/share/man/man1/dnsubmit.1.gz
 %%PREFIX%%/share/man/man1/sethost.1.gz
@@ -77,6 +80,7 @@ that use the DECnet protocol
 %%PREFIX%%/share/man/man8/dnroute.8.gz
 %%PREFIX%%/share/man/man8/dnetinfo.8.gz
 %%PREFIX%%/share/man/man8/dneigh.8.gz
+%%PREFIX%%/share/man/man8/dnl1.8.gz
 %%PREFIX%%/share/man/man8/phoned.8.gz
 %%PREFIX%%/share/man/man8/dnetd.8.gz
 %%PREFIX%%/share/man/man8/ctermd.8.gz
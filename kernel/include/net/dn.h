@@ -5,9 +5,24 @@
 #include <linux/dn.h>
 #include <net/sock.h>
 #include <net/flow.h>
+#include <linux/hrtimer.h>
 #include <asm/byteorder.h>
 #include <asm/unaligned.h>
 
+/*
+ * DAP DATA framing for sendfile()/splice(), set with setsockopt(DSO_DAPFRAME)
+ */
+#ifndef DSO_DAPFRAME
+#define DSO_DAPFRAME    17
+struct dapframe_dn {
+        __u16   dfn_chunk;              /* Data bytes per DATA msg, 0=off */
+        __u16   dfn_bufsize;            /* Largest DAP record to send     */
+        __u32   dfn_flags;
+        __u32   dfn_recnum;             /* Next record number             */
+};
+#define DN_DAPFRAME_RECNUM 0x0001       /* Send a four byte RECNUM field  */
+#endif
+
 struct dn_scp                                   /* Session Control Port */
 {
         unsigned char           state;
@@ -92,9 +107,9 @@ struct dn_scp                                   /* Session Control Port */
          *             more complicated scheme when we support flow
          *             control.
          *
-         * nsp_srtt:   Round-Trip-Time (x8) in jiffies. This is a rolling
+         * nsp_srtt:   Round-Trip-Time (x8) in microseconds. This is a rolling
          *             average.
-         * nsp_rttvar: Round-Trip-Time-Varience (x4) in jiffies. This is the
+         * nsp_rttvar: Round-Trip-Time-Varience (x4) in microseconds. This is the
          *             varience of the smoothed average (but calculated in
          *             a simpler way than for normal statistical varience
          *             calculations).
@@ -108,11 +123,14 @@ struct dn_scp                                   /* Session Control Port */
 #define NSP_MAX_WINDOW (0x07fe)
         unsigned long max_window;
         unsigned long snd_window;
-#define NSP_INITIAL_SRTT (HZ)
+#define NSP_INITIAL_SRTT (USEC_PER_SEC)
         unsigned long nsp_srtt;
-#define NSP_INITIAL_RTTVAR (HZ*3)
+#define NSP_INITIAL_RTTVAR (USEC_PER_SEC*3)
         unsigned long nsp_rttvar;
+#define NSP_MAX_RTT (60 * USEC_PER_SEC)
+#define NSP_MAX_RTO (600ULL * NSEC_PER_SEC)
 #define NSP_MAXRXTSHIFT 12
+#define NSP_PMTU_RETRIES 3
         unsigned long nsp_rxtshift;
 
         /*
@@ -132,6 +150,29 @@ struct dn_scp                                   /* Session Control Port */
         struct sk_buff_head other_receive_queue;
         int other_report;
 
+        /*
+         * Connect initiates waiting for accept() on a listening socket.
+         * These are queued directly from dn_nsp_rx without taking the
+         * socket lock so that a listener busy in accept() doesn't push
+         * incoming connects onto the (size limited) socket backlog.
+         */
+        struct sk_buff_head conn_init_queue;
+        atomic_t ci_overflows;          /* CIs dropped, queue was full */
+        atomic_t ci_queued;             /* CIs queued since listen()   */
+        atomic_t ci_filtered;           /* CIs rejected by sk_filter   */
+
+        /*
+         * Retransmit timer for data, other data and link service
+         * messages in the RUN state. It runs from an hrtimer so that
+         * the timeout can follow the measured round trip time rather
+         * than the ticks of the slow timer. If the timer goes off while
+         * the socket is owned by the user, the retransmit is done from
+         * dn_release_cb().
+         */
+        struct hrtimer rxt_timer;
+        unsigned long deferred;
+#define DN_RXT_DEFERRED 0
+
         /*
          * Stuff to do with the slow timer
          */
@@ -144,8 +185,59 @@ struct dn_scp                                   /* Session Control Port */
 #define DN_KEEPALIVE	(10 * HZ)
         unsigned long ackdelay;
 	unsigned long conntimer;
+
+        /*
+         * Receive buffer autotuning. Bytes read by the application in
+         * the current and the busiest previous round trip, and when the
+         * current measurement started.
+         */
+        struct {
+                int             space;
+                int             copied;
+                unsigned long   time;
+        } rcvq_space;
+
+        /*
+         * DAP DATA framing of spliced data (DSO_DAPFRAME). dap_left is
+         * the data still owed to the DATA message that was started
+         * last and dap_rec the bytes sent so far in the current DAP
+         * record. Plain sends get -EBUSY while either is non-zero.
+         */
+        struct dapframe_dn dapframe;
+        unsigned int dap_left;
+        unsigned int dap_rec;
 };
 
+/*
+ * Listener statistics, returned by getsockopt(DSO_LISTENINFO)
+ */
+#ifndef DSO_LISTENINFO
+#define DSO_LISTENINFO  16
+struct listeninfo_dn {
+        __u32   ldn_backlog;            /* Maximum queued connects     */
+        __u32   ldn_qlen;               /* Connects waiting for accept */
+        __u32   ldn_queued;             /* Total connects queued       */
+        __u32   ldn_overflows;          /* Connects dropped, queue full */
+        __u32   ldn_filtered;           /* Connects rejected by filter */
+};
+
+/*
+ * What a socket filter attached to a listening socket sees of each
+ * connect initiate. The program returns 0 to reject the connect.
+ */
+struct cifilter_dn {
+        __u8    cfn_srcnode[2];         /* Remote node, high byte first */
+        __u8    cfn_dstobjnum;
+        __u8    cfn_dstobjnamel;
+        __u8    cfn_dstobjname[16];
+        __u8    cfn_srcobjnum;
+        __u8    cfn_srcobjnamel;
+        __u8    cfn_srcobjname[16];
+        __u8    cfn_userl;              /* Access control user name */
+        __u8    cfn_user[39];
+};
+#endif
+
 static inline struct dn_scp *DN_SK(struct sock *sk)
 {
         return (struct dn_scp *)(sk + 1);
@@ -184,7 +276,7 @@ struct dn_skb_cb {
         __u16 segsize;
         __u16 segnum;
         __u16 xmit_count;
-        unsigned long stamp;
+        ktime_t stamp;
         int iif;
 };
 
@@ -239,6 +331,11 @@ int dn_username2sockaddr(unsigned char *data, int len, struct sockaddr_dn *addr,
 
 void dn_start_slow_timer(struct sock *sk);
 void dn_stop_slow_timer(struct sock *sk);
+void dn_init_rxt_timer(struct sock *sk);
+void dn_start_rxt_timer(struct sock *sk, u64 timeout);
+void dn_arm_rxt_timer(struct sock *sk);
+void dn_stop_rxt_timer(struct sock *sk);
+void dn_release_cb(struct sock *sk);
 void dn_nsp_schedule_pending(struct sock *sk, int what);
 
 extern __le16 decnet_address;
@@ -249,6 +346,13 @@ extern int decnet_dr_count;
 extern int decnet_no_fc_max_cwnd;
 extern int decnet_dlyack_seq;
 extern int decnet_outgoing_timer;
+extern int decnet_moderate_rcvbuf;
+extern int decnet_moderate_sndbuf;
+extern int decnet_segbufsize;
+extern int decnet_pmtu_discovery;
+extern int decnet_rps_steer;
+extern int decnet_min_rto;
+extern int decnet_l1_routing;
 
 extern long sysctl_decnet_mem[3];
 extern int sysctl_decnet_wmem[3];
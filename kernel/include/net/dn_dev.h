@@ -77,6 +77,7 @@ struct dn_dev_parms {
         unsigned long t2;         /* Default value of t2                */
         unsigned long t3;         /* Default value of t3                */
         int priority;             /* Priority to be a router            */
+        int cost;                 /* Circuit cost for level 1 routing   */
         char *name;               /* Name for sysctl                    */
         int  (*up)(struct net_device *);
         void (*down)(struct net_device *);
@@ -101,6 +102,11 @@ struct dn_dev {
         unsigned long uptime;     /* Time device went up in jiffies */
         unsigned long listen;     /* Listen time from router hello */
 	unsigned int multiplier;  /* Listen multiplier */
+        struct list_head routers; /* Routers heard on circuit, best first */
+        unsigned int rtr_gen;     /* Bumped when routers list changes */
+        struct sk_buff *hello;    /* Last router hello we built */
+        unsigned int hello_gen;   /* rtr_gen when it was built */
+        __u32 hello_key[4];       /* Parameters it was built with */
 };
 
 struct dn_short_packet {
@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _NET_DN_L1ROUTE_H
+#define _NET_DN_L1ROUTE_H
+
+/*
+ * Generic netlink interface to the in-kernel level 1 decision process.
+ * dnprogs/dnroute/dnl1.h carries a copy of these for user space.
+ *
+ * Both commands are dumps. Node addresses are in host order
+ * (area << 10 | node), node 0 of our area stands for the nearest
+ * level 2 router.
+ */
+#define DNL1_GENL_NAME          "DECNET_L1"
+#define DNL1_GENL_VERSION       1
+
+enum {
+        DNL1_CMD_UNSPEC,
+        DNL1_CMD_GET_ADJ,       /* Adjacencies we have routing messages from */
+        DNL1_CMD_GET_ROUTE,     /* Our decision for each reachable node */
+        __DNL1_CMD_MAX,
+};
+#define DNL1_CMD_MAX (__DNL1_CMD_MAX - 1)
+
+enum {
+        DNL1_A_UNSPEC,
+        DNL1_A_IFINDEX,         /* u32: Circuit */
+        DNL1_A_ADDR,            /* u16: Adjacency or destination */
+        DNL1_A_GW,              /* u16: Next hop adjacency */
+        DNL1_A_HOPS,            /* u8 */
+        DNL1_A_COST,            /* u16 */
+        DNL1_A_EXPIRES,         /* u32: Milliseconds until adjacency is dropped */
+        DNL1_A_REACH,           /* u16: Nodes the adjacency can reach */
+        __DNL1_A_MAX,
+};
+#define DNL1_A_MAX (__DNL1_A_MAX - 1)
+
+#ifdef __KERNEL__
+#ifdef CONFIG_DECNET_L1ROUTE
+struct sk_buff;
+
+void dn_l1_rcv(struct sk_buff *skb);
+void dn_l1_init(void);
+void dn_l1_cleanup(void);
+#else
+#define dn_l1_init() do { } while(0)
+#define dn_l1_cleanup() do { } while(0)
+#endif
+#endif /* __KERNEL__ */
+
+#endif /* _NET_DN_L1ROUTE_H */
@@ -3,6 +3,8 @@
 #define _NET_DN_NEIGH_H
 #include <linux/if_ether.h>
 
+struct dn_dev;
+
 /*
  * The position of the first two fields of
  * this structure are critical - SJW
@@ -18,6 +20,9 @@ struct dn_neigh {
         unsigned long blksize;
         __u8 priority;
         char macaddr[ETH_ALEN];
+        struct list_head rtr_list;   /* On dn_dev->routers, best first */
+        unsigned long rtr_expires;   /* When we stop listing it        */
+        __u8 rtr_priority;           /* Where it goes in rtr_list      */
 };
 #define DN_ADDR(dn)     (*(__le16 *)((dn)->n.primary_key))
 
@@ -26,7 +31,9 @@ void dn_neigh_cleanup(void);
 int dn_neigh_router_hello(struct net *net, struct sock *sk, struct sk_buff *skb);
 int dn_neigh_endnode_hello(struct net *net, struct sock *sk, struct sk_buff *skb);
 void dn_neigh_pointopoint_hello(struct sk_buff *skb);
-int dn_neigh_elist(struct net_device *dev, unsigned char *ptr, int n);
+int dn_neigh_elist(struct dn_dev *dn_db, unsigned char *ptr, int n);
+void dn_neigh_rtr_expire(struct dn_dev *dn_db);
+void dn_neigh_rtr_flush(struct dn_dev *dn_db);
 int dn_to_neigh_output(struct net *net, struct sock *sk, struct sk_buff *skb);
 
 extern struct neigh_table dn_neigh_table;
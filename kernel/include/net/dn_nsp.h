@@ -32,7 +32,9 @@ int dn_nsp_check_xmit_queue(struct sock *sk, struct sk_buff *skb,
 void dn_nsp_queue_xmit(struct sock *sk, struct sk_buff *skb, gfp_t gfp,
 		       int oob);
 unsigned long dn_nsp_persist(struct sock *sk);
-int dn_nsp_xmit_timeout(struct sock *sk);
+u64 dn_nsp_cur_rto(struct sock *sk);
+u64 dn_nsp_rto(struct sock *sk);
+void dn_nsp_xmit_timeout(struct sock *sk);
 
 int dn_nsp_rx(struct sk_buff *);
 int dn_nsp_backlog_rcv(struct sock *sk, struct sk_buff *skb);
@@ -20,8 +20,10 @@ int dn_route_output_sock(struct dst_entry __rcu **pprt, struct flowidn *,
                          struct sock *sk, int flags);
 int dn_cache_dump(struct sk_buff *skb, struct netlink_callback *cb);
 void dn_rt_cache_flush(int delay);
+void dn_rt_reduce_pmtu(struct sock *sk, u32 mtu);
 int dn_route_rcv(struct sk_buff *skb, struct net_device *dev,
                  struct packet_type *pt, struct net_device *orig_dev);
+void dn_route_rps_flush(struct net_device *dev);
 
 /* Masks for flags field */
 #define DN_RT_F_PID 0x07 /* Mask for packet type                      */
@@ -120,6 +120,9 @@ Version 0.0.6    2.1.110   07-aug-98   Eduardo Marcelo Serrat
 #include <linux/swap.h>
 #include <linux/version.h>
 #include <net/sock.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,9,0)
+#include <net/rps.h>
+#endif
 #include <net/tcp_states.h>
 #include <net/flow.h>
 #include <asm/ioctls.h>
@@ -130,6 +133,7 @@ Version 0.0.6    2.1.110   07-aug-98   Eduardo Marcelo Serrat
 #include <linux/stat.h>
 #include <linux/init.h>
 #include <linux/poll.h>
+#include <linux/splice.h>
 #include <linux/jiffies.h>
 #include <net/net_namespace.h>
 #include <net/neighbour.h>
@@ -142,6 +146,7 @@ Version 0.0.6    2.1.110   07-aug-98   Eduardo Marcelo Serrat
 #include <net/dn_route.h>
 #include <net/dn_fib.h>
 #include <net/dn_neigh.h>
+#include <net/dn_l1route.h>
 
 #define MIN(a, b)       ((a) < (b) ? (a) : (b))
 
@@ -172,6 +177,17 @@ static int __dn_setsockopt(struct socket *sock, int level, int optname, sockptr_
 static int __dn_setsockopt(struct socket *sock, int level, int optname, char __user *optval, unsigned int optlen, int flags);
 #endif
 static int __dn_getsockopt(struct socket *sock, int level, int optname, char __user *optval, int __user *optlen, int flags);
+static unsigned int dn_dapframe_hdrlen(const struct dapframe_dn *df);
+
+/*
+ * Marks data from sendfile()/splice(), which DSO_DAPFRAME applies to.
+ * Older kernels come in through dn_sendpage() which sets it.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,5,0)
+#define MSG_DN_SPLICED MSG_SPLICE_PAGES
+#else
+#define MSG_DN_SPLICED MSG_SENDPAGE_NOTLAST
+#endif
 
 static struct hlist_head *dn_find_list(struct sock *sk)
 {
@@ -502,6 +518,7 @@ static void dn_destruct(struct sock *sk)
         skb_queue_purge(&scp->data_xmit_queue);
         skb_queue_purge(&scp->other_xmit_queue);
         skb_queue_purge(&scp->other_receive_queue);
+        skb_queue_purge(&scp->conn_init_queue);
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5,0,0)
         dst_release(rcu_dereference_check(sk->sk_dst_cache, 1));
@@ -533,6 +550,7 @@ static struct proto dn_proto = {
         .sysctl_rmem            = sysctl_decnet_rmem,
         .max_header             = DN_MAX_NSP_DATA_HEADER + 64,
         .obj_size               = sizeof(struct dn_sock),
+        .release_cb             = dn_release_cb,
 };
 
 static struct sock *dn_alloc_sock(struct net *net, struct socket *sock, gfp_t gfp, int kern)
@@ -603,6 +621,10 @@ static struct sock *dn_alloc_sock(struct net *net, struct socket *sock, gfp_t gf
         skb_queue_head_init(&scp->data_xmit_queue);
         skb_queue_head_init(&scp->other_xmit_queue);
         skb_queue_head_init(&scp->other_receive_queue);
+        skb_queue_head_init(&scp->conn_init_queue);
+        atomic_set(&scp->ci_overflows, 0);
+        atomic_set(&scp->ci_queued, 0);
+        atomic_set(&scp->ci_filtered, 0);
 
         scp->persist = 0;
 	scp->persist_count = 0;
@@ -612,6 +634,15 @@ static struct sock *dn_alloc_sock(struct net *net, struct socket *sock, gfp_t gf
         scp->ackdelay = 0;
 	scp->conntimer = 0;
 
+        scp->rcvq_space.space = 0;
+        scp->rcvq_space.copied = 0;
+        scp->rcvq_space.time = jiffies;
+
+        memset(&scp->dapframe, 0, sizeof(scp->dapframe));
+        scp->dap_left = 0;
+        scp->dap_rec = 0;
+
+        dn_init_rxt_timer(sk);
         dn_start_slow_timer(sk);
 out:
         return sk;
@@ -688,6 +719,7 @@ static void dn_destroy_sock(struct sock *sk)
         struct dn_scp *scp = DN_SK(sk);
 
         scp->nsp_rxtshift = 0; /* reset back off */
+        dn_stop_rxt_timer(sk);
 
         if (sk->sk_socket) {
                 if (sk->sk_socket->state != SS_UNCONNECTED)
@@ -1149,16 +1181,17 @@ static void dn_user_copy(struct sk_buff *skb, struct optdata_dn *opt)
 static struct sk_buff *dn_wait_for_connect(struct sock *sk, long *timeo)
 {
         DEFINE_WAIT(wait);
+        struct dn_scp *scp = DN_SK(sk);
         struct sk_buff *skb = NULL;
         int err = 0;
 
         prepare_to_wait(sk_sleep(sk), &wait, TASK_INTERRUPTIBLE);
         for(;;) {
                 release_sock(sk);
-                skb = skb_dequeue(&sk->sk_receive_queue);
+                skb = skb_dequeue(&scp->conn_init_queue);
                 if (skb == NULL) {
                         *timeo = schedule_timeout(*timeo);
-                        skb = skb_dequeue(&sk->sk_receive_queue);
+                        skb = skb_dequeue(&scp->conn_init_queue);
                 }
                 lock_sock(sk);
                 if (skb != NULL)
@@ -1199,7 +1232,7 @@ static int dn_accept(struct socket *sock, struct socket *newsock, int flags,
         }
 
 try_again:
-        skb = skb_dequeue(&sk->sk_receive_queue);
+        skb = skb_dequeue(&DN_SK(sk)->conn_init_queue);
         if (skb == NULL) {
                 skb = dn_wait_for_connect(sk, &timeo);
                 if (IS_ERR(skb)) {
@@ -1209,7 +1242,6 @@ try_again:
         }
 
         cb = DN_SKB_CB(skb);
-        sk_acceptq_removed(sk);
 
 	/*
 	 * Now we can check to see if this is a duplicate Connect-Initiate
@@ -1338,6 +1370,10 @@ static __poll_t dn_poll(struct file *file, struct socket *sock, poll_table  *wai
         if (!skb_queue_empty(&scp->other_receive_queue))
                 mask |= EPOLLRDBAND;
 
+        if (sk->sk_state == TCP_LISTEN &&
+            !skb_queue_empty(&scp->conn_init_queue))
+                mask |= EPOLLIN | EPOLLRDNORM;
+
         return mask;
 }
 
@@ -1402,10 +1438,21 @@ static int dn_listen(struct socket *sock, int backlog)
         if (sock_flag(sk, SOCK_ZAPPED))
                 goto out;
 
-        if ((DN_SK(sk)->state != DN_O) || (sk->sk_state == TCP_LISTEN))
+        if (DN_SK(sk)->state != DN_O)
                 goto out;
 
-        sk->sk_max_ack_backlog = backlog;
+        /*
+         * As with TCP, calling listen() again on a listening socket
+         * just changes the size of the backlog. The socket layer has
+         * already capped it at net.core.somaxconn.
+         */
+        if (sk->sk_state == TCP_LISTEN) {
+                WRITE_ONCE(sk->sk_max_ack_backlog, backlog);
+                err = 0;
+                goto out;
+        }
+
+        WRITE_ONCE(sk->sk_max_ack_backlog, backlog);
         sk->sk_ack_backlog     = 0;
         sk->sk_state           = TCP_LISTEN;
         err                 = 0;
@@ -1489,6 +1536,7 @@ static int __dn_setsockopt(struct socket *sock, int level,int optname, char __us
                 int val;
                 unsigned char services;
                 unsigned char info;
+                struct dapframe_dn frame;
         } u;
         int err;
 
@@ -1638,6 +1686,22 @@ static int __dn_setsockopt(struct socket *sock, int level,int optname, char __us
                 scp->info_loc = u.info;
                 break;
 
+        case DSO_DAPFRAME:
+                if (optlen != sizeof(struct dapframe_dn))
+                        return -EINVAL;
+                /* Can't change it in the middle of a DAP record */
+                if (scp->dap_left || scp->dap_rec)
+                        return -EBUSY;
+                if (u.frame.dfn_chunk) {
+                        if (u.frame.dfn_flags & ~DN_DAPFRAME_RECNUM)
+                                return -EINVAL;
+                        if (dn_dapframe_hdrlen(&u.frame) + u.frame.dfn_chunk >
+                            u.frame.dfn_bufsize)
+                                return -EINVAL;
+                }
+                scp->dapframe = u.frame;
+                break;
+
         case DSO_LINKINFO:
         case DSO_STREAM:
         case DSO_SEQPACKET:
@@ -1679,6 +1743,7 @@ static int __dn_getsockopt(struct socket *sock, int level,int optname, char __us
         struct  sock *sk = sock->sk;
         struct dn_scp *scp = DN_SK(sk);
         struct linkinfo_dn link;
+        struct listeninfo_dn listeninfo;
         unsigned int r_len;
         void *r_data = NULL;
         unsigned int val;
@@ -1767,6 +1832,26 @@ static int __dn_getsockopt(struct socket *sock, int level,int optname, char __us
                 r_data = &scp->info_rem;
                 break;
 
+        case DSO_LISTENINFO:
+                if (sk->sk_state != TCP_LISTEN)
+                        return -EINVAL;
+                if (r_len > sizeof(struct listeninfo_dn))
+                        r_len = sizeof(struct listeninfo_dn);
+
+                listeninfo.ldn_backlog   = READ_ONCE(sk->sk_max_ack_backlog);
+                listeninfo.ldn_qlen      = skb_queue_len(&scp->conn_init_queue);
+                listeninfo.ldn_queued    = atomic_read(&scp->ci_queued);
+                listeninfo.ldn_overflows = atomic_read(&scp->ci_overflows);
+                listeninfo.ldn_filtered  = atomic_read(&scp->ci_filtered);
+                r_data = &listeninfo;
+                break;
+
+        case DSO_DAPFRAME:
+                if (r_len > sizeof(struct dapframe_dn))
+                        r_len = sizeof(struct dapframe_dn);
+                r_data = &scp->dapframe;
+                break;
+
         case DSO_STREAM:
         case DSO_SEQPACKET:
         case DSO_CONACCEPT:
@@ -1783,6 +1868,8 @@ static int __dn_getsockopt(struct socket *sock, int level,int optname, char __us
 		union {
 			struct optdata_dn	optdata;
 			struct accessdata_dn	accessdata;
+			struct listeninfo_dn	listeninfo;
+			struct dapframe_dn	dapframe;
 		} bounce;
 
 		memcpy(&bounce, r_data, r_len);
@@ -1826,6 +1913,46 @@ static int dn_data_ready(struct sock *sk, struct sk_buff_head *q, int flags, int
 }
 
 
+/*
+ * Receive buffer autotuning, along the lines of TCP's DRS. Once per
+ * round trip see how much the application has read. If that is more
+ * than we have seen before, grow sk_rcvbuf so that twice that amount
+ * can be queued before dn_congested() turns the remote's flow off
+ * (at half of sk_rcvbuf). Never shrinks, never goes beyond
+ * decnet_rmem[2] and leaves alone sockets with SO_RCVBUF set.
+ */
+static void dn_rcv_space_adjust(struct sock *sk, int copied)
+{
+        struct dn_scp *scp = DN_SK(sk);
+        unsigned long interval = max(usecs_to_jiffies(scp->nsp_srtt >> 3), 1UL);
+        int space, nsegs, segsize, rcvbuf;
+
+        scp->rcvq_space.copied += copied;
+        if (time_before(jiffies, scp->rcvq_space.time + interval))
+                return;
+
+        space = scp->rcvq_space.copied;
+        scp->rcvq_space.copied = 0;
+        scp->rcvq_space.time = jiffies;
+
+        if (space <= scp->rcvq_space.space)
+                return;
+        scp->rcvq_space.space = space;
+
+        if (!READ_ONCE(decnet_moderate_rcvbuf) ||
+            (sk->sk_userlocks & SOCK_RCVBUF_LOCK))
+                return;
+
+        /* Account for skb overhead on each received segment */
+        segsize = max_t(int, scp->segsize_loc, 230);
+        nsegs = DIV_ROUND_UP(space, segsize);
+        rcvbuf = 4 * nsegs * SKB_TRUESIZE(segsize + DN_MAX_NSP_DATA_HEADER + 64);
+        rcvbuf = min(rcvbuf, READ_ONCE(sysctl_decnet_rmem[2]));
+
+        if (rcvbuf > sk->sk_rcvbuf)
+                WRITE_ONCE(sk->sk_rcvbuf, rcvbuf);
+}
+
 static int dn_recvmsg(struct socket *sock, struct msghdr *msg, size_t size,
                       int flags)
 {
@@ -1840,6 +1967,15 @@ static int dn_recvmsg(struct socket *sock, struct msghdr *msg, size_t size,
         unsigned char eor = 0;
         long timeo = sock_rcvtimeo(sk, flags & MSG_DONTWAIT);
 
+#ifdef CONFIG_RPS
+        /*
+         * Tell RFS we're reading this link on this CPU, dn_route_rcv()
+         * steers its frames here. sock_rps_record_flow() only does that
+         * for TCP_ESTABLISHED sockets, ours never are.
+         */
+        sock_rps_record_flow_hash(READ_ONCE(sk->sk_rxhash));
+#endif
+
         lock_sock(sk);
 
         if (sock_flag(sk, SOCK_ZAPPED)) {
@@ -1961,6 +2097,8 @@ static int dn_recvmsg(struct socket *sock, struct msghdr *msg, size_t size,
 
         rv = copied;
 
+        if (copied && !(flags & (MSG_PEEK | MSG_OOB)))
+                dn_rcv_space_adjust(sk, copied);
 
         if (eor && (sk->sk_type == SOCK_SEQPACKET))
                 msg->msg_flags |= MSG_EOR;
@@ -1980,6 +2118,112 @@ out:
         return rv;
 }
 
+/*
+ * splice() from the link to a pipe. This reads the same way as
+ * dn_recvmsg() does, stopping at the end of an NSP message on a
+ * SOCK_SEQPACKET socket, but the data goes into the pipe without a
+ * trip through user space. What doesn't fit in the pipe stays on the
+ * queue for the next read.
+ */
+static ssize_t dn_splice_read(struct socket *sock, loff_t *ppos,
+                              struct pipe_inode_info *pipe, size_t len,
+                              unsigned int flags)
+{
+        struct sock *sk = sock->sk;
+        struct dn_scp *scp = DN_SK(sk);
+        struct sk_buff_head *queue = &sk->sk_receive_queue;
+        struct sk_buff *skb, *n;
+        int nonblock = (sock->file->f_flags & O_NONBLOCK) ||
+                       (flags & SPLICE_F_NONBLOCK);
+        long timeo = sock_rcvtimeo(sk, nonblock);
+        ssize_t spliced = 0;
+        int rv = 0;
+
+        lock_sock(sk);
+
+        if (sock_flag(sk, SOCK_ZAPPED)) {
+                rv = -EADDRNOTAVAIL;
+                goto out;
+        }
+
+        if (sk->sk_shutdown & RCV_SHUTDOWN)
+                goto out;
+
+        rv = dn_check_state(sk, NULL, 0, &timeo, nonblock ? MSG_DONTWAIT : 0);
+        if (rv)
+                goto out;
+
+        for(;;) {
+                DEFINE_WAIT_FUNC(wait, woken_wake_function);
+
+                if (sk->sk_err || scp->state != DN_RUN)
+                        goto out;
+
+                if (signal_pending(current)) {
+                        rv = sock_intr_errno(timeo);
+                        goto out;
+                }
+
+                if (dn_data_ready(sk, queue, 0, 1))
+                        break;
+
+                if (nonblock) {
+                        rv = -EAGAIN;
+                        goto out;
+                }
+
+                add_wait_queue(sk_sleep(sk), &wait);
+                sk_set_bit(SOCKWQ_ASYNC_WAITDATA, sk);
+                sk_wait_event(sk, &timeo, dn_data_ready(sk, queue, 0, 1), &wait);
+                sk_clear_bit(SOCKWQ_ASYNC_WAITDATA, sk);
+                remove_wait_queue(sk_sleep(sk), &wait);
+        }
+
+        skb_queue_walk_safe(queue, skb, n) {
+                unsigned int chunk = min_t(size_t, skb->len, len - spliced);
+                unsigned char eor = DN_SKB_CB(skb)->nsp_flags & 0x40;
+                int ret;
+
+                ret = skb_splice_bits(skb, sk, 0, pipe, chunk, flags);
+                if (ret <= 0) {
+                        if (!spliced)
+                                rv = ret;
+                        break;
+                }
+                spliced += ret;
+                skb_pull(skb, ret);
+
+                /* The pipe is full or we have all that was asked for */
+                if (skb->len)
+                        break;
+
+                skb_unlink(skb, queue);
+                kfree_skb(skb);
+                if ((scp->flowloc_sw == DN_DONTSEND) && !dn_congested(sk)) {
+                        scp->flowloc_sw = DN_SEND;
+                        dn_nsp_schedule_pending(sk, DN_PEND_SW);
+                }
+
+                if (eor && sk->sk_type == SOCK_SEQPACKET)
+                        break;
+                if (spliced >= len)
+                        break;
+        }
+
+        if (spliced) {
+                dn_rcv_space_adjust(sk, spliced);
+                rv = spliced;
+        }
+
+out:
+        if (rv == 0)
+                rv = sock_error(sk);
+
+        release_sock(sk);
+
+        return rv;
+}
+
 static inline int dn_queue_too_long(struct dn_scp *scp, struct sk_buff_head *queue, int flags)
 {
         if (flags & MSG_OOB) {
@@ -2068,6 +2312,105 @@ static inline struct sk_buff *dn_alloc_send_pskb(struct sock *sk,
         return skb;
 }
 
+/*
+ * DAP DATA message header for DSO_DAPFRAME: type, flags (LENGTH, plus
+ * LEN256 for big messages as libdap does it), length and the RECNUM
+ * image field.
+ */
+static unsigned int dn_dapframe_hdrlen(const struct dapframe_dn *df)
+{
+        unsigned int reclen = (df->dfn_flags & DN_DAPFRAME_RECNUM) ? 4 : 0;
+
+        if (df->dfn_chunk + reclen >= 255)
+                return 4 + 1 + reclen;
+        return 3 + 1 + reclen;
+}
+
+static void dn_dapframe_header(struct dn_scp *scp, unsigned char *ptr)
+{
+        struct dapframe_dn *df = &scp->dapframe;
+        unsigned int reclen = (df->dfn_flags & DN_DAPFRAME_RECNUM) ? 4 : 0;
+        unsigned int len = 1 + reclen + df->dfn_chunk;
+
+        *ptr++ = 8;                     /* DATA */
+        if (df->dfn_chunk + reclen >= 255) {
+                *ptr++ = 0x06;
+                put_unaligned_le16(len, ptr);
+                ptr += 2;
+        } else {
+                *ptr++ = 0x02;
+                *ptr++ = len;
+        }
+        *ptr++ = reclen;
+        if (reclen)
+                put_unaligned_le32(df->dfn_recnum, ptr);
+        df->dfn_recnum++;
+}
+
+/*
+ * Fill an NSP segment of up to mss bytes with spliced data wrapped in
+ * DAP DATA messages. DATA messages may be split across calls and
+ * segments, but a DAP record (NSP message) only ever ends after a
+ * whole DATA message. When the caller has no more data to come a
+ * short final message is padded with zeros. Returns the number of
+ * bytes taken from msg and sets *eor when the segment ends a record.
+ */
+static int dn_dapframe_fill(struct dn_scp *scp, struct sk_buff *skb,
+                            struct msghdr *msg, size_t avail, size_t mss,
+                            bool last, bool *eor)
+{
+        struct dapframe_dn *df = &scp->dapframe;
+        unsigned int hdrlen = dn_dapframe_hdrlen(df);
+        size_t used = 0;
+        size_t n;
+
+        *eor = false;
+        for (;;) {
+                if (scp->dap_left == 0) {
+                        if (used == avail) {
+                                /* Close a record a MSG_MORE call left open */
+                                if (last && scp->dap_rec) {
+                                        *eor = true;
+                                        scp->dap_rec = 0;
+                                }
+                                break;
+                        }
+                        if (skb->len + hdrlen > mss)
+                                break;
+                        dn_dapframe_header(scp, skb_put(skb, hdrlen));
+                        scp->dap_left = df->dfn_chunk;
+                        scp->dap_rec += hdrlen + df->dfn_chunk;
+                }
+
+                n = min3((size_t)scp->dap_left, avail - used, mss - skb->len);
+                if (n) {
+                        if (memcpy_from_msg(skb_put(skb, n), msg, n))
+                                return -EFAULT;
+                        used += n;
+                        scp->dap_left -= n;
+                }
+
+                if (scp->dap_left && used == avail && last) {
+                        n = min_t(size_t, scp->dap_left, mss - skb->len);
+                        skb_put_zero(skb, n);
+                        scp->dap_left -= n;
+                }
+
+                if (scp->dap_left == 0 &&
+                    ((used == avail && last) ||
+                     scp->dap_rec + hdrlen + df->dfn_chunk > df->dfn_bufsize)) {
+                        *eor = true;
+                        scp->dap_rec = 0;
+                        break;
+                }
+
+                if (skb->len == mss || (scp->dap_left && used == avail))
+                        break;
+        }
+
+        return used;
+}
+
 static int dn_sendmsg(struct socket *sock, struct msghdr *msg, size_t size)
 {
         struct sock *sk = sock->sk;
@@ -2084,8 +2427,9 @@ static int dn_sendmsg(struct socket *sock, struct msghdr *msg, size_t size)
         size_t len;
         unsigned char fctype;
         long timeo;
+        bool framed, eor;
 
-        if (flags & ~(MSG_TRYHARD|MSG_OOB|MSG_DONTWAIT|MSG_EOR|MSG_NOSIGNAL|MSG_MORE|MSG_CMSG_COMPAT))
+        if (flags & ~(MSG_TRYHARD|MSG_OOB|MSG_DONTWAIT|MSG_EOR|MSG_NOSIGNAL|MSG_MORE|MSG_CMSG_COMPAT|MSG_DN_SPLICED))
                 return -EOPNOTSUPP;
 
         if (addr_len && (addr_len != sizeof(struct sockaddr_dn)))
@@ -2139,9 +2483,22 @@ static int dn_sendmsg(struct socket *sock, struct msghdr *msg, size_t size)
                 }
         }
 
-        scp->persist_fxn = dn_nsp_xmit_timeout;
+        framed = scp->dapframe.dfn_chunk && (flags & MSG_DN_SPLICED) &&
+                 !(flags & MSG_OOB);
 
-        while(sent < size) {
+        /*
+         * A splice that was cut short (signal, no buffer space) can leave
+         * a DAP DATA message or record open. Anything else written now
+         * would land inside it, so the caller has to finish the splice
+         * first.
+         */
+        if (!framed && !(flags & MSG_OOB) && (scp->dap_left || scp->dap_rec)) {
+                err = -EBUSY;
+                goto out;
+        }
+
+        while (sent < size ||
+               (framed && !(flags & MSG_MORE) && (scp->dap_left || scp->dap_rec))) {
                 err = sock_error(sk);
                 if (err)
                         goto out;
@@ -2186,7 +2543,7 @@ static int dn_sendmsg(struct socket *sock, struct msghdr *msg, size_t size)
                  * link-layer headers and has served us well as a good
                  * guess as to their real length.
                  */
-                skb = dn_alloc_send_pskb(sk, len + 64 + DN_MAX_NSP_DATA_HEADER,
+                skb = dn_alloc_send_pskb(sk, (framed ? mss : len) + 64 + DN_MAX_NSP_DATA_HEADER,
                                          flags & MSG_DONTWAIT, &err);
 
                 if (!skb)
@@ -2196,9 +2553,20 @@ static int dn_sendmsg(struct socket *sock, struct msghdr *msg, size_t size)
 
                 skb_reserve(skb, 64 + DN_MAX_NSP_DATA_HEADER);
 
-                if (memcpy_from_msg(skb_put(skb, len), msg, len)) {
-                        err = -EFAULT;
-                        goto out;
+                if (framed) {
+                        int used = dn_dapframe_fill(scp, skb, msg, size - sent,
+                                                    mss, !(flags & MSG_MORE), &eor);
+                        if (used < 0) {
+                                err = used;
+                                goto out;
+                        }
+                        len = used;
+                } else {
+                        if (memcpy_from_msg(skb_put(skb, len), msg, len)) {
+                                err = -EFAULT;
+                                goto out;
+                        }
+                        eor = ((sent + len) == size) && (flags & MSG_EOR);
                 }
 
                 if (flags & MSG_OOB) {
@@ -2209,9 +2577,9 @@ static int dn_sendmsg(struct socket *sock, struct msghdr *msg, size_t size)
                         if (scp->seg_total == 0)
                                 cb->nsp_flags |= 0x20;
 
-                        scp->seg_total += len;
+                        scp->seg_total += skb->len;
 
-                        if (((sent + len) == size) && (flags & MSG_EOR)) {
+                        if (eor) {
                                 cb->nsp_flags |= 0x40;
                                 scp->seg_total = 0;
                                 if (fctype == NSP_FC_SCMC)
@@ -2241,7 +2609,7 @@ static int dn_sendmsg(struct socket *sock, struct msghdr *msg, size_t size)
                 dn_nsp_queue_xmit(sk, skb, sk->sk_allocation, flags & MSG_OOB);
                 skb = NULL;
 
-                scp->persist = dn_nsp_persist(sk);
+                dn_arm_rxt_timer(sk);
 
         }
 out:
@@ -2258,6 +2626,21 @@ out_err:
         return err;
 }
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,5,0)
+/*
+ * The page is still copied by dn_sendmsg(), this just marks it as
+ * spliced data so that DSO_DAPFRAME applies to it.
+ */
+static ssize_t dn_sendpage(struct socket *sock, struct page *page,
+                           int offset, size_t size, int flags)
+{
+        if (flags & MSG_SENDPAGE_NOTLAST)
+                flags |= MSG_MORE;
+
+        return sock_no_sendpage(sock, page, offset, size, flags | MSG_DN_SPLICED);
+}
+#endif
+
 static int dn_device_event(struct notifier_block *this, unsigned long event,
                            void *ptr)
 {
@@ -2272,6 +2655,14 @@ static int dn_device_event(struct notifier_block *this, unsigned long event,
                 break;
         case NETDEV_DOWN:
                 dn_dev_down(dev);
+                dn_route_rps_flush(dev);
+                break;
+        case NETDEV_CHANGEMTU:
+                /*
+                 * Routes may have an mtu metric from the old value,
+                 * new hellos will advertise the new block size.
+                 */
+                dn_rt_cache_flush(0);
                 break;
         default:
                 break;
@@ -2511,7 +2902,10 @@ static const struct proto_ops dn_proto_ops = {
         .sendmsg =      dn_sendmsg,
         .recvmsg =      dn_recvmsg,
         .mmap =         sock_no_mmap,
-        .sendpage =     sock_no_sendpage,
+        .splice_read =  dn_splice_read,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,5,0)
+        .sendpage =     dn_sendpage,
+#endif
 };
 
 MODULE_DESCRIPTION("The Linux DECnet Network Protocol");
@@ -2537,6 +2931,7 @@ static int __init decnet_init(void)
         dn_dev_init();
         dn_route_init();
         dn_fib_init();
+        dn_l1_init();
 
         sock_register(&dn_family_ops);
         dev_add_pack(&dn_dix_packet_type);
@@ -2595,6 +2990,7 @@ static void __exit decnet_exit(void)
 
         unregister_netdevice_notifier(&dn_dev_notifier);
 
+        dn_l1_cleanup();
         dn_route_cleanup();
         dn_dev_cleanup();
         dn_neigh_cleanup();
@@ -110,6 +110,7 @@ static struct dn_dev_parms dn_dev_list[] =  {
         .state =        DN_DEV_S_RU,
         .t2 =           1,
         .t3 =           10,
+        .cost =         4,
         .name =         "ethernet",
         .up =           dn_eth_up,
         .down =         dn_eth_down,
@@ -121,6 +122,7 @@ static struct dn_dev_parms dn_dev_list[] =  {
         .state =        DN_DEV_S_RU,
         .t2 =           1,
         .t3 =           10,
+        .cost =         4,
         .name =         "ipgre",
         .timer3 =       dn_send_brd_hello,
 },
@@ -131,6 +133,7 @@ static struct dn_dev_parms dn_dev_list[] =  {
         .state =        DN_DEV_S_DS,
         .t2 =           1,
         .t3 =           120,
+        .cost =         4,
         .name =         "x25",
         .timer3 =       dn_send_ptp_hello,
 },
@@ -142,6 +145,7 @@ static struct dn_dev_parms dn_dev_list[] =  {
         .state =        DN_DEV_S_RU,
         .t2 =           1,
         .t3 =           10,
+        .cost =         4,
         .name =         "ppp",
         .timer3 =       dn_send_brd_hello,
 },
@@ -152,6 +156,7 @@ static struct dn_dev_parms dn_dev_list[] =  {
         .state =        DN_DEV_S_DS,
         .t2 =           1,
         .t3 =           120,
+        .cost =         4,
         .name =         "ddcmp",
         .timer3 =       dn_send_ptp_hello,
 },
@@ -161,6 +166,7 @@ static struct dn_dev_parms dn_dev_list[] =  {
         .state =        DN_DEV_S_RU,
         .t2 =           1,
         .t3 =           10,
+        .cost =         4,
         .name =         "loopback",
         .timer3 =       dn_send_brd_hello,
 }
@@ -177,6 +183,14 @@ static int max_t2[] = { 60 }; /* No max specified, but this seems sensible */
 static int min_t3[] = { 1 };
 static int max_t3[] = { 8191 }; /* Must fit in 16 bits when multiplied by BCT3MULT, WT3MULT or T3MULT */
 
+#ifdef CONFIG_DECNET_L1ROUTE
+static int min_cost[] = { 1 };
+static int max_cost[] = { 25 }; /* From DECnet spec */
+#define DN_DEV_L1_VARS 1
+#else
+#define DN_DEV_L1_VARS 0
+#endif
+
 static int min_priority[1];
 static int max_priority[] = { 127 }; /* From DECnet spec */
 
@@ -189,7 +203,7 @@ static int dn_forwarding_proc(struct ctl_table *, int,
 #endif
 static struct dn_dev_sysctl_table {
         struct ctl_table_header *sysctl_header;
-        struct ctl_table dn_dev_vars[5];
+        struct ctl_table dn_dev_vars[5 + DN_DEV_L1_VARS];
 } dn_dev_sysctl = {
         NULL,
         {
@@ -227,6 +241,17 @@ static struct dn_dev_sysctl_table {
                 .extra1 = &min_t3,
                 .extra2 = &max_t3
         },
+#ifdef CONFIG_DECNET_L1ROUTE
+        {
+                .procname = "cost",
+                .data = (void *)DN_DEV_PARMS_OFFSET(cost),
+                .maxlen = sizeof(int),
+                .mode = 0644,
+                .proc_handler = proc_dointvec_minmax,
+                .extra1 = &min_cost,
+                .extra2 = &max_cost
+        },
+#endif
         { }
         },
 };
@@ -945,20 +970,21 @@ static int dn_am_i_a_router(struct dn_neigh *dn, struct dn_dev *dn_db, struct dn
         return 0;
 }
 
-static void dn_send_router_hello(struct net_device *dev, struct dn_ifaddr *ifa)
+/*
+ * Build a router hello for the circuit. Only done when the routers we
+ * have heard or our own parameters have changed, otherwise the last
+ * one is sent again.
+ */
+static struct sk_buff *dn_build_router_hello(struct net_device *dev,
+                                             struct dn_ifaddr *ifa)
 {
         int n;
         struct dn_dev *dn_db = rcu_dereference_raw(dev->dn_ptr);
-        struct dn_neigh *dn = (struct dn_neigh *)dn_db->router;
         struct sk_buff *skb;
         size_t size;
         unsigned char *ptr;
         unsigned char *i1, *i2;
         __le16 *pktlen;
-        char *src;
-
-        if (mtu2blksize(dev) < (26 + 7))
-                return;
 
         n = mtu2blksize(dev) - 26;
         n /= 7;
@@ -969,7 +995,7 @@ static void dn_send_router_hello(struct net_device *dev, struct dn_ifaddr *ifa)
         size = 2 + 26 + 7 * n;
 
         if ((skb = dn_alloc_skb(NULL, size, GFP_ATOMIC)) == NULL)
-                return;
+                return NULL;
 
         skb->dev = dev;
         ptr = skb_put(skb, size);
@@ -979,7 +1005,6 @@ static void dn_send_router_hello(struct net_device *dev, struct dn_ifaddr *ifa)
         *ptr++ = 0;
         *ptr++ = 0;
         dn_dn2eth(ptr, ifa->ifa_local);
-        src = ptr;
         ptr += ETH_ALEN;
         *ptr++ = dn_db->parms.forwarding == 1 ?
                         DN_RT_INFO_L1RT : DN_RT_INFO_L2RT;
@@ -995,7 +1020,7 @@ static void dn_send_router_hello(struct net_device *dev, struct dn_ifaddr *ifa)
         ptr += 7;
         i2 = ptr++;
 
-        n = dn_neigh_elist(dev, ptr, n);
+        n = dn_neigh_elist(dn_db, ptr, n);
 
         *i2 = 7 * n;
         *i1 = 8 + *i2;
@@ -1007,14 +1032,54 @@ static void dn_send_router_hello(struct net_device *dev, struct dn_ifaddr *ifa)
 
         skb_reset_network_header(skb);
 
+        return skb;
+}
+
+static void dn_send_router_hello(struct net_device *dev, struct dn_ifaddr *ifa)
+{
+        struct dn_dev *dn_db = rcu_dereference_raw(dev->dn_ptr);
+        struct dn_neigh *dn = (struct dn_neigh *)dn_db->router;
+        struct sk_buff *skb;
+        __u32 key[4];
+        char src[ETH_ALEN];
+
+        if (mtu2blksize(dev) < (26 + 7))
+                return;
+
+        dn_neigh_rtr_expire(dn_db);
+
+        key[0] = le16_to_cpu(ifa->ifa_local);
+        key[1] = mtu2blksize(dev);
+        key[2] = dn_db->parms.t3;
+        key[3] = (dn_db->parms.forwarding << 8) | dn_db->parms.priority;
+
+        if (dn_db->hello == NULL || dn_db->hello_gen != dn_db->rtr_gen ||
+            memcmp(dn_db->hello_key, key, sizeof(key))) {
+                unsigned int gen = READ_ONCE(dn_db->rtr_gen);
+
+                if ((skb = dn_build_router_hello(dev, ifa)) == NULL)
+                        return;
+                kfree_skb(dn_db->hello);
+                dn_db->hello = skb;
+                dn_db->hello_gen = gen;
+                memcpy(dn_db->hello_key, key, sizeof(key));
+        }
+
+        /*
+         * The cached hello can't be cloned because dn_rt_finish_output()
+         * writes the link header into its headroom, so send copies.
+         */
+        dn_dn2eth(src, ifa->ifa_local);
+
         if (dn_am_i_a_router(dn, dn_db, ifa)) {
-                struct sk_buff *skb2 = skb_copy(skb, GFP_ATOMIC);
+                struct sk_buff *skb2 = skb_copy(dn_db->hello, GFP_ATOMIC);
                 if (skb2) {
                         dn_rt_finish_output(skb2, dn_rt_all_end_mcast, src);
                 }
         }
 
-        dn_rt_finish_output(skb, dn_rt_all_rt_mcast, src);
+        if ((skb = skb_copy(dn_db->hello, GFP_ATOMIC)) != NULL)
+                dn_rt_finish_output(skb, dn_rt_all_rt_mcast, src);
 }
 
 static void dn_send_brd_hello(struct net_device *dev, struct dn_ifaddr *ifa)
@@ -1241,6 +1306,7 @@ static struct dn_dev *dn_dev_create(struct net_device *dev, int *err)
                 return NULL;
 
         memcpy(&dn_db->parms, p, sizeof(struct dn_dev_parms));
+        INIT_LIST_HEAD(&dn_db->routers);
 
         rcu_assign_pointer(dev->dn_ptr, dn_db);
         dn_db->dev = dev;
@@ -1378,7 +1444,16 @@ static void dn_dev_delete(struct net_device *dev)
         if (dn_db->parms.down)
                 dn_db->parms.down(dev);
 
-        dev->dn_ptr = NULL;
+        RCU_INIT_POINTER(dev->dn_ptr, NULL);
+
+        /*
+         * A router hello being processed may still have dn_db and be
+         * about to add a router to its list. Wait for it to finish so
+         * nothing is added after the flush.
+         */
+        synchronize_net();
+        dn_neigh_rtr_flush(dn_db);
+        kfree_skb(dn_db->hello);
 
         neigh_parms_release(&dn_neigh_table, dn_db->neigh_parms);
         neigh_ifdown(&dn_neigh_table, dev);
@@ -0,0 +1,512 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * DECnet       An implementation of the DECnet protocol suite for the LINUX
+ *              operating system.  DECnet is implemented using the  BSD Socket
+ *              interface as the means of communication with the user level.
+ *
+ *              DECnet Level 1 Routing (Phase IV decision process)
+ *
+ * Level 1 routing messages from the routers on our circuits are kept as
+ * one hop/cost vector per adjacency. Only the entries which changed are
+ * marked, and a work item reruns the decision for those destinations and
+ * puts the result straight into the main FIB table, so dnroute no longer
+ * has to see every message and push routes back one node at a time.
+ *
+ * Routes are added with protocol "dnrouted" and a metric of
+ * DN_L1_PRIORITY, so that routes added by hand or by dnroute (which use
+ * metric 0) take precedence over them.
+ */
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/bitmap.h>
+#include <linux/workqueue.h>
+#include <linux/netdevice.h>
+#include <linux/rtnetlink.h>
+#include <linux/jiffies.h>
+#include <net/netlink.h>
+#include <net/genetlink.h>
+#include <net/dn.h>
+#include <net/dn_dev.h>
+#include <net/dn_route.h>
+#include <net/dn_fib.h>
+#include <net/dn_l1route.h>
+
+#define DN_L1_NODES     1024            /* Nodes in an area                   */
+#define DN_L1_INF       0x7fff          /* Unreachable entry                  */
+#define DN_L1_MAXH      30              /* Maximum hops in an area            */
+#define DN_L1_MAXC      1022            /* Maximum path cost in an area       */
+#define DN_L1_MAXADJ    64              /* Routers we keep vectors for        */
+#define DN_L1_HOLD      (60 * HZ)       /* Adjacency lifetime without a msg   */
+#define DN_L1_PRIORITY  1               /* FIB metric of our routes           */
+
+#define DN_L1_HOPS(e)   (((e) >> 10) & 0x1f)
+#define DN_L1_COST(e)   ((e) & 0x3ff)
+
+struct dn_l1_adj {
+        struct list_head list;
+        int ifindex;
+        __le16 addr;
+        u16 cost;                       /* Circuit cost added to the vector   */
+        unsigned long expires;
+        u16 vec[DN_L1_NODES];           /* As received: hops << 10 | cost     */
+};
+
+struct dn_l1_route {
+        int ifindex;                    /* 0 if unreachable                   */
+        __le16 gw;
+        u16 cost;
+        u8 hops;
+};
+
+static LIST_HEAD(dn_l1_adjs);
+static int dn_l1_nadj;
+static DEFINE_SPINLOCK(dn_l1_lock);
+static DECLARE_BITMAP(dn_l1_changed, DN_L1_NODES);
+
+/* Written by the work item only, read under dn_l1_lock by dumps */
+static struct dn_l1_route dn_l1_routes[DN_L1_NODES];
+
+static void dn_l1_work_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(dn_l1_work, dn_l1_work_fn);
+
+static u16 dn_l1_csum(const unsigned char *ptr, int len)
+{
+        u32 sum = 1;
+        int i;
+
+        for(i = 0; i < len; i += 2)
+                sum += ptr[i] | (ptr[i + 1] << 8);
+        sum = (sum >> 16) + (sum & 0xffff);
+        sum = (sum >> 16) + (sum & 0xffff);
+
+        return (u16)sum;
+}
+
+static struct dn_l1_adj *dn_l1_find(int ifindex, __le16 addr)
+{
+        struct dn_l1_adj *adj;
+
+        list_for_each_entry(adj, &dn_l1_adjs, list) {
+                if (adj->ifindex == ifindex && adj->addr == addr)
+                        return adj;
+        }
+        return NULL;
+}
+
+/* Every destination the adjacency offers a path to needs a new decision */
+static void dn_l1_mark(struct dn_l1_adj *adj)
+{
+        int n;
+
+        for(n = 0; n < DN_L1_NODES; n++) {
+                if (adj->vec[n] != DN_L1_INF)
+                        __set_bit(n, dn_l1_changed);
+        }
+}
+
+/*
+ * Called with a linear level 1 routing message, skb->data pointing at the
+ * flags byte: src(2) reserved(1), then segments of count(2) start(2)
+ * entries(2 * count), then the checksum over the segments.
+ */
+void dn_l1_rcv(struct sk_buff *skb)
+{
+        struct net_device *dev = skb->dev;
+        struct dn_dev *dn_db = rcu_dereference(dev->dn_ptr);
+        unsigned char *ptr = skb->data;
+        int len = skb->len;
+        struct dn_l1_adj *adj, *new = NULL;
+        __le16 src;
+        int pos, count, start, n;
+        int changed = 0;
+        u16 e;
+
+        if (!decnet_l1_routing || dn_db == NULL || dn_db->parms.forwarding == 0)
+                return;
+        if (decnet_address == 0 || len < 10 || (len & 1))
+                return;
+
+        src = cpu_to_le16(ptr[1] | (ptr[2] << 8));
+        if (src == decnet_address ||
+            (le16_to_cpu(src) >> 10) != (le16_to_cpu(decnet_address) >> 10))
+                return;
+
+        if (dn_l1_csum(ptr + 4, len - 6) != (ptr[len - 2] | (ptr[len - 1] << 8))) {
+                if (decnet_debug_level & DN_DBG_RX_ROUTE)
+                        printk(KERN_DEBUG "dn_l1_rcv: bad checksum from %d.%d\n",
+                                le16_to_cpu(src) >> 10, le16_to_cpu(src) & 0x3ff);
+                return;
+        }
+
+        /* Check every segment before we believe any of them */
+        for(pos = 4; pos < len - 2; pos += 4 + 2 * count) {
+                if (pos + 4 > len - 2)
+                        return;
+                count = ptr[pos] | (ptr[pos + 1] << 8);
+                start = ptr[pos + 2] | (ptr[pos + 3] << 8);
+                if (start + count > DN_L1_NODES || pos + 4 + 2 * count > len - 2)
+                        return;
+        }
+
+        spin_lock_bh(&dn_l1_lock);
+        adj = dn_l1_find(dev->ifindex, src);
+        if (adj == NULL) {
+                spin_unlock_bh(&dn_l1_lock);
+                if (READ_ONCE(dn_l1_nadj) >= DN_L1_MAXADJ)
+                        return;
+                new = kmalloc(sizeof(*new), GFP_ATOMIC);
+                if (new == NULL)
+                        return;
+                new->ifindex = dev->ifindex;
+                new->addr = src;
+                new->cost = dn_db->parms.cost;
+                for(n = 0; n < DN_L1_NODES; n++)
+                        new->vec[n] = DN_L1_INF;
+
+                spin_lock_bh(&dn_l1_lock);
+                adj = dn_l1_find(dev->ifindex, src);
+                if (adj == NULL) {
+                        list_add_tail(&new->list, &dn_l1_adjs);
+                        dn_l1_nadj++;
+                        adj = new;
+                        new = NULL;
+                }
+        }
+
+        if (adj->cost != dn_db->parms.cost) {
+                adj->cost = dn_db->parms.cost;
+                dn_l1_mark(adj);
+                changed = 1;
+        }
+
+        for(pos = 4; pos < len - 2; pos += 4 + 2 * count) {
+                count = ptr[pos] | (ptr[pos + 1] << 8);
+                start = ptr[pos + 2] | (ptr[pos + 3] << 8);
+                for(n = 0; n < count; n++) {
+                        e = (ptr[pos + 4 + 2 * n] | (ptr[pos + 5 + 2 * n] << 8)) & DN_L1_INF;
+                        if (adj->vec[start + n] != e) {
+                                adj->vec[start + n] = e;
+                                __set_bit(start + n, dn_l1_changed);
+                                changed = 1;
+                        }
+                }
+        }
+        adj->expires = jiffies + DN_L1_HOLD;
+        spin_unlock_bh(&dn_l1_lock);
+
+        kfree(new);
+
+        if (changed)
+                mod_delayed_work(system_wq, &dn_l1_work, 0);
+        else
+                schedule_delayed_work(&dn_l1_work, HZ);
+}
+
+/*
+ * fib_magic() in dn_fib.c does the same for local addresses. Node 0
+ * stands for the nearest level 2 router and becomes our default route.
+ */
+static int dn_l1_fib(int cmd, int node, const struct dn_l1_route *r)
+{
+        struct dn_fib_table *tb;
+        struct {
+                struct nlmsghdr nlh;
+                struct rtmsg rtm;
+        } req;
+        struct {
+                struct nlattr hdr;
+                __le16 dst;
+        } dst_attr = {
+                .hdr = { .nla_len = NLA_HDRLEN + 2, .nla_type = RTA_DST },
+                .dst = cpu_to_le16((le16_to_cpu(decnet_address) & 0xfc00) | node),
+        };
+        struct {
+                struct nlattr hdr;
+                __le16 gw;
+        } gw_attr = {
+                .hdr = { .nla_len = NLA_HDRLEN + 2, .nla_type = RTA_GATEWAY },
+                .gw = r->gw,
+        };
+        struct {
+                struct nlattr hdr;
+                u32 oif;
+        } oif_attr = {
+                .hdr = { .nla_len = NLA_HDRLEN + 4, .nla_type = RTA_OIF },
+                .oif = r->ifindex,
+        };
+        struct {
+                struct nlattr hdr;
+                u32 prio;
+        } prio_attr = {
+                .hdr = { .nla_len = NLA_HDRLEN + 4, .nla_type = RTA_PRIORITY },
+                .prio = DN_L1_PRIORITY,
+        };
+        struct nlattr *attrs[RTA_MAX+1] = {
+                [RTA_PRIORITY] = (struct nlattr *) &prio_attr,
+        };
+
+        tb = dn_fib_get_table(RT_TABLE_MAIN, cmd == RTM_NEWROUTE);
+        if (tb == NULL)
+                return -ESRCH;
+
+        memset(&req, 0, sizeof(req));
+        req.nlh.nlmsg_len = sizeof(req);
+        req.nlh.nlmsg_type = cmd;
+        req.nlh.nlmsg_flags = NLM_F_REQUEST|NLM_F_CREATE|NLM_F_REPLACE;
+
+        req.rtm.rtm_family = AF_DECnet;
+        req.rtm.rtm_table = tb->n;
+        req.rtm.rtm_protocol = RTPROT_DNROUTED;
+        req.rtm.rtm_type = RTN_UNICAST;
+
+        if (node) {
+                req.rtm.rtm_dst_len = 16;
+                attrs[RTA_DST] = (struct nlattr *) &dst_attr;
+        }
+
+        if (cmd != RTM_NEWROUTE) {
+                req.rtm.rtm_scope = RT_SCOPE_NOWHERE;
+                return tb->delete(tb, &req.rtm, attrs, &req.nlh, NULL);
+        }
+
+        attrs[RTA_OIF] = (struct nlattr *) &oif_attr;
+        if (node && r->gw == dst_attr.dst) {
+                req.rtm.rtm_scope = RT_SCOPE_LINK;
+        } else {
+                /* The router is on the circuit, no need to look it up */
+                req.rtm.rtm_scope = RT_SCOPE_UNIVERSE;
+                req.rtm.rtm_flags = RTNH_F_ONLINK;
+                attrs[RTA_GATEWAY] = (struct nlattr *) &gw_attr;
+        }
+        return tb->insert(tb, &req.rtm, attrs, &req.nlh, NULL);
+}
+
+/* Level 2 routers find other areas themselves */
+static int dn_l1_level2(void)
+{
+        struct net_device *dev;
+        struct dn_dev *dn_db;
+
+        for_each_netdev(&init_net, dev) {
+                dn_db = rtnl_dereference(dev->dn_ptr);
+                if (dn_db && dn_db->parms.forwarding == 2)
+                        return 1;
+        }
+        return 0;
+}
+
+/* Pick the cheapest path to one node, fewest hops breaking ties */
+static void dn_l1_decide(int node)
+{
+        struct dn_l1_route best = { .ifindex = 0 };
+        struct dn_l1_route *old = &dn_l1_routes[node];
+        struct dn_l1_adj *adj;
+        unsigned int hops, cost;
+        u16 e;
+
+        if (node == (le16_to_cpu(decnet_address) & 0x3ff))
+                return;
+
+        if (node || !dn_l1_level2()) {
+                spin_lock_bh(&dn_l1_lock);
+                list_for_each_entry(adj, &dn_l1_adjs, list) {
+                        e = adj->vec[node];
+                        if (e == DN_L1_INF)
+                                continue;
+                        hops = DN_L1_HOPS(e) + 1;
+                        cost = DN_L1_COST(e) + adj->cost;
+                        if (hops > DN_L1_MAXH || cost > DN_L1_MAXC)
+                                continue;
+                        if (best.ifindex == 0 || cost < best.cost ||
+                            (cost == best.cost && hops < best.hops)) {
+                                best.ifindex = adj->ifindex;
+                                best.gw = adj->addr;
+                                best.hops = hops;
+                                best.cost = cost;
+                        }
+                }
+                spin_unlock_bh(&dn_l1_lock);
+        }
+
+        if (best.ifindex == old->ifindex && best.gw == old->gw &&
+            best.hops == old->hops && best.cost == old->cost)
+                return;
+
+        /* A new hop or cost over the same next hop leaves the FIB alone */
+        if (best.ifindex && (best.ifindex != old->ifindex || best.gw != old->gw) &&
+            dn_l1_fib(RTM_NEWROUTE, node, &best) != 0)
+                best.ifindex = 0;
+        if (best.ifindex == 0 && old->ifindex)
+                dn_l1_fib(RTM_DELROUTE, node, old);
+
+        spin_lock_bh(&dn_l1_lock);
+        *old = best;
+        spin_unlock_bh(&dn_l1_lock);
+}
+
+static void dn_l1_work_fn(struct work_struct *work)
+{
+        DECLARE_BITMAP(changed, DN_L1_NODES);
+        struct dn_l1_adj *adj, *next;
+        struct net_device *dev;
+        struct dn_dev *dn_db;
+        LIST_HEAD(dead);
+        int node, more;
+
+        rtnl_lock();
+        spin_lock_bh(&dn_l1_lock);
+        list_for_each_entry_safe(adj, next, &dn_l1_adjs, list) {
+                dev = __dev_get_by_index(&init_net, adj->ifindex);
+                dn_db = dev ? rtnl_dereference(dev->dn_ptr) : NULL;
+                if (decnet_l1_routing && dn_db && (dev->flags & IFF_UP) &&
+                    dn_db->parms.forwarding && time_before(jiffies, adj->expires))
+                        continue;
+                dn_l1_mark(adj);
+                list_move(&adj->list, &dead);
+                dn_l1_nadj--;
+        }
+        bitmap_copy(changed, dn_l1_changed, DN_L1_NODES);
+        bitmap_zero(dn_l1_changed, DN_L1_NODES);
+        more = dn_l1_nadj;
+        spin_unlock_bh(&dn_l1_lock);
+
+        list_for_each_entry_safe(adj, next, &dead, list) {
+                list_del(&adj->list);
+                kfree(adj);
+        }
+
+        for_each_set_bit(node, changed, DN_L1_NODES)
+                dn_l1_decide(node);
+        rtnl_unlock();
+
+        /* Keep looking for adjacencies which have gone quiet */
+        if (more)
+                schedule_delayed_work(&dn_l1_work, HZ);
+}
+
+static struct genl_family dn_l1_genl_family;
+
+static int dn_l1_dump_adj(struct sk_buff *skb, struct netlink_callback *cb)
+{
+        struct dn_l1_adj *adj;
+        int idx = 0, s_idx = cb->args[0];
+        unsigned long expires;
+        int reach, n;
+        void *hdr;
+
+        spin_lock_bh(&dn_l1_lock);
+        list_for_each_entry(adj, &dn_l1_adjs, list) {
+                if (idx < s_idx)
+                        goto next;
+
+                reach = 0;
+                for(n = 0; n < DN_L1_NODES; n++) {
+                        if (adj->vec[n] != DN_L1_INF)
+                                reach++;
+                }
+                expires = time_after(adj->expires, jiffies) ? adj->expires - jiffies : 0;
+
+                hdr = genlmsg_put(skb, NETLINK_CB(cb->skb).portid,
+                                  cb->nlh->nlmsg_seq, &dn_l1_genl_family,
+                                  NLM_F_MULTI, DNL1_CMD_GET_ADJ);
+                if (hdr == NULL)
+                        goto full;
+                if (nla_put_u32(skb, DNL1_A_IFINDEX, adj->ifindex) ||
+                    nla_put_u16(skb, DNL1_A_ADDR, le16_to_cpu(adj->addr)) ||
+                    nla_put_u16(skb, DNL1_A_COST, adj->cost) ||
+                    nla_put_u32(skb, DNL1_A_EXPIRES, jiffies_to_msecs(expires)) ||
+                    nla_put_u16(skb, DNL1_A_REACH, reach)) {
+                        genlmsg_cancel(skb, hdr);
+                        goto full;
+                }
+                genlmsg_end(skb, hdr);
+next:
+                idx++;
+        }
+full:
+        spin_unlock_bh(&dn_l1_lock);
+        cb->args[0] = idx;
+        return skb->len;
+}
+
+static int dn_l1_dump_route(struct sk_buff *skb, struct netlink_callback *cb)
+{
+        u16 area = le16_to_cpu(decnet_address) & 0xfc00;
+        struct dn_l1_route *r;
+        int node;
+        void *hdr;
+
+        spin_lock_bh(&dn_l1_lock);
+        for(node = cb->args[0]; node < DN_L1_NODES; node++) {
+                r = &dn_l1_routes[node];
+                if (r->ifindex == 0)
+                        continue;
+
+                hdr = genlmsg_put(skb, NETLINK_CB(cb->skb).portid,
+                                  cb->nlh->nlmsg_seq, &dn_l1_genl_family,
+                                  NLM_F_MULTI, DNL1_CMD_GET_ROUTE);
+                if (hdr == NULL)
+                        break;
+                if (nla_put_u16(skb, DNL1_A_ADDR, area | node) ||
+                    nla_put_u32(skb, DNL1_A_IFINDEX, r->ifindex) ||
+                    nla_put_u16(skb, DNL1_A_GW, le16_to_cpu(r->gw)) ||
+                    nla_put_u8(skb, DNL1_A_HOPS, r->hops) ||
+                    nla_put_u16(skb, DNL1_A_COST, r->cost)) {
+                        genlmsg_cancel(skb, hdr);
+                        break;
+                }
+                genlmsg_end(skb, hdr);
+        }
+        spin_unlock_bh(&dn_l1_lock);
+        cb->args[0] = node;
+        return skb->len;
+}
+
+static const struct genl_ops dn_l1_genl_ops[] = {
+        {
+                .cmd = DNL1_CMD_GET_ADJ,
+                .dumpit = dn_l1_dump_adj,
+        },
+        {
+                .cmd = DNL1_CMD_GET_ROUTE,
+                .dumpit = dn_l1_dump_route,
+        },
+};
+
+static struct genl_family dn_l1_genl_family = {
+        .name = DNL1_GENL_NAME,
+        .version = DNL1_GENL_VERSION,
+        .module = THIS_MODULE,
+        .ops = dn_l1_genl_ops,
+        .n_ops = ARRAY_SIZE(dn_l1_genl_ops),
+};
+
+void __init dn_l1_init(void)
+{
+        if (genl_register_family(&dn_l1_genl_family))
+                printk(KERN_ERR "DECnet: Unable to register level 1 routing netlink family\n");
+}
+
+void __exit dn_l1_cleanup(void)
+{
+        struct dn_l1_adj *adj, *next;
+        int node;
+
+        genl_unregister_family(&dn_l1_genl_family);
+        cancel_delayed_work_sync(&dn_l1_work);
+
+        rtnl_lock();
+        for(node = 0; node < DN_L1_NODES; node++) {
+                if (dn_l1_routes[node].ifindex)
+                        dn_l1_fib(RTM_DELROUTE, node, &dn_l1_routes[node]);
+        }
+        rtnl_unlock();
+
+        list_for_each_entry_safe(adj, next, &dn_l1_adjs, list) {
+                list_del(&adj->list);
+                kfree(adj);
+        }
+}
@@ -52,6 +52,8 @@
 static int dn_neigh_construct(struct neighbour *);
 static void dn_neigh_error_report(struct neighbour *, struct sk_buff *);
 static int dn_neigh_output(struct neighbour *neigh, struct sk_buff *skb);
+static void dn_neigh_rtr_update(struct dn_dev *dn_db, struct dn_neigh *dn,
+                                unsigned long expires);
 
 /*
  * Operations for adding the link layer header.
@@ -115,6 +117,8 @@ static int dn_neigh_construct(struct neighbour *neigh)
         struct dn_dev *dn_db;
         struct neigh_parms *parms;
 
+        INIT_LIST_HEAD(&dn->rtr_list);
+
         rcu_read_lock();
         dn_db = rcu_dereference(dev->dn_ptr);
         if (dn_db == NULL) {
@@ -443,6 +447,7 @@ int dn_neigh_router_hello(struct net *net, struct sock *sk, struct sk_buff *skb)
                                         struct dn_neigh *dn = container_of(oldrouter, struct dn_neigh, n);
 
                                         dn->flags &= ~(DN_NDFLAG_R1 | DN_NDFLAG_R2);
+                                        dn_neigh_rtr_update(dn_db, dn, 0);
                                         neigh_release(oldrouter);
                                 }
 
@@ -451,6 +456,9 @@ int dn_neigh_router_hello(struct net *net, struct sock *sk, struct sk_buff *skb)
                         }
                         dn_db->t4 = dn_db->listen;
 
+                        dn_neigh_rtr_update(dn_db, dn, jiffies +
+                                dn_db->multiplier * le16_to_cpu(msg->timer) * HZ);
+
                 	write_unlock(&neigh->lock);
                 	neigh_release(neigh);
 		}
@@ -490,6 +498,8 @@ int dn_neigh_endnode_hello(struct net *net, struct sock *sk, struct sk_buff *skb
                                 dn->flags   &= ~(DN_NDFLAG_R1 | DN_NDFLAG_R2);
                                 dn->blksize  = le16_to_cpu(msg->blksize);
                                 dn->priority = 0;
+                                dn_neigh_rtr_update(rcu_dereference(neigh->dev->dn_ptr),
+                                                    dn, 0);
                         }
 
                         write_unlock(&neigh->lock);
@@ -501,71 +511,134 @@ int dn_neigh_endnode_hello(struct net *net, struct sock *sk, struct sk_buff *skb
         return 0;
 }
 
-static char *dn_find_slot(char *base, int max, int priority)
-{
-        int i;
-        unsigned char *min = NULL;
+/*
+ * Each circuit keeps the routers it has heard on it in a list, highest
+ * priority first, so that our own router hellos don't have to search
+ * the whole neighbour table for them. Entries hold a reference to the
+ * neighbour. They are added and moved by incoming router hellos, dropped
+ * when a router stops being one of ours and expired from our T3 timer.
+ */
+static DEFINE_SPINLOCK(dn_rtr_lock);
 
-        base += 6; /* skip first id */
+static void dn_rtr_insert(struct dn_dev *dn_db, struct dn_neigh *dn)
+{
+        struct dn_neigh *pos;
 
-        for(i = 0; i < max; i++) {
-                if (!min || (*base < *min))
-                        min = base;
-                base += 7; /* find next priority */
+        list_for_each_entry(pos, &dn_db->routers, rtr_list) {
+                if (pos->rtr_priority < dn->rtr_priority)
+                        break;
         }
+        list_add_tail(&dn->rtr_list, &pos->rtr_list);
+        dn_db->rtr_gen++;
+}
 
-        if (!min)
-                return NULL;
+static void dn_rtr_release(struct list_head *dead)
+{
+        struct dn_neigh *dn, *tmp;
 
-        return (*min < priority) ? (min - 6) : NULL;
+        list_for_each_entry_safe(dn, tmp, dead, rtr_list) {
+                list_del_init(&dn->rtr_list);
+                neigh_release(&dn->n);
+        }
 }
 
-struct elist_cb_state {
-        struct net_device *dev;
-        unsigned char *ptr;
-        unsigned char *rs;
-        int t, n;
-};
-
-static void neigh_elist_cb(struct neighbour *neigh, void *_info)
+/*
+ * Called with neigh->lock held after a hello has changed what we know
+ * about a neighbour, to bring the circuit's router list up to date.
+ */
+static void dn_neigh_rtr_update(struct dn_dev *dn_db, struct dn_neigh *dn,
+                                unsigned long expires)
 {
-        struct elist_cb_state *s = _info;
-        struct dn_neigh *dn;
+        __u8 priority;
 
-        if (neigh->dev != s->dev)
+        if (dn_db == NULL)
                 return;
 
-        dn = container_of(neigh, struct dn_neigh, n);
-        if (!(dn->flags & (DN_NDFLAG_R1|DN_NDFLAG_R2)))
-                return;
+        priority = dn->priority & 0x7f;
 
-        if (s->t == s->n)
-                s->rs = dn_find_slot(s->ptr, s->n, dn->priority);
-        else
-                s->t++;
-        if (s->rs == NULL)
-                return;
+        spin_lock_bh(&dn_rtr_lock);
+        if (!(dn->flags & (DN_NDFLAG_R1|DN_NDFLAG_R2))) {
+                if (!list_empty(&dn->rtr_list)) {
+                        /* The caller holds a reference, this isn't the last */
+                        list_del_init(&dn->rtr_list);
+                        dn_db->rtr_gen++;
+                        neigh_release(&dn->n);
+                }
+        } else if (list_empty(&dn->rtr_list)) {
+                neigh_hold(&dn->n);
+                dn->rtr_priority = priority;
+                dn_rtr_insert(dn_db, dn);
+        } else if (dn->rtr_priority != priority) {
+                list_del(&dn->rtr_list);
+                dn->rtr_priority = priority;
+                dn_rtr_insert(dn_db, dn);
+        }
+        if (expires)
+                dn->rtr_expires = expires;
+        spin_unlock_bh(&dn_rtr_lock);
+}
 
-        dn_dn2eth(s->rs, DN_ADDR(dn));
-        s->rs += 6;
-        *(s->rs) = neigh->nud_state & NUD_CONNECTED ? 0x80 : 0x0;
-        *(s->rs) |= dn->priority;
-        s->rs++;
+/*
+ * Drop routers we haven't heard from within their listen time.
+ */
+void dn_neigh_rtr_expire(struct dn_dev *dn_db)
+{
+        struct dn_neigh *dn, *tmp;
+        LIST_HEAD(dead);
+
+        spin_lock_bh(&dn_rtr_lock);
+        list_for_each_entry_safe(dn, tmp, &dn_db->routers, rtr_list) {
+                if (time_after(jiffies, dn->rtr_expires)) {
+                        list_move(&dn->rtr_list, &dead);
+                        dn_db->rtr_gen++;
+                }
+        }
+        spin_unlock_bh(&dn_rtr_lock);
+
+        dn_rtr_release(&dead);
 }
 
-int dn_neigh_elist(struct net_device *dev, unsigned char *ptr, int n)
+/*
+ * The circuit is going away, let go of all its routers.
+ */
+void dn_neigh_rtr_flush(struct dn_dev *dn_db)
 {
-        struct elist_cb_state state;
+        LIST_HEAD(dead);
+
+        spin_lock_bh(&dn_rtr_lock);
+        list_splice_init(&dn_db->routers, &dead);
+        dn_db->rtr_gen++;
+        spin_unlock_bh(&dn_rtr_lock);
 
-        state.dev = dev;
-        state.t = 0;
-        state.n = n;
-        state.ptr = ptr;
-        state.rs = ptr;
+        dn_rtr_release(&dead);
+}
 
-        neigh_for_each(&dn_neigh_table, neigh_elist_cb, &state);
+/*
+ * Fill in the router list of a router hello with the best n routers
+ * on the circuit. Returns the number of entries used. Whether we can
+ * talk to each one is taken from the neighbour now, not when we last
+ * heard from it.
+ */
+int dn_neigh_elist(struct dn_dev *dn_db, unsigned char *ptr, int n)
+{
+        struct dn_neigh *dn;
+        int t = 0;
+
+        spin_lock_bh(&dn_rtr_lock);
+        list_for_each_entry(dn, &dn_db->routers, rtr_list) {
+                if (t == n)
+                        break;
+                dn_dn2eth(ptr, DN_ADDR(dn));
+                ptr += 6;
+                *ptr = dn->rtr_priority;
+                if (READ_ONCE(dn->n.nud_state) & NUD_CONNECTED)
+                        *ptr |= 0x80;
+                ptr++;
+                t++;
+        }
+        spin_unlock_bh(&dn_rtr_lock);
 
-        return state.t;
+        return t;
 }
 
 
@@ -83,7 +83,6 @@
 #define ACKDELAY        (3 * HZ)
 
 extern int decnet_log_martians;
-extern int decnet_segbufsize;
 
 static void dn_log_martian(struct sk_buff *skb, const char *msg)
 {
@@ -221,6 +220,56 @@ static struct {
  { NSP_REASON_IO, "CI: User data format error" }
 };
 
+/*
+ * Run the socket filter of a listener, if it has one, over a summary
+ * of the connect initiate so that node and object policy can turn
+ * connects away here instead of after accept(). Returns true if the
+ * connect may go ahead.
+ */
+static bool dn_ci_filter(struct sock *sk, struct sk_buff *skb,
+                         struct sockaddr_dn *dstaddr,
+                         struct sockaddr_dn *srcaddr, unsigned char *user)
+{
+        struct dn_skb_cb *cb = DN_SKB_CB(skb);
+        struct sk_filter *filter;
+        struct cifilter_dn *ci;
+        struct sk_buff *fskb;
+        u16 src = le16_to_cpu(cb->src);
+        bool ok = true;
+
+        if (!rcu_access_pointer(sk->sk_filter))
+                return true;
+
+        fskb = alloc_skb(sizeof(*ci), GFP_ATOMIC);
+        if (fskb == NULL)
+                return true;
+
+        ci = skb_put_zero(fskb, sizeof(*ci));
+        ci->cfn_srcnode[0] = src >> 8;
+        ci->cfn_srcnode[1] = src & 0xff;
+        ci->cfn_dstobjnum = dstaddr->sdn_objnum;
+        ci->cfn_dstobjnamel = le16_to_cpu(dstaddr->sdn_objnamel);
+        memcpy(ci->cfn_dstobjname, dstaddr->sdn_objname, ci->cfn_dstobjnamel);
+        ci->cfn_srcobjnum = srcaddr->sdn_objnum;
+        ci->cfn_srcobjnamel = le16_to_cpu(srcaddr->sdn_objnamel);
+        memcpy(ci->cfn_srcobjname, srcaddr->sdn_objname, ci->cfn_srcobjnamel);
+        if (user) {
+                ci->cfn_userl = *user;
+                memcpy(ci->cfn_user, user + 1, ci->cfn_userl);
+        }
+        fskb->dev = skb->dev;
+        fskb->protocol = skb->protocol;
+
+        rcu_read_lock();
+        filter = rcu_dereference(sk->sk_filter);
+        if (filter)
+                ok = bpf_prog_run_save_cb(filter->prog, fskb) != 0;
+        rcu_read_unlock();
+
+        consume_skb(fskb);
+        return ok;
+}
+
 /*
  * This function uses a slightly different lookup method
  * to find its sockets, since it searches on object name/number
@@ -241,6 +290,8 @@ static struct sock *dn_find_listener(struct sk_buff *skb, unsigned short *reason
         int len;
         int err = 0;
         unsigned char menuver;
+        unsigned char *user = NULL;
+        struct sock *sk;
 
         memset(&dstaddr, 0, sizeof(struct sockaddr_dn));
         memset(&srcaddr, 0, sizeof(struct sockaddr_dn));
@@ -307,6 +358,7 @@ static struct sock *dn_find_listener(struct sk_buff *skb, unsigned short *reason
          */
         err++;
         if (menuver & DN_MENUVER_ACC) {
+                user = ptr;
                 if (dn_check_idf(&ptr, &len, 39))
                         goto err_out;
                 if (dn_check_idf(&ptr, &len, 39))
@@ -327,7 +379,18 @@ static struct sock *dn_find_listener(struct sk_buff *skb, unsigned short *reason
         /*
          * 7. Look up socket based on destination end username
          */
-        return dn_sklist_find_listener(&dstaddr);
+        sk = dn_sklist_find_listener(&dstaddr);
+
+        /*
+         * 8. Let the listener's filter turn it away
+         */
+        if (sk && !dn_ci_filter(sk, skb, &dstaddr, &srcaddr, user)) {
+                atomic_inc(&DN_SK(sk)->ci_filtered);
+                sock_put(sk);
+                *reason = NSP_REASON_UR;
+                return NULL;
+        }
+        return sk;
 err_out:
         dn_log_martian(skb, ci_err_table[err].text);
         *reason = ci_err_table[err].reason;
@@ -335,18 +398,55 @@ err_out:
 }
 
 
+/*
+ * Queue a connect initiate for accept(). This can be called without
+ * the socket lock held, the connect initiate queue has its own lock.
+ * If the listen() backlog is full the CI is dropped, just as TCP drops
+ * a SYN, and the remote end will retransmit it. The backlog is the
+ * length of the queue, checked and added to under the queue lock, so
+ * sk_ack_backlog (which needs the socket lock) isn't used.
+ */
 static void dn_nsp_conn_init(struct sock *sk, struct sk_buff *skb)
 {
-        if (sk_acceptq_is_full(sk)) {
+        struct dn_scp *scp = DN_SK(sk);
+        struct sk_buff_head *q = &scp->conn_init_queue;
+        unsigned long flags;
+
+        spin_lock_irqsave(&q->lock, flags);
+        if (skb_queue_len(q) > READ_ONCE(sk->sk_max_ack_backlog)) {
+                spin_unlock_irqrestore(&q->lock, flags);
+                atomic_inc(&scp->ci_overflows);
                 kfree_skb(skb);
                 return;
         }
+        __skb_queue_tail(q, skb);
+        spin_unlock_irqrestore(&q->lock, flags);
 
-        sk_acceptq_added(sk);
-        skb_queue_tail(&sk->sk_receive_queue, skb);
+        atomic_inc(&scp->ci_queued);
         sk->sk_state_change(sk);
 }
 
+/*
+ * If a message was received with a short routing header or with the
+ * Intra-Ethernet bit clear, traffic is going off ethernet and some hop
+ * may not carry the segment size the remote asked for, so revert to the
+ * "SEGMENT BUFFER SIZE" parameter. With path mtu discovery enabled the
+ * remote's segment size is kept; dn_current_mss() limits it to the route
+ * mtu and dn_nsp_xmit_timeout() backs off if large segments get lost.
+ */
+static void dn_nsp_check_offlan(struct sock *sk, struct dn_skb_cb *cb)
+{
+        struct dn_scp *scp = DN_SK(sk);
+
+        if (READ_ONCE(decnet_pmtu_discovery))
+                return;
+
+        if (((cb->rt_flags & DN_RT_PKT_MSK) == DN_RT_PKT_SHORT) ||
+            ((cb->rt_flags & DN_RT_F_IE) == 0))
+                scp->segsize_rem =
+                  decnet_segbufsize - (DN_MAX_NSP_DATA_HEADER + 6);
+}
+
 static void dn_nsp_conn_conf(struct sock *sk, struct sk_buff *skb)
 {
         struct dn_skb_cb *cb = DN_SKB_CB(skb);
@@ -372,16 +472,7 @@ static void dn_nsp_conn_conf(struct sock *sk, struct sk_buff *skb)
                 scp->info_rem = cb->info;
                 scp->segsize_rem = cb->segsize;
 
-                /*
-                 * If the Connect Confirm message was received with
-                 * a short routing header or with the Intra-Ethernet bit
-                 * clear, revert to the "SEGMENT BUFFER SIZE" parameter since
-                 * traffic will be going off ethernet.
-                 */
-                if (((cb->rt_flags & DN_RT_PKT_MSK) == DN_RT_PKT_SHORT) ||
-                    ((cb->rt_flags & DN_RT_F_IE) == 0))
-                        scp->segsize_rem =
-                          decnet_segbufsize - (DN_MAX_NSP_DATA_HEADER + 6);
+                dn_nsp_check_offlan(sk, cb);
 
                 if ((scp->services_rem & NSP_FC_MASK) == NSP_FC_NONE)
                         scp->max_window = decnet_no_fc_max_cwnd;
@@ -474,6 +565,7 @@ static void dn_nsp_disc_init(struct sock *sk, struct sk_buff *skb)
         if (scp->addrrem) {
                 dn_nsp_send_disc(sk, NSP_DISCCONF, NSP_REASON_DC, GFP_ATOMIC);
         }
+        dn_stop_rxt_timer(sk);
         scp->persist_fxn = dn_destroy_timer;
         scp->persist = dn_nsp_persist(sk);
 
@@ -524,6 +616,7 @@ static void dn_nsp_disc_conf(struct sock *sk, struct sk_buff *skb)
                 sk->sk_state_change(sk);
         }
 
+        dn_stop_rxt_timer(sk);
         scp->persist_fxn = dn_destroy_timer;
         scp->persist = dn_nsp_persist(sk);
 
@@ -839,6 +932,8 @@ got_it:
         if (sk != NULL) {
                 struct dn_scp *scp = DN_SK(sk);
 
+                sock_rps_save_rxhash(sk, skb);
+
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5,0,0)
         	if (skb_dst(skb) != rcu_dereference_check(sk->sk_dst_cache, 1)) {
 #else
@@ -867,8 +962,24 @@ got_it:
                  * We linearize everything except data segments here.
                  */
                 if (cb->nsp_flags & ~0x60) {
-                        if (unlikely(skb_linearize(skb)))
+                        if (unlikely(skb_linearize(skb))) {
+                                sock_put(sk);
                                 goto free_out;
+                        }
+                }
+
+                /*
+                 * Fast path for connect initiates to a listener, these
+                 * go straight onto its connect initiate queue rather
+                 * than waiting behind the socket lock.
+                 */
+                if (sk->sk_state == TCP_LISTEN &&
+                    (cb->nsp_flags & 0x0c) == 0x08 &&
+                    ((cb->nsp_flags & 0x70) == 0x10 ||
+                     (cb->nsp_flags & 0x70) == 0x60)) {
+                        dn_nsp_conn_init(sk, skb);
+                        sock_put(sk);
+                        return NET_RX_SUCCESS;
                 }
 
                 return sk_receive_skb(sk, skb, 0);
@@ -938,16 +1049,7 @@ int dn_nsp_backlog_rcv(struct sock *sk, struct sk_buff *skb)
                         sk->sk_state = TCP_ESTABLISHED;
                         sk->sk_state_change(sk);
 
-                        /*
-                         * If the data or ack frame was received with a short
-                         * routing header or with the Intra-Ethernet bit
-                         * clear, revert to the "SEGMENT BUFFER SIZE"
-                         * parameter since traffic will be going off ethernet.
-                         */
-                        if (((cb->rt_flags & DN_RT_PKT_MSK) == DN_RT_PKT_SHORT) ||
-                            ((cb->rt_flags & DN_RT_F_IE) == 0))
-                                scp->segsize_rem =
-                                  decnet_segbufsize - (DN_MAX_NSP_DATA_HEADER + 6);
+                        dn_nsp_check_offlan(sk, cb);
                 }
 
                 if ((cb->nsp_flags & 0x1c) == 0)
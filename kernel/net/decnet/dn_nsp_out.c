@@ -151,34 +151,57 @@ struct sk_buff *dn_alloc_skb(struct sock *sk, int size, gfp_t pri)
 }
 
 /*
- * Calculate persist timer based upon the smoothed round
- * trip time and the variance. Backoff according to the
- * nsp_backoff[] array.
+ * Calculate the retransmit timeout (in nanoseconds) based upon the
+ * smoothed round trip time and the variance. Backoff according to
+ * the nsp_backoff[] array. Never less than net.decnet.min_rto
+ * milliseconds.
  */
-unsigned long dn_nsp_persist(struct sock *sk)
+u64 dn_nsp_cur_rto(struct sock *sk)
 {
         struct dn_scp *scp = DN_SK(sk);
-        unsigned long t = ((scp->nsp_srtt >> 2) + scp->nsp_rttvar) >> 1;
+        u64 t = ((scp->nsp_srtt >> 2) + scp->nsp_rttvar) >> 1;
 
-	if (scp->state != DN_RUN)
-		return 2*HZ;
+        t *= nsp_backoff[scp->nsp_rxtshift] * NSEC_PER_USEC;
 
-        t *= nsp_backoff[scp->nsp_rxtshift];
+        t = max_t(u64, t, READ_ONCE(decnet_min_rto) * NSEC_PER_MSEC);
+        return min_t(u64, t, NSP_MAX_RTO);
+}
 
-        if (t < HZ) t = HZ;
-        if (t > (600*HZ)) t = (600*HZ);
+/*
+ * As dn_nsp_cur_rto(), but also backs off for next time. Only for
+ * when a timer has expired, not for sending.
+ */
+u64 dn_nsp_rto(struct sock *sk)
+{
+        struct dn_scp *scp = DN_SK(sk);
+        u64 t = dn_nsp_cur_rto(sk);
 
         if (scp->nsp_rxtshift < NSP_MAXRXTSHIFT)
                 scp->nsp_rxtshift++;
 
-        /* printk(KERN_DEBUG "rxtshift %lu, t=%lu\n", scp->nsp_rxtshift, t); */
+        /* printk(KERN_DEBUG "rxtshift %lu, t=%llu\n", scp->nsp_rxtshift, t); */
 
         return t;
 }
 
+/*
+ * Calculate persist timer for the slow timer. Outside the RUN
+ * state this is fixed, in the RUN state it is the retransmit
+ * timeout rounded to jiffies.
+ */
+unsigned long dn_nsp_persist(struct sock *sk)
+{
+        struct dn_scp *scp = DN_SK(sk);
+
+	if (scp->state != DN_RUN)
+		return 2*HZ;
+
+        return nsecs_to_jiffies(dn_nsp_rto(sk));
+}
+
 /*
  * This is called each time we get an estimate for the rtt
- * on the link.
+ * on the link, in microseconds.
  */
 static void dn_nsp_rtt(struct sock *sk, long rtt)
 {
@@ -188,12 +211,14 @@ static void dn_nsp_rtt(struct sock *sk, long rtt)
         long delta;
 
         /*
-         * If the jiffies clock flips over in the middle of timestamp
-         * gathering this value might turn out negative, so we make sure
-         * that is it always positive here.
+         * The ack may have been timestamped before the packet it
+         * acknowledges was (re)sent, so make sure that the value is
+         * always positive here.
          */
         if (rtt < 0)
                 rtt = -rtt;
+        if (rtt > NSP_MAX_RTT)
+                rtt = NSP_MAX_RTT;
         /*
          * Add new rtt to smoothed average
          */
@@ -217,6 +242,31 @@ static void dn_nsp_rtt(struct sock *sk, long rtt)
         /* printk(KERN_DEBUG "srtt=%lu rttvar=%lu\n", scp->nsp_srtt, scp->nsp_rttvar); */
 }
 
+/*
+ * Called when the send window opens. Make sure sk_sndbuf can hold
+ * twice the window's worth of segments so the application can keep
+ * the pipe full while earlier segments wait to be acknowledged.
+ * Bounded by decnet_wmem[2], sockets with SO_SNDBUF set are left alone.
+ */
+static void dn_nsp_sndbuf_expand(struct sock *sk)
+{
+        struct dn_scp *scp = DN_SK(sk);
+        int sndbuf;
+
+        if (!READ_ONCE(decnet_moderate_sndbuf) ||
+            (sk->sk_userlocks & SOCK_SNDBUF_LOCK))
+                return;
+
+        sndbuf = 2 * scp->snd_window *
+                 SKB_TRUESIZE(scp->segsize_rem + DN_MAX_NSP_DATA_HEADER + 64);
+        sndbuf = min(sndbuf, READ_ONCE(sysctl_decnet_wmem[2]));
+
+        if (sndbuf > sk->sk_sndbuf) {
+                WRITE_ONCE(sk->sk_sndbuf, sndbuf);
+                sk->sk_write_space(sk);
+        }
+}
+
 /**
  * dn_nsp_clone_and_send - Send a data packet by cloning it
  * @skb: The packet to clone and transmit
@@ -236,7 +286,7 @@ static inline unsigned int dn_nsp_clone_and_send(struct sk_buff *skb,
         if ((skb2 = skb_clone(skb, gfp)) != NULL) {
                 ret = cb->xmit_count;
                 cb->xmit_count++;
-                cb->stamp = jiffies;
+                cb->stamp = ktime_get();
                 cb->ack_delay = 0;
                 skb2->sk = skb->sk;
                 skb2->destructor = dn_nsp_null_destructor;
@@ -291,17 +341,44 @@ recalc_window:
         }
 }
 
-int dn_nsp_xmit_timeout(struct sock *sk)
+/*
+ * With path mtu discovery enabled, connections which leave the local
+ * ethernet keep the segment size the remote asked for. If a segment
+ * larger than the "SEGMENT BUFFER SIZE" parameter allows has been sent
+ * NSP_PMTU_RETRIES times without an ack, assume some hop can't carry it:
+ * stop building large segments on this link and remember the smaller
+ * mtu on the route so that new connections start out at a size which
+ * works.
+ */
+static void dn_nsp_pmtu_blackhole(struct sock *sk)
+{
+        struct dn_scp *scp = DN_SK(sk);
+        struct sk_buff *skb = skb_peek(&scp->data_xmit_queue);
+        int segsize = decnet_segbufsize - (DN_MAX_NSP_DATA_HEADER + 6);
+
+        if (!skb || scp->nsp_rxtshift < NSP_PMTU_RETRIES)
+                return;
+
+        if (skb->len <= segsize + DN_MAX_NSP_DATA_HEADER ||
+            scp->segsize_rem <= segsize)
+                return;
+
+        scp->segsize_rem = segsize;
+        dn_rt_reduce_pmtu(sk, decnet_segbufsize);
+}
+
+void dn_nsp_xmit_timeout(struct sock *sk)
 {
         struct dn_scp *scp = DN_SK(sk);
 
+        if (READ_ONCE(decnet_pmtu_discovery))
+                dn_nsp_pmtu_blackhole(sk);
+
         dn_nsp_output(sk);
 
         if (!skb_queue_empty(&scp->data_xmit_queue) ||
             !skb_queue_empty(&scp->other_xmit_queue))
-                scp->persist = dn_nsp_persist(sk);
-
-        return 0;
+                dn_start_rxt_timer(sk, dn_nsp_rto(sk));
 }
 
 static inline __le16 *dn_mk_common_header(struct dn_scp *scp, struct sk_buff *skb, unsigned char msgflag, int len)
@@ -380,7 +457,8 @@ void dn_nsp_queue_xmit(struct sock *sk, struct sk_buff *skb,
 {
         struct dn_scp *scp = DN_SK(sk);
         struct dn_skb_cb *cb = DN_SKB_CB(skb);
-        unsigned long t = ((scp->nsp_srtt >> 2) + scp->nsp_rttvar) >> 1;
+        unsigned long t = usecs_to_jiffies(((scp->nsp_srtt >> 2) +
+                                            scp->nsp_rttvar) >> 1);
 
         cb->xmit_count = 0;
         dn_nsp_mk_data_header(sk, skb, oth);
@@ -416,8 +494,8 @@ int dn_nsp_check_xmit_queue(struct sock *sk, struct sk_buff *skb, struct sk_buff
         struct sk_buff *skb2, *n, *ack = NULL;
         int wakeup = 0;
         int try_retrans = 0;
-        unsigned long reftime = cb->stamp;
-        unsigned long pkttime;
+        ktime_t reftime = cb->stamp;
+        ktime_t pkttime;
         unsigned short xmit_count;
         unsigned short segnum;
 
@@ -460,10 +538,12 @@ int dn_nsp_check_xmit_queue(struct sock *sk, struct sk_buff *skb, struct sk_buff
                  */
                 if (xmit_count == 1) {
                         if (dn_equal(segnum, acknum))
-                                dn_nsp_rtt(sk, (long)(pkttime - reftime));
+                                dn_nsp_rtt(sk, (long)ktime_us_delta(pkttime, reftime));
 
-                        if (scp->snd_window < scp->max_window)
+                        if (scp->snd_window < scp->max_window) {
                                 scp->snd_window++;
+                                dn_nsp_sndbuf_expand(sk);
+                        }
                 }
 
                 /*
@@ -482,6 +562,18 @@ int dn_nsp_check_xmit_queue(struct sock *sk, struct sk_buff *skb, struct sk_buff
         if (try_retrans)
                 dn_nsp_output(sk);
 
+        /*
+         * New data has been acked, so time what is left from now. The
+         * send paths only start the timer if it isn't already running.
+         */
+        if (wakeup) {
+                if (skb_queue_empty(&scp->data_xmit_queue) &&
+                    skb_queue_empty(&scp->other_xmit_queue))
+                        dn_stop_rxt_timer(sk);
+                else
+                        dn_start_rxt_timer(sk, dn_nsp_cur_rto(sk));
+        }
+
         return wakeup;
 }
 
@@ -663,8 +755,7 @@ int dn_nsp_send_link(struct sock *sk, unsigned char lsflags, char fcval)
 
         dn_nsp_queue_xmit(sk, skb, gfp, 1);
 
-        scp->persist = dn_nsp_persist(sk);
-        scp->persist_fxn = dn_nsp_xmit_timeout;
+        dn_arm_rxt_timer(sk);
 	return 1;
 }
 
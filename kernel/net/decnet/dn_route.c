@@ -80,9 +80,21 @@
 #include <linux/times.h>
 #include <linux/export.h>
 #include <linux/version.h>
+#include <linux/jhash.h>
+#include <linux/interrupt.h>
+#include <linux/percpu.h>
+#include <linux/smp.h>
+#include <linux/cpuhotplug.h>
+#include <asm/unaligned.h>
 #include <asm/errno.h>
 #include <net/net_namespace.h>
 #include <net/netlink.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,5,0)
+#include <net/netdev_rx_queue.h>
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,9,0)
+#include <net/rps.h>
+#endif
 #include <net/neighbour.h>
 #include <net/dst.h>
 #include <net/flow.h>
@@ -93,6 +105,7 @@
 #include <net/dn_route.h>
 #include <net/dn_neigh.h>
 #include <net/dn_fib.h>
+#include <net/dn_l1route.h>
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5,0,0)
 #define NLMSG_PARSE     nlmsg_parse
@@ -136,6 +149,24 @@ static void dn_dst_update_pmtu(struct dst_entry *dst, struct sock *sk,
                                struct sk_buff *skb , u32 mtu,
                                bool confirm_neigh);
 #endif
+/*
+ * NSP has decided that segments of the current size are not getting
+ * through to the socket's peer (see dn_nsp_xmit_timeout()).
+ */
+void dn_rt_reduce_pmtu(struct sock *sk, u32 mtu)
+{
+        struct dst_entry *dst = __sk_dst_get(sk);
+
+        if (dst == NULL)
+                return;
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,19,93)
+        dn_dst_update_pmtu(dst, sk, NULL, mtu);
+#else
+        dn_dst_update_pmtu(dst, sk, NULL, mtu, true);
+#endif
+}
+
 static void dn_dst_redirect(struct dst_entry *dst, struct sock *sk,
                             struct sk_buff *skb);
 static struct neighbour *dn_dst_neigh_lookup(const struct dst_entry *dst,
@@ -281,7 +312,7 @@ static void dn_dst_update_pmtu(struct dst_entry *dst, struct sock *sk,
         else
                 min_mtu -= DN_RT_HDR_LONG;
 
-        if (dst_metric_raw(dst, RTAX_MTU) > mtu && mtu >= min_mtu) {
+        if (dst_mtu(dst) > mtu && mtu >= min_mtu) {
                 if (!(dst_metric_locked(dst, RTAX_MTU))) {
                         dst_metric_set(dst, RTAX_MTU, mtu);
                         dst_set_expires(dst, dn_rt_mtu_expires);
@@ -639,6 +670,15 @@ static int dn_route_discard(struct net *net, struct sock *sk, struct sk_buff *sk
         return NET_RX_SUCCESS;
 }
 
+static int dn_route_rtg_msg(struct net *net, struct sock *sk, struct sk_buff *skb)
+{
+#ifdef CONFIG_DECNET_L1ROUTE
+        if ((DN_SKB_CB(skb)->rt_flags & DN_RT_CNTL_MSK) == DN_RT_PKT_L1RT)
+                dn_l1_rcv(skb);
+#endif
+        return dn_route_discard(net, sk, skb);
+}
+
 static int dn_route_ptp_hello(struct net *net, struct sock *sk, struct sk_buff *skb)
 {
         dn_dev_hello(skb);
@@ -646,26 +686,354 @@ static int dn_route_ptp_hello(struct net *net, struct sock *sk, struct sk_buff *
         return NET_RX_SUCCESS;
 }
 
+static int __dn_route_rcv(struct sk_buff *skb, struct net_device *dev);
+
+#ifdef CONFIG_RPS
+static inline bool dn_rps_needed(void)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,1,0)
+        return static_key_false(&rps_needed);
+#else
+        return static_branch_unlikely(&rps_needed);
+#endif
+}
+
+/*
+ * The flow dissector doesn't understand DECnet, so every frame arriving
+ * on an interface gets the same hash and RPS does all of our receive
+ * processing on one CPU. If the interface has an RPS map, hash the node
+ * addresses and NSP link addresses of data frames and give the frame
+ * that as its hash. NSP saves it on the socket and dn_recvmsg() records
+ * it in the RFS flow table, so with RFS configured a link is processed
+ * on the CPU last reading its socket. Otherwise the hash picks a CPU
+ * from the map, so each logical link stays on one CPU and the links are
+ * spread across the map.
+ *
+ * The frame is handed over on a per-CPU queue of our own and the target
+ * CPU is kicked with an IPI, which schedules a tasklet to run the rest
+ * of dn_route_rcv() there. It isn't passed back to netif_rx(), that
+ * would show it to packet taps and count it a second time. If the kick
+ * fails the queue is run where we are, and a CPU going offline runs
+ * its own queue before it goes, so nothing is left behind on one.
+ *
+ * skb->data is at the length field, the routing flags follow it and any
+ * padding.
+ */
+#define DN_RPS_BACKLOG 1000
+
+struct dn_rps_queue {
+        struct sk_buff_head queue;
+        call_single_data_t csd;
+        struct tasklet_struct tasklet;
+};
+
+static DEFINE_PER_CPU(struct dn_rps_queue, dn_rps_queues);
+
+static u32 dn_route_rps_hash(struct sk_buff *skb)
+{
+        static u32 dn_rps_seed __read_mostly;
+        unsigned int off = 2, hdrlen;
+        unsigned char flags, *ptr;
+        __u16 dst, src;
+        u32 links;
+
+        if (!pskb_may_pull(skb, off + 1))
+                return 0;
+
+        flags = skb->data[off];
+        if (flags & DN_RT_F_PF) {
+                off += flags & ~DN_RT_F_PF;
+                if (!pskb_may_pull(skb, off + 1))
+                        return 0;
+                flags = skb->data[off];
+        }
+
+        if (flags & (DN_RT_PKT_CNTL | DN_RT_F_VER))
+                return 0;
+
+        switch (flags & DN_RT_PKT_MSK) {
+        case DN_RT_PKT_LONG:
+                hdrlen = DN_RT_HDR_LONG;
+                break;
+        case DN_RT_PKT_SHORT:
+                hdrlen = DN_RT_HDR_SHORT;
+                break;
+        default:
+                return 0;
+        }
+
+        /* Routing header, NSP msgflg and both link addresses */
+        if (!pskb_may_pull(skb, off + hdrlen + 5))
+                return 0;
+
+        ptr = skb->data + off;
+        if (hdrlen == DN_RT_HDR_LONG) {
+                dst = get_unaligned((__u16 *)(ptr + 7));
+                src = get_unaligned((__u16 *)(ptr + 15));
+        } else {
+                dst = get_unaligned((__u16 *)(ptr + 1));
+                src = get_unaligned((__u16 *)(ptr + 3));
+        }
+        links = get_unaligned((u32 *)(ptr + hdrlen + 1));
+
+        net_get_random_once(&dn_rps_seed, sizeof(dn_rps_seed));
+        return jhash_3words((u32)dst << 16 | src, links, ETH_P_DNA_RT,
+                            dn_rps_seed);
+}
+
+/*
+ * The CPU that last read the socket this flow belongs to, if RFS knows
+ * it. The table entries are the top bits of the hash and a CPU number.
+ */
+static int dn_route_rfs_cpu(u32 hash)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,9,0)
+        struct rps_sock_flow_table *table =
+                rcu_dereference(net_hotdata.rps_sock_flow_table);
+        u32 cpu_mask = net_hotdata.rps_cpu_mask;
+#else
+        struct rps_sock_flow_table *table = rcu_dereference(rps_sock_flow_table);
+        u32 cpu_mask = rps_cpu_mask;
+#endif
+        u32 ident;
+
+        if (table == NULL)
+                return -1;
+
+        ident = READ_ONCE(table->ents[hash & table->mask]);
+        if ((ident ^ hash) & ~cpu_mask)
+                return -1;
+
+        ident &= cpu_mask;
+        return ident < nr_cpu_ids ? ident : -1;
+}
+
+/*
+ * Returns the CPU that should process this frame, or -1 to carry on
+ * here. Called under rcu_read_lock() from the receive path.
+ */
+static int dn_route_rps_cpu(struct sk_buff *skb, struct net_device *dev)
+{
+        struct netdev_rx_queue *rxqueue = dev->_rx;
+        struct rps_map *map;
+        u32 hash;
+        int cpu;
+
+        if (!READ_ONCE(decnet_rps_steer) || !dn_rps_needed())
+                return -1;
+
+        hash = dn_route_rps_hash(skb);
+        if (hash == 0)
+                return -1;
+        __skb_set_sw_hash(skb, hash, true);
+
+        cpu = dn_route_rfs_cpu(hash);
+        if (cpu < 0) {
+                if (skb_rx_queue_recorded(skb)) {
+                        u16 index = skb_get_rx_queue(skb);
+
+                        if (unlikely(index >= dev->real_num_rx_queues))
+                                return -1;
+                        rxqueue += index;
+                }
+
+                map = rcu_dereference(rxqueue->rps_map);
+                if (map == NULL)
+                        return -1;
+
+                cpu = map->cpus[reciprocal_scale(hash, map->len)];
+        }
+
+        if (cpu == smp_processor_id() || !cpu_online(cpu))
+                return -1;
+
+        return cpu;
+}
+
+static void dn_route_rps_run(unsigned long data)
+{
+        struct dn_rps_queue *q = (struct dn_rps_queue *)data;
+        struct sk_buff_head list;
+        struct sk_buff *skb;
+        unsigned long flags;
+
+        __skb_queue_head_init(&list);
+        spin_lock_irqsave(&q->queue.lock, flags);
+        skb_queue_splice_tail_init(&q->queue, &list);
+        spin_unlock_irqrestore(&q->queue.lock, flags);
+
+        rcu_read_lock();
+        while ((skb = __skb_dequeue(&list)) != NULL)
+                __dn_route_rcv(skb, skb->dev);
+        rcu_read_unlock();
+}
+
+static void dn_route_rps_drop(struct sk_buff *skb)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,18,0)
+        dev_core_stats_rx_dropped_inc(skb->dev);
+#else
+        atomic_long_inc(&skb->dev->rx_dropped);
+#endif
+        kfree_skb(skb);
+}
+
+static void dn_route_rps_queue(struct sk_buff *skb, int cpu)
+{
+        struct dn_rps_queue *q = &per_cpu(dn_rps_queues, cpu);
+        unsigned long flags;
+        bool kick;
+        int err;
+
+        spin_lock_irqsave(&q->queue.lock, flags);
+        if (skb_queue_len(&q->queue) >= DN_RPS_BACKLOG) {
+                spin_unlock_irqrestore(&q->queue.lock, flags);
+                dn_route_rps_drop(skb);
+                return;
+        }
+        kick = skb_queue_empty(&q->queue);
+        __skb_queue_tail(&q->queue, skb);
+        spin_unlock_irqrestore(&q->queue.lock, flags);
+
+        /*
+         * Only the first frame on an empty queue needs to wake the CPU,
+         * the tasklet takes everything that's there when it runs. If
+         * the IPI is still in flight (-EBUSY) it'll pick this one up
+         * too. Any other failure means the CPU has gone, so run its
+         * queue here rather than leave it waiting for a kick that
+         * won't come.
+         */
+        if (kick) {
+                err = smp_call_function_single_async(cpu, &q->csd);
+                if (err && err != -EBUSY)
+                        dn_route_rps_run((unsigned long)q);
+        }
+}
+
+static void dn_route_rps_ipi(void *data)
+{
+        struct dn_rps_queue *q = data;
+
+        tasklet_schedule(&q->tasklet);
+}
+
+/* CPU hotplug: run whatever was queued for a CPU before it goes */
+static int dn_route_rps_cpu_down(unsigned int cpu)
+{
+        struct dn_rps_queue *q = &per_cpu(dn_rps_queues, cpu);
+
+        local_bh_disable();
+        dn_route_rps_run((unsigned long)q);
+        local_bh_enable();
+        return 0;
+}
+
+static int dn_route_rps_hp_state;
+
+/*
+ * Drop anything still queued for a device that's going down. Frames
+ * already taken off a queue are processed under rcu_read_lock(), the
+ * device isn't freed until they're done.
+ */
+void dn_route_rps_flush(struct net_device *dev)
+{
+        struct sk_buff *skb, *tmp;
+        int cpu;
+
+        for_each_possible_cpu(cpu) {
+                struct dn_rps_queue *q = &per_cpu(dn_rps_queues, cpu);
+
+                spin_lock_irq(&q->queue.lock);
+                skb_queue_walk_safe(&q->queue, skb, tmp) {
+                        if (skb->dev == dev) {
+                                __skb_unlink(skb, &q->queue);
+                                kfree_skb(skb);
+                        }
+                }
+                spin_unlock_irq(&q->queue.lock);
+        }
+}
+
+static void __init dn_route_rps_init(void)
+{
+        int cpu;
+
+        for_each_possible_cpu(cpu) {
+                struct dn_rps_queue *q = &per_cpu(dn_rps_queues, cpu);
+
+                skb_queue_head_init(&q->queue);
+                q->csd.func = dn_route_rps_ipi;
+                q->csd.info = q;
+                tasklet_init(&q->tasklet, dn_route_rps_run, (unsigned long)q);
+        }
+
+        dn_route_rps_hp_state = cpuhp_setup_state_nocalls(CPUHP_AP_ONLINE_DYN,
+                                                          "net/decnet:rps",
+                                                          NULL,
+                                                          dn_route_rps_cpu_down);
+}
+
+static void __exit dn_route_rps_cleanup(void)
+{
+        int cpu;
+
+        if (dn_route_rps_hp_state > 0)
+                cpuhp_remove_state_nocalls(dn_route_rps_hp_state);
+
+        for_each_possible_cpu(cpu) {
+                struct dn_rps_queue *q = &per_cpu(dn_rps_queues, cpu);
+
+                tasklet_kill(&q->tasklet);
+                skb_queue_purge(&q->queue);
+        }
+}
+#else
+void dn_route_rps_flush(struct net_device *dev)
+{
+}
+#endif
+
 int dn_route_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type *pt, struct net_device *orig_dev)
+{
+        if (!net_eq(dev_net(dev), &init_net) ||
+            rcu_access_pointer(dev->dn_ptr) == NULL) {
+                kfree_skb(skb);
+                return NET_RX_DROP;
+        }
+
+        if ((skb = skb_share_check(skb, GFP_ATOMIC)) == NULL)
+                return NET_RX_DROP;
+
+#ifdef CONFIG_RPS
+        {
+                int cpu = dn_route_rps_cpu(skb, dev);
+
+                if (cpu >= 0) {
+                        dn_route_rps_queue(skb, cpu);
+                        return NET_RX_SUCCESS;
+                }
+        }
+#endif
+
+        return __dn_route_rcv(skb, dev);
+}
+
+static int __dn_route_rcv(struct sk_buff *skb, struct net_device *dev)
 {
         struct dn_skb_cb *cb;
         unsigned char flags = 0;
-        __u16 len = le16_to_cpu(*(__le16 *)skb->data);
+        __u16 len;
         struct dn_dev *dn = rcu_dereference(dev->dn_ptr);
         unsigned char padlen = 0;
 
-        if (!net_eq(dev_net(dev), &init_net))
-                goto dump_it;
-
         if (dn == NULL)
                 goto dump_it;
 
-        if ((skb = skb_share_check(skb, GFP_ATOMIC)) == NULL)
-                goto out;
-
         if (!pskb_may_pull(skb, 3))
                 goto dump_it;
 
+        len = le16_to_cpu(*(__le16 *)skb->data);
+
         skb_pull(skb, 2);
 
         if (len > skb->len)
@@ -676,7 +1044,7 @@ int dn_route_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type
         flags = *skb->data;
 
         cb = DN_SKB_CB(skb);
-        cb->stamp = jiffies;
+        cb->stamp = ktime_get();
         cb->iif = dev->ifindex;
 
         /*
@@ -737,7 +1105,7 @@ int dn_route_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type
 
                         return NF_HOOK(NFPROTO_DECNET, NF_DN_ROUTE,
                                        &init_net, NULL, skb, skb->dev, NULL,
-                                       dn_route_discard);
+                                       dn_route_rtg_msg);
                 case DN_RT_PKT_ERTH:
 #ifndef CONFIG_DECNET_ROUTER
                         if (dn_IVprime && ((flags & DN_RT_PKT_IVP) == 0))
@@ -774,7 +1142,6 @@ int dn_route_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type
 
 dump_it:
         kfree_skb(skb);
-out:
         return NET_RX_DROP;
 }
 
@@ -895,9 +1262,27 @@ static unsigned int dn_dst_default_advmss(const struct dst_entry *dst)
 
 static unsigned int dn_dst_mtu(const struct dst_entry *dst)
 {
+        const struct dn_route *rt = (const struct dn_route *) dst;
         unsigned int mtu = dst_metric_raw(dst, RTAX_MTU);
 
-        return mtu ? : dst->dev->mtu;
+        if (!mtu)
+                mtu = dst->dev->mtu;
+
+        /*
+         * Never send more than the next hop said it could receive in
+         * its hello messages, so that a jumbo frame interface doesn't
+         * overrun an adjacent node with a standard sized buffer. The
+         * block size doesn't include the 16 bit length field which
+         * mtu2blksize() takes off the device mtu.
+         */
+        if (rt->n) {
+                struct dn_neigh *dn = container_of(rt->n, struct dn_neigh, n);
+
+                if (dn->blksize >= 230 && (dn->blksize + 2) < mtu)
+                        mtu = dn->blksize + 2;
+        }
+
+        return mtu;
 }
 
 static struct neighbour *dn_dst_neigh_lookup(const struct dst_entry *dst,
@@ -1964,6 +2349,10 @@ void __init dn_route_init(void)
 
         dn_dst_ops.gc_thresh = (dn_rt_hash_mask + 1);
 
+#ifdef CONFIG_RPS
+        dn_route_rps_init();
+#endif
+
         proc_create_seq_private("decnet_cache", 0444, init_net.proc_net,
                         &dn_rt_cache_seq_ops,
                         sizeof(struct dn_rt_cache_iter_state), NULL);
@@ -1981,6 +2370,9 @@ void __exit dn_route_cleanup(void)
 {
         del_timer(&dn_route_timer);
         dn_run_flush(NULL);
+#ifdef CONFIG_RPS
+        dn_route_rps_cleanup();
+#endif
 
         remove_proc_entry("decnet_cache", init_net.proc_net);
         dst_entries_destroy(&dn_dst_ops);
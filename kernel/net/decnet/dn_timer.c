@@ -15,23 +15,122 @@
  *       Steve Whitehouse      : Added checks for sk->sock_readers
  *       David S. Miller       : New socket locking
  *       Steve Whitehouse      : Timer grabs socket ref.
+ *                             : NSP retransmits moved to an hrtimer.
  */
 #include <linux/net.h>
 #include <linux/socket.h>
 #include <linux/skbuff.h>
 #include <linux/netdevice.h>
 #include <linux/timer.h>
+#include <linux/hrtimer.h>
+#include <linux/version.h>
 #include <linux/spinlock.h>
 #include <net/sock.h>
 #include <linux/atomic.h>
 #include <linux/jiffies.h>
 #include <net/flow.h>
 #include <net/dn.h>
+#include <net/dn_nsp.h>
 
 extern void dn_nsp_send_data_ack(struct sock *);
 
 /*
- * Slow timer is for everything else (n * 500mS)
+ * Retransmit timer (RUN state only). The timer holds a reference to
+ * the socket while it is queued. Timers are only started with the
+ * socket locked, so the hrtimer_is_queued() test doesn't race with
+ * another start.
+ */
+
+static enum hrtimer_restart dn_rxt_timer(struct hrtimer *t);
+
+void dn_init_rxt_timer(struct sock *sk)
+{
+	struct dn_scp *scp = DN_SK(sk);
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,13,0)
+	hrtimer_init(&scp->rxt_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+	scp->rxt_timer.function = dn_rxt_timer;
+#else
+	hrtimer_setup(&scp->rxt_timer, dn_rxt_timer, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL_SOFT);
+#endif
+	scp->deferred = 0;
+}
+
+void dn_start_rxt_timer(struct sock *sk, u64 timeout)
+{
+	struct dn_scp *scp = DN_SK(sk);
+
+	if (!hrtimer_is_queued(&scp->rxt_timer))
+		sock_hold(sk);
+	hrtimer_start(&scp->rxt_timer, ns_to_ktime(timeout),
+		      HRTIMER_MODE_REL_SOFT);
+}
+
+/*
+ * Start the timer for data just sent, unless it is already running for
+ * earlier data. Restarting it on every send would push it back for as
+ * long as we keep sending.
+ */
+void dn_arm_rxt_timer(struct sock *sk)
+{
+	struct dn_scp *scp = DN_SK(sk);
+
+	if (!hrtimer_is_queued(&scp->rxt_timer))
+		dn_start_rxt_timer(sk, dn_nsp_cur_rto(sk));
+}
+
+void dn_stop_rxt_timer(struct sock *sk)
+{
+	struct dn_scp *scp = DN_SK(sk);
+
+	if (hrtimer_try_to_cancel(&scp->rxt_timer) == 1)
+		__sock_put(sk);
+}
+
+static void dn_rxt_expired(struct sock *sk)
+{
+	struct dn_scp *scp = DN_SK(sk);
+
+	if (scp->state == DN_RUN)
+		dn_nsp_xmit_timeout(sk);
+}
+
+static enum hrtimer_restart dn_rxt_timer(struct hrtimer *t)
+{
+	struct dn_scp *scp = container_of(t, struct dn_scp, rxt_timer);
+	struct sock *sk = (struct sock *)scp - 1;
+
+	bh_lock_sock(sk);
+	if (!sock_owned_by_user(sk)) {
+		dn_rxt_expired(sk);
+	} else if (!test_and_set_bit(DN_RXT_DEFERRED, &scp->deferred)) {
+		/* Reference is dropped by dn_release_cb() */
+		sock_hold(sk);
+	}
+	bh_unlock_sock(sk);
+	sock_put(sk);
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Called from release_sock() with the socket spinlock held, to do
+ * anything the timers had to put off because the user owned the socket.
+ */
+void dn_release_cb(struct sock *sk)
+{
+	struct dn_scp *scp = DN_SK(sk);
+
+	if (test_and_clear_bit(DN_RXT_DEFERRED, &scp->deferred)) {
+		dn_rxt_expired(sk);
+		__sock_put(sk);
+	}
+}
+
+/*
+ * Slow timer is for everything else (n * 500mS): connection
+ * establishment and disconnection, keepalives and delayed acks.
  */
 
 #define SLOW_INTERVAL (HZ/2)
@@ -63,9 +162,9 @@ static void dn_slow_timer(struct timer_list *t)
 
 	/*
 	 * The persist timer is the standard slow timer used for retransmits
-	 * in both connection establishment and disconnection as well as
-	 * in the RUN state. The different states are catered for by changing
-	 * the function pointer in the socket. Setting the timer to a value
+	 * in both connection establishment and disconnection (the RUN
+	 * state uses rxt_timer). The different states are catered for by
+	 * changing the function pointer in the socket. Setting the timer to a value
 	 * of zero turns it off. We allow the persist_fxn to turn the
 	 * timer off in a permant way by returning non-zero, so that
 	 * timer based routines may remove sockets. This is why we have a
@@ -38,7 +38,13 @@ int decnet_log_martians = 1;
 int decnet_no_fc_max_cwnd = NSP_MIN_WINDOW;
 int decnet_dlyack_seq = 3;
 int decnet_segbufsize = 576;
+int decnet_pmtu_discovery = 0;
+int decnet_rps_steer = 1;
+int decnet_min_rto = 20;
+int decnet_l1_routing = 0;
 int decnet_outgoing_timer = 60;
+int decnet_moderate_rcvbuf = 1;
+int decnet_moderate_sndbuf = 1;
 
 char node_name[7] = "???";
 
@@ -57,9 +63,15 @@ static int max_decnet_no_fc_max_cwnd[] = { NSP_MAX_WINDOW };
 static int min_decnet_dlyack_seq[] = { NSP_MIN_WINDOW };
 static int max_decnet_dlyack_seq[] = { NSP_MAX_WINDOW };
 static int min_decnet_segbufsize[] = { 230 };
-static int max_decnet_segbufsize[] = { ETH_DATA_LEN - DN_RT_HDR_LONG };
+static int max_decnet_segbufsize[] = { 0xffff - DN_RT_HDR_LONG };
 static int min_decnet_timer[] = { 1 };
 static int max_decnet_timer[] = { 65535 };
+static int min_decnet_min_rto[] = { 1 };
+static int max_decnet_min_rto[] = { 1000 };
+#ifdef CONFIG_DECNET_L1ROUTE
+static int min_decnet_l1_routing[] = { 0 };
+static int max_decnet_l1_routing[] = { 1 };
+#endif
 
 static struct ctl_table_header *dn_table_header = NULL;
 
@@ -347,6 +359,40 @@ static struct ctl_table dn_table[] = {
                 .extra1 = &min_decnet_segbufsize,
                 .extra2 = &max_decnet_segbufsize
         },
+        {
+                .procname = "pmtu_discovery",
+                .data = &decnet_pmtu_discovery,
+                .maxlen = sizeof(int),
+                .mode = 0644,
+                .proc_handler = proc_dointvec,
+        },
+        {
+                .procname = "min_rto",
+                .data = &decnet_min_rto,
+                .maxlen = sizeof(int),
+                .mode = 0644,
+                .proc_handler = proc_dointvec_minmax,
+                .extra1 = &min_decnet_min_rto,
+                .extra2 = &max_decnet_min_rto
+        },
+        {
+                .procname = "rps_steer",
+                .data = &decnet_rps_steer,
+                .maxlen = sizeof(int),
+                .mode = 0644,
+                .proc_handler = proc_dointvec,
+        },
+#ifdef CONFIG_DECNET_L1ROUTE
+        {
+                .procname = "l1_routing",
+                .data = &decnet_l1_routing,
+                .maxlen = sizeof(int),
+                .mode = 0644,
+                .proc_handler = proc_dointvec_minmax,
+                .extra1 = &min_decnet_l1_routing,
+                .extra2 = &max_decnet_l1_routing
+        },
+#endif
 	{
 		.procname = "outgoing_timer",
 		.data = &decnet_outgoing_timer,
@@ -377,6 +423,20 @@ static struct ctl_table dn_table[] = {
                 .mode = 0644,
                 .proc_handler = proc_dointvec,
         },
+        {
+                .procname = "moderate_rcvbuf",
+                .data = &decnet_moderate_rcvbuf,
+                .maxlen = sizeof(int),
+                .mode = 0644,
+                .proc_handler = proc_dointvec,
+        },
+        {
+                .procname = "moderate_sndbuf",
+                .data = &decnet_moderate_sndbuf,
+                .maxlen = sizeof(int),
+                .mode = 0644,
+                .proc_handler = proc_dointvec,
+        },
         {
                 .procname = "debug",
                 .data = &decnet_debug_level,